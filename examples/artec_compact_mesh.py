@@ -0,0 +1,103 @@
+# Reference decoder for the compact mesh format returned by getf_frame_mesh_compact(),
+# getf_composite_mesh_compact(), and getf_deferred_capture_compact()
+#
+# Format, all values little endian:
+#
+#   Header (56 bytes)
+#     char[4]    magic "ACMF"
+#     uint8      version, currently 1
+#     uint8      flags, 0x1 normals present, 0x2 payload deflated with zlib
+#     uint8      position_bytes, 2 or 4
+#     uint8      reserved
+#     uint32     vertex_count
+#     uint32     triangle_count
+#     float64    precision in mm
+#     float64[3] origin in mm, the minimum corner of the bounding box
+#     uint32     payload size before deflate
+#     uint32     stored payload size
+#
+#   Payload
+#     vertex_count * 3 unsigned integers of position_bytes, the x, y, z of each vertex as
+#       round((p - origin) / precision)
+#     vertex_count * 2 int8 octahedral encoded normals, if the normals flag is set
+#     triangle_count * 3 varint encoded triangle indices. Each index is stored as the zigzag encoded
+#       difference from the previous index.
+
+import struct
+import zlib
+import numpy as np
+
+_HEADER = struct.Struct("<4sBBBBIId3dII")
+
+
+def _decode_varints(data, count):
+    ret = np.empty(count, dtype=np.uint64)
+    pos = 0
+    for i in range(count):
+        v = 0
+        shift = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            v |= (b & 0x7F) << shift
+            if b < 0x80:
+                break
+            shift += 7
+        ret[i] = v
+    return ret, pos
+
+
+def decode_compact_mesh(data):
+    """Decode a compact mesh blob. Returns (vertices, normals, triangles). Vertices are an Nx3 float64 array in mm,
+    normals are an Nx3 float64 array or None, and triangles are an Mx3 uint32 array."""
+    data = bytes(data)
+    magic, version, flags, position_bytes, _, vertex_count, triangle_count, precision, ox, oy, oz, \
+        payload_size, stored_size = _HEADER.unpack_from(data, 0)
+    if magic != b"ACMF" or version != 1:
+        raise ValueError("Not a compact mesh")
+    payload = data[_HEADER.size:_HEADER.size + stored_size]
+    if flags & 0x2:
+        payload = zlib.decompress(payload)
+    if len(payload) != payload_size:
+        raise ValueError("Invalid compact mesh payload size")
+
+    pos = 0
+    dtype = np.dtype("<u2") if position_bytes == 2 else np.dtype("<u4")
+    q = np.frombuffer(payload, dtype=dtype, count=vertex_count * 3, offset=pos).reshape((-1, 3))
+    pos += vertex_count * 3 * position_bytes
+    vertices = q.astype(np.float64) * precision + np.array([ox, oy, oz])
+
+    normals = None
+    if flags & 0x1:
+        e = np.frombuffer(payload, dtype=np.int8, count=vertex_count * 2, offset=pos).reshape((-1, 2))
+        pos += vertex_count * 2
+        x = e[:, 0].astype(np.float64) / 127.0
+        y = e[:, 1].astype(np.float64) / 127.0
+        z = 1.0 - np.abs(x) - np.abs(y)
+        neg = z < 0
+        x_neg = (1.0 - np.abs(y[neg])) * np.where(x[neg] >= 0, 1.0, -1.0)
+        y_neg = (1.0 - np.abs(x[neg])) * np.where(y[neg] >= 0, 1.0, -1.0)
+        x[neg] = x_neg
+        y[neg] = y_neg
+        normals = np.stack((x, y, z), axis=1)
+        normals /= np.linalg.norm(normals, axis=1)[:, None]
+
+    zz, _ = _decode_varints(payload[pos:], triangle_count * 3)
+    deltas = (zz >> np.uint64(1)).astype(np.int64) ^ -(zz & np.uint64(1)).astype(np.int64)
+    triangles = np.cumsum(deltas).astype(np.uint32).reshape((-1, 3))
+
+    return vertices, normals, triangles
+
+
+if __name__ == "__main__":
+    from RobotRaconteur.Client import *
+
+    c = RRN.ConnectService('rr+tcp://localhost:64238?service=scanner')
+
+    h = c.capture_deferred(False)
+    try:
+        compact_bytes = c.getf_deferred_capture_compact(h, 0.05, True)
+    finally:
+        c.deferred_capture_free([h])
+    vertices, normals, triangles = decode_compact_mesh(compact_bytes)
+    print(f"Decoded {len(vertices)} vertices and {len(triangles)} triangles from {len(compact_bytes)} bytes")
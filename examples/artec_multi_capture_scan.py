@@ -11,7 +11,7 @@ for i in range(N):
     scan_handles.append(c.capture_deferred(False))
 
 
-prepare_gen = c.deferred_capture_prepare(scan_handles)
+prepare_gen = c.deferred_capture_prepare(scan_handles, 0)
 with suppress(RR.StopIterationException):
     prepare_res = prepare_gen.Next()
     print(prepare_res)
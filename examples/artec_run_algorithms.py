@@ -49,12 +49,14 @@ fast_fus.data.resolution = 2
 algs.append(fast_fus)
 
 # Run the algorithms
-alg_gen = c.run_algorithms(input_model_handle, algs)
+alg_gen = c.run_algorithms(input_model_handle, algs, 0)
 
 with suppress(RR.StopIterationException):
     while True:
         alg_res = alg_gen.Next()
-        print(f"alg_res: {alg_res.action_status}, {alg_res.current_algorithm}")
+        print(f"alg_res: {alg_res.action_status}, {alg_res.current_algorithm}, "
+              f"progress: {alg_res.progress_current}/{alg_res.progress_total} ({alg_res.progress*100:.0f}%), "
+              f"eta: {alg_res.eta:.1f} s")
 
 # Get and save the result
 output_model_handle = alg_res.output_model_handle
@@ -3,8 +3,15 @@
 #include <artec/sdk/base/TRef.h>
 #include <artec/sdk/base/IJobObserver.h>
 #include <artec/sdk/base/AlgorithmWorkset.h>
+#include <artec/sdk/base/IProgressObserver.h>
+#include <artec/sdk/base/RefBase.h>
 #include <artec/sdk/algorithms/Algorithms.h>
-#include "artec_scanner_util.h" 
+#include "artec_scanner_util.h"
+#include "artec_scanner_algorithm_cache.h"
+#include "artec_scanner_cpu_budget.h"
+#include "artec_scanner_job_manager.h"
+#include <boost/atomic.hpp>
+#include <chrono>
 
 #pragma once
 
@@ -12,65 +19,142 @@ namespace artec_scanner_robotraconteur_driver
 {
     class ArtecScannerImpl;
     class RRArtecModel;
-    class RunAlgorithms : public RobotRaconteur::Generator<experimental::artec_scanner::RunAlgorithmsStatusPtr,void>,
-        public RR_ENABLE_SHARED_FROM_THIS<RunAlgorithms>
+
+    // Progress reported by the SDK for one algorithm job. The SDK worker thread writes the atomics and the
+    // status is read without locking.
+    class AlgorithmProgressObserver : public artec::sdk::base::RefBase<artec::sdk::base::IProgressObserver>
+    {
+    public:
+        boost::atomic<int32_t> current{0};
+        boost::atomic<int32_t> total{0};
+
+        void report(int current, int total) override;
+    };
+
+    // One algorithm in a RunAlgorithms graph. The node runs once its input node has completed, using the
+    // output model of the input node as its input model. Nodes without an input use the input model
+    // passed to Init().
+    struct RunAlgorithmsNode
+    {
+        std::string name;
+        // Index of the input node, or -1 to use the input model
+        int32_t input = -1;
+        std::vector<uint32_t> children;
+        // Input model identity followed by the settings of this node and all of its ancestors
+        std::string cache_key;
+        artec::sdk::base::TRef<artec::sdk::algorithms::IAlgorithm> algorithm;
+        artec::sdk::base::AlgorithmWorkset workset;
+        // Thread limit requested in the algorithm settings, or zero for no limit
+        uint32_t max_threads = 0;
+        CpuBudgetLeasePtr cpu_lease;
+        boost::shared_ptr<AlgorithmProgressObserver> progress;
+        std::chrono::steady_clock::time_point start_time;
+        std::chrono::steady_clock::time_point end_time;
+        boost::shared_ptr<RRArtecModel> output_model;
+        size_t output_bytes = 0;
+        // Keep the output after the children complete and return it as a model handle
+        bool retain_output = false;
+        bool started = false;
+        bool complete = false;
+        // Output was found in the algorithm result cache
+        bool cache_hit = false;
+        // Output is also held by the algorithm result cache
+        bool cached = false;
+        // Not run because all children were found in the cache
+        bool skipped = false;
+    };
+
+    using RunAlgorithmsNodePtr = boost::shared_ptr<RunAlgorithmsNode>;
+
+    // Runs a graph of algorithms. Each node is launched as soon as its input is available, so independent
+    // branches run concurrently. All jobs share one cancellation source. The output models of the leaf
+    // nodes are returned when the graph completes.
+    class RunAlgorithms : public QueuedJobGenerator<RunAlgorithms,experimental::artec_scanner::RunAlgorithmsStatusPtr>
     {
         protected:
             boost::weak_ptr<ArtecScannerImpl> parent;
             boost::shared_ptr<ArtecScannerImpl> GetParent();
-            boost::mutex this_lock;
-            bool started = false;
-            bool closed = false;
-            bool aborted = false;
-            bool completed = false;
             bool artec_job_complete = false;
-            artec::sdk::base::ErrorCode artec_job_status = artec::sdk::base::ErrorCode_UnknownExceptionType;
+            artec::sdk::base::ErrorCode artec_job_status = artec::sdk::base::ErrorCode_OK;
             boost::shared_ptr<RRArtecModel> input_model;
 
-            boost::shared_ptr<RRArtecModel> current_input_model;
-            boost::shared_ptr<RRArtecModel> current_output_model;
+            std::vector<RunAlgorithmsNodePtr> nodes;
+            uint32_t running_count = 0;
+            AlgorithmResultCachePtr cache;
+            CpuBudgetPtr cpu_budget;
+            uint32_t cache_hits = 0;
+            uint32_t cache_misses = 0;
+            // Estimated size of the models currently held by the run
+            size_t model_bytes = 0;
+            size_t input_model_bytes = 0;
+            // Estimated size of the models held by the run that are also held by the result cache, so they are
+            // not counted twice in the peak
+            size_t cached_model_bytes = 0;
+            // Peak of the models held by the run plus the models held by the result cache
+            size_t peak_model_bytes = 0;
+            size_t peak_resident_bytes = 0;
+            std::chrono::steady_clock::time_point start_time;
+            // Smoothed estimate of the remaining time in seconds, or -1 if unknown
+            double eta = -1.0;
+            int32_t failed_algorithm = -1;
 
-            artec::sdk::base::AlgorithmWorkset current_workset;
             artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
 
             uint32_t current_algorithm = 0;
             uint32_t last_algorithm_update = 0;
-            RobotRaconteur::TimerPtr next_timer;
-
-            std::vector<artec::sdk::base::TRef<artec::sdk::algorithms::IAlgorithm> > artec_algorithms;
-
-            boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
 
         public:
             friend class RunAlgorithmsJobObserver;
 
             RunAlgorithms(boost::shared_ptr<ArtecScannerImpl> parent);
 
-            void Init(boost::shared_ptr<RRArtecModel> input_model, 
+            // Run algorithms in sequence, each using the output of the previous algorithm as input
+            void Init(boost::shared_ptr<RRArtecModel> input_model,
                 const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms);
 
-            void AsyncNext(boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
-                override;
+            // Run a graph of algorithms. Each node must be listed after its input node.
+            void Init(boost::shared_ptr<RRArtecModel> input_model,
+                const RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmPipelineNode>& pipeline);
 
-            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+        protected:
+            void init_nodes(boost::shared_ptr<RRArtecModel> input_model, std::vector<RunAlgorithmsNodePtr>& nodes);
 
-            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+            // Start the run once admitted by the job queue. Must be called with this_lock held.
+            void start_job() override;
 
-            experimental::artec_scanner::RunAlgorithmsStatusPtr Next() override {return nullptr;}
-            void Close() override {}
-            void Abort() override {}
+            bool job_complete() override;
+
+            bool status_updated() override;
+
+            // Cancels the running algorithms
+            void stop_job(bool abort) override;
+
+            // Resolve nodes from the algorithm result cache before launching. Nodes whose children are all
+            // cached are skipped. Must be called with this_lock held.
+            void resolve_cached_nodes();
+
+            // Launch all nodes whose inputs are available. Must be called with this_lock held.
+            void launch_ready_nodes();
 
-        protected:
             void algorithm_job_complete(artec::sdk::base::ErrorCode result, uint32_t job_number);
 
+            // Release the input of a completed node once no other node needs it. Must be called with
+            // this_lock held.
+            void release_node_input(uint32_t node_index);
+
+            void add_model_bytes(size_t bytes);
+
+            void update_peak_model_bytes();
+
+            void update_peak_resident_bytes();
+
             void complete_gen(boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler) override;
+
+            experimental::artec_scanner::RunAlgorithmsStatusPtr running_status() override;
 
-            void next_timer_handler(const RobotRaconteur::TimerEvent& evt);
+            // Fill progress, stage times, and ETA. Must be called with this_lock held.
+            void fill_progress(const experimental::artec_scanner::RunAlgorithmsStatusPtr& status);
     };
 
     class RunAlgorithmsJobObserver : public artec::sdk::base::JobObserverBase
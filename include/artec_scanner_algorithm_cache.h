@@ -0,0 +1,50 @@
+#include "artec_scanner_util.h"
+#include <list>
+#include <set>
+#include <unordered_map>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class RRArtecModel;
+
+    // Output models of completed algorithms, keyed by the input model identity and the settings of each
+    // algorithm leading to the output. Least recently used entries are evicted when the estimated size of
+    // the cached models exceeds the memory budget.
+    class AlgorithmResultCache
+    {
+    protected:
+        struct Entry
+        {
+            std::string key;
+            boost::shared_ptr<RRArtecModel> model;
+            size_t bytes = 0;
+        };
+
+        boost::mutex this_lock;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t budget_bytes = 0;
+        size_t total_bytes = 0;
+
+    public:
+        AlgorithmResultCache(size_t budget_bytes);
+
+        // Returns nullptr if the key is not in the cache
+        boost::shared_ptr<RRArtecModel> Get(const std::string& key);
+
+        // bytes is the estimated size of the model from EstimateModelBytes()
+        void Put(const std::string& key, boost::shared_ptr<RRArtecModel> model, size_t bytes);
+
+        void Clear();
+
+        size_t GetBytes();
+
+        // Estimated size of the cached models that are not in counted. The cached models are added to counted.
+        size_t GetBytes(std::set<artec::sdk::base::IModel*>& counted);
+    };
+
+    using AlgorithmResultCachePtr = boost::shared_ptr<AlgorithmResultCache>;
+}
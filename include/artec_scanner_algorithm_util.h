@@ -51,8 +51,31 @@ namespace artec_scanner_robotraconteur_driver
         const experimental::artec_scanner::OutliersRemovalAlgorithmPtr& settings, 
         artec::sdk::base::ScannerType scanner_type);
 
+    // Create an algorithm from one of the algorithm settings structures, including the algorithms implemented
+    // by the driver. Throws InvalidArgumentException if the structure type is not a supported algorithm.
+    void create_algorithm(artec::sdk::algorithms::IAlgorithm** alg,
+        const RobotRaconteur::RRValuePtr& settings,
+        artec::sdk::base::ScannerType scanner_type);
+
+    // Canonical string of the algorithm type and settings fields. Two settings structures that create the
+    // same algorithm return the same key. Used to key the algorithm result cache.
+    std::string algorithm_settings_key(const RobotRaconteur::RRValuePtr& settings);
+
+    // Thread limit requested with the "max_threads" entry of the extended field of the algorithm settings.
+    // Returns zero if no limit is requested.
+    uint32_t algorithm_max_threads(const RobotRaconteur::RRValuePtr& settings);
+
     class RRArtecModel;
 
     RobotRaconteur::RRValuePtr util_initialize_algorithm(boost::shared_ptr<RRArtecModel> model, const std::string& algorithm);
 
+    // Settings structure with the default settings of the algorithm for a scanner type. algorithm may be the
+    // structure name with or without the service prefix.
+    RobotRaconteur::RRValuePtr util_initialize_algorithm(const std::string& algorithm,
+        artec::sdk::base::ScannerType scanner_type);
+
+    // Settings structure of the algorithm type with all fields zero, or nullptr if the type is not a supported
+    // algorithm
+    RobotRaconteur::RRValuePtr util_new_algorithm_settings(const std::string& algorithm);
+
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "artec_scanner_util.h"
+#include <artec/sdk/capturing/IScanner.h>
+#include <artec/sdk/capturing/IFrameProcessor.h>
+#include <artec/sdk/capturing/IFrame.h>
+#include <artec/sdk/base/TRef.h>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // A raw captured frame. Reconstruction into a mesh is done later by a ScannerFrameProcessor.
+    class ScannerFrame
+    {
+    public:
+        // Estimated memory held by the raw frame data
+        virtual size_t estimate_bytes() { return 0; }
+
+        virtual ~ScannerFrame() {}
+    };
+
+    using ScannerFramePtr = boost::shared_ptr<ScannerFrame>;
+
+    class ScannerFrameProcessor
+    {
+    public:
+        virtual void reconstruct(const ScannerFramePtr& frame, artec::sdk::base::IFrameMesh** mesh) = 0;
+
+        virtual ~ScannerFrameProcessor() {}
+    };
+
+    using ScannerFrameProcessorPtr = boost::shared_ptr<ScannerFrameProcessor>;
+
+    // Capture interface used by ArtecScannerImpl. Implemented by the Artec SDK scanner and by the
+    // simulated scanner used for benchmarking without hardware.
+    class ScannerBackend
+    {
+    public:
+        virtual std::string get_serial() = 0;
+
+        virtual ScannerFramePtr capture(bool with_texture) = 0;
+
+        virtual ScannerFrameProcessorPtr create_frame_processor() = 0;
+
+        // Returns nullptr if the backend is not an Artec SDK scanner. The scanning procedure
+        // requires an SDK scanner.
+        virtual artec::sdk::capturing::IScanner* get_scanner() = 0;
+
+        virtual ~ScannerBackend() {}
+    };
+
+    using ScannerBackendPtr = boost::shared_ptr<ScannerBackend>;
+
+    // Pool of frame processors for one backend. Frame processors are expensive to create, so they are
+    // created once and reused by the deferred capture prepare threads.
+    class ScannerFrameProcessorPool : public RR_ENABLE_SHARED_FROM_THIS<ScannerFrameProcessorPool>
+    {
+    protected:
+        ScannerBackendPtr backend;
+        boost::mutex this_lock;
+        std::vector<ScannerFrameProcessorPtr> idle;
+
+        void Release(const ScannerFrameProcessorPtr& processor);
+
+    public:
+        ScannerFrameProcessorPool(ScannerBackendPtr backend);
+
+        // Create frame processors until at least count are idle
+        void Prepare(size_t count);
+
+        // Returns a frame processor. It is returned to the pool when the last reference is released.
+        ScannerFrameProcessorPtr Acquire();
+    };
+
+    using ScannerFrameProcessorPoolPtr = boost::shared_ptr<ScannerFrameProcessorPool>;
+
+    class ArtecSdkScannerFrame : public ScannerFrame
+    {
+    public:
+        artec::sdk::base::TRef<artec::sdk::capturing::IFrame> frame;
+
+        size_t estimate_bytes() override;
+    };
+
+    class ArtecSdkFrameProcessor : public ScannerFrameProcessor
+    {
+    protected:
+        artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> processor;
+
+    public:
+        ArtecSdkFrameProcessor(artec::sdk::capturing::IScanner* scanner);
+
+        void reconstruct(const ScannerFramePtr& frame, artec::sdk::base::IFrameMesh** mesh) override;
+    };
+
+    class ArtecSdkScannerBackend : public ScannerBackend
+    {
+    protected:
+        artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner;
+        std::string serial;
+
+    public:
+        ArtecSdkScannerBackend(artec::sdk::capturing::IScanner* scanner, const std::string& serial);
+
+        std::string get_serial() override;
+
+        ScannerFramePtr capture(bool with_texture) override;
+
+        ScannerFrameProcessorPtr create_frame_processor() override;
+
+        artec::sdk::capturing::IScanner* get_scanner() override;
+    };
+}
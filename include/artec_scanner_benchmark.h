@@ -0,0 +1,126 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/TRef.h>
+#include <artec/sdk/base/IJobObserver.h>
+#include <artec/sdk/base/AlgorithmWorkset.h>
+#include <artec/sdk/algorithms/Algorithms.h>
+#include "artec_scanner_util.h"
+#include "artec_scanner_algorithm.h"
+#include "artec_scanner_cpu_budget.h"
+#include "artec_scanner_job_manager.h"
+#include <boost/atomic.hpp>
+#include <chrono>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class ArtecScannerImpl;
+    class RRArtecModel;
+
+    // Progress observer that also samples the resident memory of the process each time the SDK reports
+    // progress, so the peak memory of a stage is captured while the stage is running. The benchmark also calls
+    // sample() from a timer, since some algorithms report progress rarely.
+    class BenchmarkProgressObserver : public AlgorithmProgressObserver
+    {
+    public:
+        boost::atomic<uint64_t> peak_resident_bytes{0};
+
+        void report(int current, int total) override;
+
+        void sample();
+    };
+
+    // One chain of algorithms to benchmark. Each algorithm uses the output of the previous algorithm as input.
+    struct BenchmarkVariantStages
+    {
+        std::string name;
+        std::vector<std::string> algorithm_names;
+        std::vector<artec::sdk::base::TRef<artec::sdk::algorithms::IAlgorithm> > algorithms;
+        // Thread limit requested in the algorithm settings, or zero for no limit
+        std::vector<uint32_t> max_threads;
+    };
+
+    // Runs each variant in turn, one stage at a time, and reports the wall time, CPU time, peak resident
+    // memory, and output size of each stage. Results are not cached and the output models are discarded as
+    // soon as the next stage has run, so a sweep can run unattended. A failed stage is reported and the rest
+    // of the variant is skipped. CPU time and resident memory are measured for the whole process, so the
+    // benchmark is admitted exclusively and no other queued jobs run at the same time.
+    class BenchmarkAlgorithms
+        : public QueuedJobGenerator<BenchmarkAlgorithms,experimental::artec_scanner::BenchmarkAlgorithmsStatusPtr>
+    {
+        protected:
+            boost::weak_ptr<ArtecScannerImpl> parent;
+            boost::shared_ptr<ArtecScannerImpl> GetParent();
+            bool benchmark_complete = false;
+            boost::shared_ptr<RRArtecModel> input_model;
+            std::vector<BenchmarkVariantStages> variants;
+            uint32_t total_stages = 0;
+            uint32_t completed_stages = 0;
+
+            uint32_t current_variant = 0;
+            uint32_t current_stage = 0;
+            // Output of the previous stage of the current variant
+            boost::shared_ptr<RRArtecModel> stage_input;
+            boost::shared_ptr<RRArtecModel> stage_output;
+            artec::sdk::base::AlgorithmWorkset workset;
+            CpuBudgetLeasePtr cpu_lease;
+            boost::shared_ptr<BenchmarkProgressObserver> progress;
+            // Samples the resident memory of the running stage
+            RobotRaconteur::TimerPtr sample_timer;
+            std::chrono::steady_clock::time_point stage_start_time;
+            double stage_start_cpu_time = 0.0;
+
+            RobotRaconteur::RRListPtr<experimental::artec_scanner::BenchmarkStageResult> results;
+            size_t last_result_update = 0;
+
+            CpuBudgetPtr cpu_budget;
+
+            artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
+
+        public:
+            friend class BenchmarkAlgorithmsJobObserver;
+
+            BenchmarkAlgorithms(boost::shared_ptr<ArtecScannerImpl> parent);
+
+            void Init(boost::shared_ptr<RRArtecModel> input_model,
+                const RobotRaconteur::RRListPtr<experimental::artec_scanner::BenchmarkVariant>& variants);
+
+        protected:
+            // Start the benchmark once admitted by the job queue. Must be called with this_lock held.
+            void start_job() override;
+
+            bool job_complete() override;
+
+            bool status_updated() override;
+
+            // Cancels the running stage
+            void stop_job(bool abort) override;
+
+            // Launch the next stage, skipping variants that fail to launch. Sets benchmark_complete when no
+            // stages remain. Must be called with this_lock held.
+            void launch_next_stage();
+
+            // Record the result of the current stage and move to the next variant if the stage failed. Must
+            // be called with this_lock held.
+            void add_stage_result(bool success, const std::string& error, uint64_t output_model_bytes,
+                uint64_t vertex_count, uint64_t triangle_count);
+
+            void stage_job_complete(artec::sdk::base::ErrorCode result);
+
+            void complete_gen(boost::function<void(const experimental::artec_scanner::BenchmarkAlgorithmsStatusPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler) override;
+
+            experimental::artec_scanner::BenchmarkAlgorithmsStatusPtr running_status() override;
+    };
+
+    class BenchmarkAlgorithmsJobObserver : public artec::sdk::base::JobObserverBase
+    {
+        boost::shared_ptr<BenchmarkAlgorithms> parent;
+
+    public:
+        BenchmarkAlgorithmsJobObserver(boost::shared_ptr<BenchmarkAlgorithms> parent);
+
+        void completed (artec::sdk::base::ErrorCode result) override;
+    };
+}
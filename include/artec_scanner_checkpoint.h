@@ -0,0 +1,83 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include "artec_scanner_util.h"
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <deque>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class RRArtecModel;
+
+    // Directory of the checkpoint projects in the project save path
+    boost::filesystem::path CheckpointDir(const boost::optional<boost::filesystem::path>& save_path);
+
+    // Completed checkpoints in the checkpoint directory, oldest first. Checkpoints that were interrupted before
+    // completing are not listed.
+    RobotRaconteur::RRListPtr<experimental::artec_scanner::CheckpointInfo> ListCheckpoints(
+        const boost::filesystem::path& checkpoint_dir);
+
+    // True if the checkpoint exists and was completed. Throws if the name is invalid.
+    bool IsCompleteCheckpoint(const boost::filesystem::path& checkpoint_dir, const std::string& checkpoint_name);
+
+    // Remove a checkpoint project. Throws if the checkpoint does not exist.
+    void DeleteCheckpoint(const boost::filesystem::path& checkpoint_dir, const std::string& checkpoint_name);
+
+    // Saves completed scanning and algorithm output models as projects in the checkpoint directory so they can be
+    // recovered with checkpoint_load() after the driver restarts. Checkpoints are written one at a time by a
+    // background thread running at the lowest CPU and I/O priority. A checkpoint does not start while
+    // capture_active returns true, and after each checkpoint the thread waits until the average write rate is
+    // below the bandwidth limit. The SDK writes each project in one call, so the limit paces checkpoints rather
+    // than individual writes.
+    class ModelCheckpointer
+    {
+    protected:
+        struct Request
+        {
+            boost::shared_ptr<RRArtecModel> model;
+            int32_t model_handle = 0;
+            std::string source;
+        };
+
+        boost::mutex this_lock;
+        boost::condition_variable cv;
+        std::deque<Request> queue;
+        boost::thread thread;
+        bool stopping = false;
+
+        boost::filesystem::path checkpoint_dir;
+        // Bytes per second, zero for no limit
+        double bandwidth;
+        // Oldest checkpoints are removed beyond this count, zero to keep all
+        uint32_t max_checkpoints;
+        boost::function<bool()> capture_active;
+
+        void thread_func();
+
+        // Returns the bytes written
+        uint64_t save_checkpoint(const Request& request);
+
+        void remove_old_checkpoints();
+
+    public:
+        // Pending checkpoints beyond this count are dropped, oldest first
+        static const size_t max_pending = 4;
+
+        ModelCheckpointer(const boost::filesystem::path& checkpoint_dir, double bandwidth, uint32_t max_checkpoints,
+            boost::function<bool()> capture_active);
+
+        // Removes interrupted checkpoints and starts the background thread
+        void Start();
+
+        // Stops the background thread after the checkpoint being written, if any, completes. Pending checkpoints
+        // are dropped.
+        ~ModelCheckpointer();
+
+        void Enqueue(boost::shared_ptr<RRArtecModel> model, int32_t model_handle, const std::string& source);
+    };
+
+    using ModelCheckpointerPtr = boost::shared_ptr<ModelCheckpointer>;
+}
@@ -0,0 +1,72 @@
+#include "artec_scanner_util.h"
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class CpuBudget;
+
+    // Threads assigned to one job. The threads are returned to the budget when the lease is destroyed.
+    class CpuBudgetLease
+    {
+    protected:
+        boost::weak_ptr<CpuBudget> budget;
+        uint32_t threads;
+        bool reserved;
+
+    public:
+        CpuBudgetLease(boost::shared_ptr<CpuBudget> budget, uint32_t threads, bool reserved);
+
+        uint32_t get_threads() { return threads; }
+
+        ~CpuBudgetLease();
+    };
+
+    using CpuBudgetLeasePtr = boost::shared_ptr<CpuBudgetLease>;
+
+    // Divides the CPU threads between the SDK jobs and reconstruction threads running at the same time. Real
+    // time scanning procedures and sessions reserve a small fixed number of threads for their whole lifetime.
+    // The remaining threads are shared by the other jobs. Each job is assigned at most its fair share of the
+    // threads for the expected number of concurrent jobs, or for the number of active jobs if more are
+    // running, limited to the threads not already assigned to other jobs. The thread count of a job is fixed
+    // when it is launched, so the first job does not take every thread. Every job is assigned at least one
+    // thread.
+    class CpuBudget : public RR_ENABLE_SHARED_FROM_THIS<CpuBudget>
+    {
+    protected:
+        boost::mutex this_lock;
+        uint32_t total_threads;
+        uint32_t expected_jobs = 1;
+        uint32_t assigned_threads = 0;
+        uint32_t reserved_threads = 0;
+        uint32_t active_jobs = 0;
+
+        void Release(uint32_t threads, bool reserved);
+
+    public:
+        friend class CpuBudgetLease;
+
+        // Threads reserved by each real time scanning procedure or session
+        static const uint32_t realtime_threads = 2;
+
+        // total_threads of zero uses the number of hardware threads
+        CpuBudget(uint32_t total_threads = 0);
+
+        // Assign threads to a new job. max_threads of zero means no limit.
+        CpuBudgetLeasePtr Acquire(uint32_t max_threads = 0);
+
+        // Reserve threads for a real time scanning procedure or session. The reserved threads are not
+        // assigned to other jobs, and the procedure is not counted as an active job.
+        CpuBudgetLeasePtr AcquireRealtime();
+
+        uint32_t GetTotalThreads();
+
+        // total_threads of zero uses the number of hardware threads. Leases already assigned are not changed.
+        void SetTotalThreads(uint32_t total_threads);
+
+        // Number of jobs expected to run at the same time, normally the job queue concurrency limit
+        void SetExpectedJobs(uint32_t expected_jobs);
+    };
+
+    using CpuBudgetPtr = boost::shared_ptr<CpuBudget>;
+}
@@ -0,0 +1,26 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/IModel.h>
+#include "artec_scanner_util.h"
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Path of an export file relative to the project save path. Throws if the save path is not set, the path is
+    // absolute or outside of the save path, or the path is inside a project or checkpoint directory. The extension
+    // of the format is added if the path has none, and a different extension is rejected.
+    boost::filesystem::path ExportFilePath(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& path, experimental::artec_scanner::ModelExportFormat::ModelExportFormat format);
+
+    // Writes the composite meshes of the model, or the frame meshes if the model has no composite container, to
+    // a single binary PLY, OBJ, or binary STL file in model coordinates in mm. Meshes are split into chunks that
+    // are encoded in parallel using threads threads and written in order through a buffered file, so memory use
+    // is bounded by the chunk size rather than the model size. The file is written to a temporary file that is
+    // renamed once complete. Throws if the file exists unless overwrite is set.
+    experimental::artec_scanner::ModelExportResultPtr ExportModel(artec::sdk::base::IModel* model,
+        experimental::artec_scanner::ModelExportFormat::ModelExportFormat format,
+        const boost::filesystem::path& file_path, uint32_t threads, bool overwrite);
+}
@@ -3,6 +3,16 @@
 #include <artec/sdk/capturing/IScanner.h>
 #include <artec/sdk/base/TRef.h>
 #include "artec_scanner_util.h"
+#include "artec_scanner_backend.h"
+#include "artec_scanner_algorithm_cache.h"
+#include "artec_scanner_project_cache.h"
+#include "artec_scanner_cpu_budget.h"
+#include "artec_scanner_job_manager.h"
+#include "artec_scanner_presets.h"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/atomic.hpp>
+#include <boost/filesystem.hpp>
+#include <set>
 
 namespace artec_scanner_robotraconteur_driver
 {
@@ -10,9 +20,43 @@ namespace artec_scanner_robotraconteur_driver
     {
     public:
         artec::sdk::base::TRef<artec::sdk::base::IModel> model;
+        // Unique identity of this model. Used to key algorithm results computed from this model.
+        uint64_t content_id;
+        // Model is shared with the project cache, the algorithm result cache, or other handles. Models are never
+        // modified in place once they have a handle, so sharing them is safe. Reported in memory_usage.
+        bool shared = false;
 
         RRArtecModel();
 
+        // Handle sharing a cached model. The content_id of the cached model is kept so cached algorithm results
+        // are reused between handles.
+        RRArtecModel(artec::sdk::base::TRef<artec::sdk::base::IModel> shared_model, uint64_t content_id);
+
+        // Estimated memory of the model. Recomputed only when content_id changes.
+        ModelMemoryEstimate get_memory_estimate();
+
+        uint64_t get_estimated_bytes() override;
+
+        // Record that the scans and composite container of the model are stored in the project file, after the
+        // model is loaded from or saved to it
+        void set_persisted(const boost::filesystem::path& file_path);
+
+        // Scans, and the composite container if it is set, that are not stored in the project file
+        void get_unpersisted(const boost::filesystem::path& file_path, std::vector<artec::sdk::base::IScan*>& scans,
+            artec::sdk::base::ICompositeContainer*& container);
+
+    protected:
+        boost::mutex memory_estimate_lock;
+        ModelMemoryEstimate memory_estimate;
+        uint64_t memory_estimate_content_id = 0;
+
+        boost::mutex persisted_lock;
+        // Project file the model was last loaded from or saved to
+        boost::filesystem::path persisted_file;
+        std::set<artec::sdk::base::IScan*> persisted_scans;
+        artec::sdk::base::ICompositeContainer* persisted_container = nullptr;
+    public:
+
         uint32_t get_scan_count() override;
 
         experimental::artec_scanner::ScanPtr get_scans(int32_t ind) override;
@@ -36,6 +80,11 @@ namespace artec_scanner_robotraconteur_driver
 
         RobotRaconteur::RRArrayPtr<uint8_t > getf_frame_mesh_stl(uint32_t ind) override;
 
+        RobotRaconteur::RRArrayPtr<uint8_t > getf_frame_mesh_compact(uint32_t ind, double precision,
+            RobotRaconteur::rr_bool compress) override;
+
+        experimental::artec_scanner::MeshBuffersPtr getf_frame_mesh_buffers(uint32_t ind) override;
+
         com::robotraconteur::geometry::Transform getf_frame_transform(uint32_t ind) override;
     };
 
@@ -52,81 +101,248 @@ namespace artec_scanner_robotraconteur_driver
 
         RobotRaconteur::RRArrayPtr<uint8_t> getf_composite_mesh_stl(uint32_t ind) override;
 
+        RobotRaconteur::RRArrayPtr<uint8_t> getf_composite_mesh_compact(uint32_t ind, double precision,
+            RobotRaconteur::rr_bool compress) override;
+
+        experimental::artec_scanner::MeshBuffersPtr getf_composite_mesh_buffers(uint32_t ind) override;
+
         com::robotraconteur::geometry::Transform getf_composite_mesh_transform(uint32_t ind) override;
 
     };
 
 
     class ScanningProcedure;
+    class ScanningSession;
     class RunAlgorithms;
     class DeferredCapturePrepare;
+    struct ModelProjectJob;
+    class SharedMemoryExport;
+    class ModelCheckpointer;
 
     struct RRDeferredCapture
     {
         int32_t handle = -1;
-        artec::sdk::base::TRef<artec::sdk::capturing::IFrame> frame;
+        // Scanner that captured the frame. The frame is reconstructed by a processor of the same scanner.
+        uint32_t scanner_index = 0;
+        ScannerFramePtr frame;
         com::robotraconteur::geometry::shapes::MeshPtr mesh;
         RobotRaconteur::RRArrayPtr<uint8_t> mesh_stl_bytes;
+
+        // Estimated memory of the raw frame and the converted meshes
+        size_t estimate_bytes();
     };
 
     using RRDeferredCapturePtr = boost::shared_ptr<RRDeferredCapture>;
+
+    struct ArtecScannerDevice
+    {
+        uint32_t index = 0;
+        ScannerBackendPtr backend;
+        // Frame processor dedicated to capture() on this device
+        ScannerFrameProcessorPtr processor;
+        // Frame processors used by the deferred capture prepare threads
+        ScannerFrameProcessorPoolPtr processor_pool;
+        // Serializes capture and reconstruction on this device
+        boost::mutex lock;
+    };
+
+    using ArtecScannerDevicePtr = boost::shared_ptr<ArtecScannerDevice>;
     
     class ArtecScannerImpl : public experimental::artec_scanner::ArtecScanner_default_impl, 
         public RR_ENABLE_SHARED_FROM_THIS<ArtecScannerImpl>
     {
 
         private:
-            artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner = nullptr;
-            artec::sdk::base::TRef<artec::sdk::capturing::IFrameProcessor> processor = nullptr;
+            std::vector<ArtecScannerDevicePtr> devices;
+
+            bool ready = false;
+            double time_to_ready = 0.0;
+            boost::condition_variable ready_cv;
+            // Run a throwaway capture during warm up
+            bool warm_up_capture = false;
+
+            // Blocks until WarmUp() completes
+            void wait_ready();
+
+            ArtecScannerDevicePtr get_device(uint32_t index);
+
+            void capture_device(const ArtecScannerDevicePtr& device, bool with_texture, 
+                experimental::artec_scanner::ScannerCaptureResultPtr& result);
+
+            // SDK scanner of the device for the scanning procedure. Throws for the simulated scanner.
+            artec::sdk::capturing::IScanner* get_procedure_scanner(uint32_t scanner_index);
 
             int32_t add_model(RRArtecModelPtr model);
+
+            // Run a prepared project load through the job queue unless it was resolved from the project cache,
+            // and add the model. Blocks until the load is complete.
+            int32_t load_model(const boost::shared_ptr<ModelProjectJob>& job, const std::string& operation);
                         
             int32_t handle_cnt = 100;
             std::map<int32_t,RRArtecModelPtr> models;
             std::map<int32_t,RRDeferredCapturePtr> deferred_captures;
+            std::map<int32_t,boost::shared_ptr<ScanningSession> > scanning_sessions;
+            // Shared memory exports of each model or deferred capture handle, removed when the handle is freed
+            std::map<int32_t,std::vector<boost::shared_ptr<SharedMemoryExport> > > shared_memory_exports;
 
             boost::mutex this_lock;
 
             boost::optional<boost::filesystem::path> save_path;
 
+            AlgorithmResultCachePtr algorithm_cache;
+
+            ProjectCachePtr project_cache;
+
+            CpuBudgetPtr cpu_budget = boost::make_shared<CpuBudget>();
+
+            JobManagerPtr job_manager = boost::make_shared<JobManager>(2, 16, cpu_budget);
+
+            AlgorithmPresetsPtr algorithm_presets = boost::make_shared<AlgorithmPresets>();
+
+            // Launched scanning procedures by job id, for scanning_procedure_snapshot()
+            std::map<uint32_t,boost::weak_ptr<ScanningProcedure> > scanning_procedures;
+
+            void add_scanning_procedure(uint32_t job_id, boost::shared_ptr<ScanningProcedure> procedure);
+
+            // Autosave of completed scanning and algorithm output models, nullptr if autosave is disabled
+            boost::shared_ptr<ModelCheckpointer> checkpointer;
+
+            // Queue a checkpoint of a completed model if autosave is enabled
+            void autosave_model(int32_t model_handle, const RRArtecModelPtr& model, const std::string& source);
+
+            // True while a scanning procedure or session is recording or a scanner is capturing. Checkpoints are
+            // deferred until it returns false.
+            bool capture_active();
+
             void deferred_capture_to_iframemesh(const RRDeferredCapturePtr& deferred_capture, artec::sdk::base::IFrameMesh** frame_mesh);
 
             RRDeferredCapturePtr get_deferred_capture(int32_t deferred_capture_handle);
 
         public:
             friend class ScanningProcedure;
+            friend class ScanningSession;
             friend class RunAlgorithms;
+            friend class BenchmarkAlgorithms;
             friend class DeferredCapturePrepare;
+            friend class ModelProjectIO;
+            friend class RRScannerHead;
 
-            void Init(artec::sdk::capturing::IScanner* scanner);
+            void Init(const std::vector<ArtecScannerDevicePtr>& devices);
+
+            // Creates the frame processors, converts a small synthetic mesh to initialize the mesh conversion,
+            // and checks the algorithms license. Runs in a background thread so the service can be registered
+            // immediately. Capture calls block until complete.
+            void StartWarmUp();
+            void WarmUp();
+
+            // Also run a throwaway capture and reconstruct on each scanner during warm up, so the first capture
+            // does not pay to initialize the capture path. The scanner fires its flash. Must be called before
+            // StartWarmUp().
+            void set_warm_up_capture(bool enable);
 
             void set_save_path(boost::optional<boost::filesystem::path> save_path);
 
+            // Memory budget for cached algorithm results. Zero disables the cache.
+            void set_algorithm_cache_size(size_t bytes);
+
+            void set_project_cache_size(size_t bytes);
+
+            // Enable autosave checkpoints in the checkpoints directory of the project save path. bandwidth is the
+            // average write rate limit in bytes per second, zero for no limit. The oldest checkpoints beyond
+            // max_checkpoints are removed, zero to keep all. Throws if the save path is not set.
+            void set_autosave(double bandwidth, uint32_t max_checkpoints);
+
+        protected:
+            // Memory limit in bytes for models and deferred captures, zero for no limit
+            boost::atomic<uint64_t> memory_limit{0};
+            // Estimated size of the most recent deferred capture, used as the estimate for the next capture
+            boost::atomic<uint64_t> last_deferred_capture_bytes{0};
+
+            // Throws OutOfMemoryException if the estimated memory used plus required_bytes exceeds the memory limit
+            void check_memory_limit(uint64_t required_bytes, const std::string& operation);
+
+        public:
+
+            // Number of CPU threads shared by algorithms and deferred capture preparation. Zero uses the number
+            // of hardware threads. Must be called before Init().
+            void set_cpu_threads(uint32_t threads);
+
+            // Maximum number of scanning, algorithm, and deferred capture prepare jobs running at the same time,
+            // and the maximum number of jobs waiting to start
+            void set_job_limits(uint32_t max_concurrent_jobs, uint32_t max_queued_jobs);
+
+            // Load named algorithm presets from a YAML file. reload_presets() loads the same file again.
+            void set_algorithm_presets_path(const boost::filesystem::path& path);
+
             com::robotraconteur::geometry::shapes::MeshPtr capture(RobotRaconteur::rr_bool with_texture) override;
 
             RobotRaconteur::RRArrayPtr<uint8_t> capture_stl() override;
+
+            uint32_t get_scanner_count() override;
+
+            RobotRaconteur::rr_bool get_ready() override;
+
+            double get_time_to_ready() override;
+
+            RobotRaconteur::RRListPtr<experimental::artec_scanner::ScannerCaptureResult> 
+                capture_all(RobotRaconteur::rr_bool with_texture) override;
+
+            experimental::artec_scanner::ScannerHeadPtr get_scanners(int32_t scanner_index) override;
+
+            // capture(), capture_stl(), capture_deferred(), run_scanning_procedure(), and scanning_session_create()
+            // use the first scanner. These overloads use the scanner with the index, and are called through the
+            // scanners objref.
+            com::robotraconteur::geometry::shapes::MeshPtr capture(uint32_t scanner_index, bool with_texture);
 
-            int32_t capture_deferred(RobotRaconteur::rr_bool with_texture) override;
+            RobotRaconteur::RRArrayPtr<uint8_t> capture_stl(uint32_t scanner_index);
+
+            int32_t capture_deferred(uint32_t scanner_index, bool with_texture);
+
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::ScanningProcedureStatusPtr,void>
+                run_scanning_procedure(uint32_t scanner_index,
+                const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings);
+
+            int32_t scanning_session_create(uint32_t scanner_index,
+                const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings);
+
+            int32_t capture_deferred(RobotRaconteur::rr_bool with_texture) override;
 
             com::robotraconteur::geometry::shapes::MeshPtr getf_deferred_capture(int32_t deferred_capture_handle) override;
 
             RobotRaconteur::RRArrayPtr<uint8_t > getf_deferred_capture_stl(int32_t deferred_capture_handle) override;
 
+            RobotRaconteur::RRArrayPtr<uint8_t > getf_deferred_capture_compact(int32_t deferred_capture_handle,
+                double precision, RobotRaconteur::rr_bool compress) override;
+
+            experimental::artec_scanner::MeshBuffersPtr getf_deferred_capture_buffers(int32_t deferred_capture_handle)
+                override;
+
+            experimental::artec_scanner::SharedMemoryRegionPtr deferred_capture_export_shared_memory(
+                int32_t deferred_capture_handle) override;
+
             void deferred_capture_free(const RobotRaconteur::RRArrayPtr<int32_t>& deferred_capture_handle) override;
 
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void> 
-                deferred_capture_prepare(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles) 
-                override;
+                deferred_capture_prepare(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles,
+                int32_t priority) override;
 
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void> 
-                deferred_capture_prepare_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
-                override;
+                deferred_capture_prepare_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles,
+                int32_t priority) override;
 
 
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::ScanningProcedureStatusPtr,void>
                 run_scanning_procedure(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings) 
                 override;
 
+            int32_t scanning_procedure_snapshot(uint32_t job_id) override;
+
+            int32_t scanning_session_create(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings) override;
+
+            experimental::artec_scanner::ScanningSessionPtr get_scanning_sessions(int32_t session_handle) override;
+
+            void scanning_session_free(int32_t session_handle) override;
+
             void model_free(int32_t model_handle) override;
             experimental::artec_scanner::ModelPtr get_models(int32_t model_handle) override;
 
@@ -134,11 +350,68 @@ namespace artec_scanner_robotraconteur_driver
 
             void model_save(int32_t model_handle, const std::string& project_name) override;
 
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::ModelProjectStatusPtr,void >
+                model_load_async(const std::string& project_name, int32_t priority) override;
+
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::ModelProjectStatusPtr,void >
+                model_save_async(int32_t model_handle, const std::string& project_name, int32_t priority) override;
+
+            experimental::artec_scanner::ModelAppendResultPtr model_append(int32_t model_handle,
+                const std::string& project_name) override;
+
+            RobotRaconteur::RRListPtr<experimental::artec_scanner::ProjectEntryInfo>
+                project_list_entries(const std::string& project_name) override;
+
+            int32_t model_load_entries(const std::string& project_name,
+                const RobotRaconteur::RRListPtr<RobotRaconteur::RRArray<char> >& entry_uuids) override;
+
+            experimental::artec_scanner::ModelExportResultPtr model_export(int32_t model_handle,
+                experimental::artec_scanner::ModelExportFormat::ModelExportFormat format,
+                const std::string& path, RobotRaconteur::rr_bool overwrite) override;
+
+            experimental::artec_scanner::SharedMemoryRegionPtr model_export_shared_memory(int32_t model_handle) override;
+
+            void shared_memory_release(const std::string& name) override;
+
+            RobotRaconteur::RRListPtr<experimental::artec_scanner::CheckpointInfo> checkpoint_list() override;
+
+            int32_t checkpoint_load(const std::string& checkpoint_name) override;
+
+            void checkpoint_delete(const std::string& checkpoint_name) override;
+
             RobotRaconteur::RRValuePtr initialize_algorithm(int32_t input_model_handle, const std::string& algorithm) override;
 
             RobotRaconteur::GeneratorPtr<experimental::artec_scanner::RunAlgorithmsStatusPtr,void >
-                run_algorithms(int32_t input_model_handle, const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms) override;
+                run_algorithms(int32_t input_model_handle, const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms,
+                int32_t priority) override;
+
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::RunAlgorithmsStatusPtr,void >
+                run_algorithm_pipeline(int32_t input_model_handle, 
+                const RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmPipelineNode>& pipeline,
+                int32_t priority) override;
+
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::BenchmarkAlgorithmsStatusPtr,void >
+                benchmark_algorithms(int32_t input_model_handle, 
+                const RobotRaconteur::RRListPtr<experimental::artec_scanner::BenchmarkVariant>& variants,
+                int32_t priority) override;
 
+            RobotRaconteur::GeneratorPtr<experimental::artec_scanner::RunAlgorithmsStatusPtr,void >
+                run_preset(int32_t input_model_handle, const std::string& preset_name, int32_t priority) override;
+
+            RobotRaconteur::RRListPtr<RobotRaconteur::RRArray<char> > get_preset_names() override;
+
+            void reload_presets() override;
+
+            experimental::artec_scanner::JobQueuePtr get_jobs() override;
+
+            RobotRaconteur::RRListPtr<experimental::artec_scanner::MemoryUsage> get_memory_usage() override;
+
+            uint64_t get_memory_used() override;
+
+            uint64_t get_memory_limit() override;
+
+            void set_memory_limit(uint64_t value) override;
+
             void free_all() override;
 
             virtual ~ArtecScannerImpl();
@@ -147,4 +420,34 @@ namespace artec_scanner_robotraconteur_driver
     using ArtecScannerImplPtr = boost::shared_ptr<ArtecScannerImpl>;
     using ArtecScannerImplWeakPtr = boost::weak_ptr<ArtecScannerImpl>;
 
+    // One scanner of a multi-head setup. Handles returned by the functions are owned by the ArtecScanner object.
+    class RRScannerHead : public experimental::artec_scanner::ScannerHead_default_impl
+    {
+    protected:
+        ArtecScannerImplWeakPtr parent;
+        uint32_t scanner_index;
+
+        ArtecScannerImplPtr GetParent();
+
+    public:
+        RRScannerHead(ArtecScannerImplPtr parent, uint32_t scanner_index);
+
+        uint32_t get_scanner_index() override;
+
+        std::string get_scanner_serial() override;
+
+        com::robotraconteur::geometry::shapes::MeshPtr capture(RobotRaconteur::rr_bool with_texture) override;
+
+        RobotRaconteur::RRArrayPtr<uint8_t> capture_stl() override;
+
+        int32_t capture_deferred(RobotRaconteur::rr_bool with_texture) override;
+
+        RobotRaconteur::GeneratorPtr<experimental::artec_scanner::ScanningProcedureStatusPtr,void>
+            run_scanning_procedure(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings)
+            override;
+
+        int32_t scanning_session_create(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings)
+            override;
+    };
+
 }
@@ -0,0 +1,397 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include "artec_scanner_util.h"
+#include "artec_scanner_cpu_budget.h"
+#include <boost/atomic.hpp>
+#include <chrono>
+#include <list>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class JobManager;
+
+    // Admission of one job to the job manager. The job slot, or the queue entry if the job has not been
+    // admitted yet, is released when the ticket is destroyed.
+    class JobTicket
+    {
+    protected:
+        boost::weak_ptr<JobManager> manager;
+        uint32_t job_id;
+        boost::atomic<bool> admitted{false};
+
+    public:
+        friend class JobManager;
+
+        JobTicket(boost::shared_ptr<JobManager> manager, uint32_t job_id);
+
+        uint32_t get_job_id() { return job_id; }
+
+        bool IsAdmitted() { return admitted.load(); }
+
+        ~JobTicket();
+    };
+
+    using JobTicketPtr = boost::shared_ptr<JobTicket>;
+
+    // Admission control for heavy jobs. At most max_concurrent_jobs jobs run at the same time. Other jobs wait
+    // in a bounded queue ordered by priority, then by submission order. An exclusive job runs with no other
+    // admitted jobs.
+    class JobManager : public experimental::artec_scanner::JobQueue_default_impl,
+        public RR_ENABLE_SHARED_FROM_THIS<JobManager>
+    {
+    protected:
+        struct Job
+        {
+            uint32_t job_id = 0;
+            std::string job_type;
+            int32_t priority = 0;
+            bool running = false;
+            bool exclusive = false;
+            std::chrono::steady_clock::time_point submit_time;
+            std::chrono::steady_clock::time_point start_time;
+            boost::weak_ptr<JobTicket> ticket;
+            boost::function<void()> on_admitted;
+        };
+
+        using JobPtr = boost::shared_ptr<Job>;
+
+        boost::mutex this_lock;
+        std::list<JobPtr> jobs;
+        uint32_t job_id_cnt = 0;
+        uint32_t max_concurrent_jobs;
+        uint32_t max_queued_jobs;
+        // Sized for max_concurrent_jobs, so each job is assigned a fair share of the threads
+        CpuBudgetPtr cpu_budget;
+
+        void Release(uint32_t job_id);
+
+        // Admit queued jobs while slots are available. Must be called with this_lock held. The admitted
+        // callbacks are returned so they can be posted after the lock is released. The tickets are returned
+        // so a ticket released by its owner meanwhile is not destroyed while the lock is held.
+        void admit_jobs(std::vector<boost::function<void()> >& admitted,
+            std::vector<JobTicketPtr>& admitted_tickets);
+
+        static void post_admitted(std::vector<boost::function<void()> >& admitted);
+
+        // Returns true if a should be admitted before b
+        static bool job_before(const JobPtr& a, const JobPtr& b);
+
+        uint32_t running_count();
+
+        bool exclusive_running();
+
+    public:
+        friend class JobTicket;
+
+        JobManager(uint32_t max_concurrent_jobs, uint32_t max_queued_jobs, CpuBudgetPtr cpu_budget);
+
+        // Submit a job. If a slot is available the returned ticket is already admitted. Otherwise the job is
+        // queued, and on_admitted is called from the thread pool when it is admitted. An exclusive job is only
+        // admitted when no other jobs are running, and no other jobs are admitted until it is released. Queued
+        // jobs with higher priority are admitted first. Throws OperationFailedException if the queue is full.
+        JobTicketPtr Submit(const std::string& job_type, boost::function<void()> on_admitted,
+            bool exclusive = false, int32_t priority = 0);
+
+        // Submit a job for a synchronous call and block until it is admitted. Throws OperationFailedException if
+        // the queue is full.
+        JobTicketPtr SubmitWait(const std::string& job_type, bool exclusive = false, int32_t priority = 0);
+
+        // Returns 0 if the job is running, the position in the queue starting at 1 if it is queued, or -1 if
+        // the job is not found.
+        int32_t GetQueuePosition(uint32_t job_id);
+
+        uint32_t get_max_concurrent_jobs() override;
+        void set_max_concurrent_jobs(uint32_t value) override;
+
+        uint32_t get_max_queued_jobs() override;
+        void set_max_queued_jobs(uint32_t value) override;
+
+        uint32_t get_running_count() override;
+        uint32_t get_queued_count() override;
+
+        RobotRaconteur::RRListPtr<experimental::artec_scanner::JobInfo> get_jobs() override;
+
+        void set_job_priority(uint32_t job_id, int32_t priority) override;
+    };
+
+    using JobManagerPtr = boost::shared_ptr<JobManager>;
+
+    // Generator for a job that waits in the job queue before it starts. Submits the job on the first call to
+    // Next, reports the queue position while queued, starts the job once it is admitted, and releases the queue
+    // entry if the generator is closed or aborted before the job starts. The derived class starts the job in
+    // start_job(), reports its status in running_status(), and replies with the result in complete_gen() once
+    // job_complete() returns true. The derived class is called with this_lock held.
+    template <typename Derived, typename StatusPtr>
+    class QueuedJobGenerator : public RobotRaconteur::Generator<StatusPtr,void>,
+        public RR_ENABLE_SHARED_FROM_THIS<Derived>
+    {
+        protected:
+            using NextHandler = boost::function<void(const StatusPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)>;
+
+            boost::mutex this_lock;
+            bool started = false;
+            bool closed = false;
+            bool aborted = false;
+            bool completed = false;
+
+            JobManagerPtr job_manager;
+            // Admission to the job queue. The derived class releases it when the job completes.
+            JobTicketPtr job_ticket;
+            uint32_t job_id = 0;
+            // Error starting the job after it was admitted from the queue, reported by the next call to Next
+            RobotRaconteur::RobotRaconteurExceptionPtr start_error;
+
+            RobotRaconteur::TimerPtr next_timer;
+            NextHandler next_handler;
+
+            std::string job_type;
+            std::string job_name;
+            // Next keeps reporting a started job after Close until the job completes
+            bool next_after_close;
+            // Run with no other admitted jobs
+            bool exclusive_job = false;
+            // Priority of the job in the job queue
+            int32_t job_priority = 0;
+
+            // job_type is passed to the job manager. job_name is used in log and error messages.
+            QueuedJobGenerator(const std::string& job_type, const std::string& job_name, bool next_after_close)
+                : job_type(job_type), job_name(job_name), next_after_close(next_after_close)
+            {
+            }
+
+            // Start the job once admitted by the job queue. Sets started if the job was started.
+            virtual void start_job() = 0;
+
+            virtual StatusPtr running_status() = 0;
+
+            // True once the next call to Next should be answered by complete_gen
+            virtual bool job_complete() = 0;
+
+            virtual void complete_gen(NextHandler handler) = 0;
+
+            // True if the status changed since it was last reported, so Next replies without waiting
+            virtual bool status_updated() { return false; }
+
+            // Stop or cancel the job for Close or Abort
+            virtual void stop_job(bool abort) {}
+
+            // Called when the job is closed or aborted before it started
+            virtual void job_dropped() {}
+
+            std::string aborted_message()
+            {
+                return job_name + " operation was aborted";
+            }
+
+            // Reply to a Next call with the result if the job is complete, otherwise with the current status
+            void reply_next(boost::mutex::scoped_lock& lock, NextHandler handler)
+            {
+                if (job_complete())
+                {
+                    complete_gen(handler);
+                    return;
+                }
+                auto ret = running_status();
+                lock.unlock();
+                handler(ret, nullptr);
+            }
+
+            void job_admitted()
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                if (started || !job_ticket)
+                {
+                    return;
+                }
+                if (closed || aborted)
+                {
+                    job_ticket.reset();
+                    job_dropped();
+                    return;
+                }
+
+                try
+                {
+                    start_job();
+                }
+                catch (std::exception& e)
+                {
+                    start_error = RobotRaconteur::RobotRaconteurExceptionUtil::ExceptionToSharedPtr(e);
+                }
+
+                auto h = next_handler;
+                next_handler.clear();
+                if (!h)
+                {
+                    return;
+                }
+                try
+                {
+                    next_timer->Stop();
+                }
+                catch (std::exception&) {}
+
+                if (start_error)
+                {
+                    auto err = start_error;
+                    start_error.reset();
+                    lock.unlock();
+                    h(nullptr, err);
+                    return;
+                }
+                reply_next(lock, h);
+            }
+
+            void next_timer_handler(const RobotRaconteur::TimerEvent& evt)
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                auto h = next_handler;
+                next_handler.clear();
+                if (h)
+                {
+                    auto ret = running_status();
+                    h(ret, nullptr);
+                }
+            }
+
+            void close_or_abort(bool abort,
+                boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler)
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                if (closed || aborted)
+                {
+                    lock.unlock();
+                    handler(nullptr);
+                    return;
+                }
+                if (abort)
+                {
+                    aborted = true;
+                }
+                else
+                {
+                    closed = true;
+                }
+                stop_job(abort);
+                NextHandler h;
+                if (!started)
+                {
+                    // Still queued, so no job completion will reply to a pending next
+                    job_ticket.reset();
+                    job_dropped();
+                    h = next_handler;
+                    next_handler.clear();
+                }
+                lock.unlock();
+                if (h)
+                {
+                    if (abort)
+                    {
+                        h(nullptr, RR_MAKE_SHARED<RobotRaconteur::OperationAbortedException>(aborted_message()));
+                    }
+                    else
+                    {
+                        h(nullptr, RR_MAKE_SHARED<RobotRaconteur::StopIterationException>(""));
+                    }
+                }
+                handler(nullptr);
+            }
+
+        public:
+            // Set the queue priority before the job is submitted by the first call to Next
+            void SetJobPriority(int32_t priority)
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                job_priority = priority;
+            }
+
+            void AsyncNext(NextHandler handler, int32_t timeout = RR_TIMEOUT_INFINITE) override
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                if (aborted)
+                {
+                    throw RobotRaconteur::OperationAbortedException(aborted_message());
+                }
+                if (start_error)
+                {
+                    auto err = start_error;
+                    start_error.reset();
+                    lock.unlock();
+                    handler(nullptr, err);
+                    return;
+                }
+                if ((closed && !(started && next_after_close)) || completed)
+                {
+                    throw RobotRaconteur::StopIterationException("");
+                }
+
+                if (next_handler)
+                {
+                    throw RobotRaconteur::InvalidOperationException("Next call already in progress");
+                }
+
+                if (!started && !job_ticket)
+                {
+                    RR_WEAK_PTR<Derived> weak_this = this->shared_from_this();
+                    job_ticket = job_manager->Submit(job_type, [weak_this]() {
+                        auto t = weak_this.lock();
+                        if (!t) return;
+                        t->job_admitted();
+                    }, exclusive_job, job_priority);
+                    job_id = job_ticket->get_job_id();
+                    if (!job_ticket->IsAdmitted())
+                    {
+                        // Report the job id and queue position before waiting for admission
+                        auto ret = running_status();
+                        RR_ARTEC_LOG_INFO(job_name << " job " << job_id << " queued");
+                        lock.unlock();
+                        handler(ret, nullptr);
+                        return;
+                    }
+                }
+
+                if (!started && job_ticket->IsAdmitted())
+                {
+                    start_job();
+                    reply_next(lock, handler);
+                    return;
+                }
+
+                if (job_complete() || status_updated())
+                {
+                    reply_next(lock, handler);
+                    return;
+                }
+
+                next_handler = handler;
+
+                RR_WEAK_PTR<Derived> weak_this = this->shared_from_this();
+                next_timer = RobotRaconteur::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5),
+                    [weak_this](const RobotRaconteur::TimerEvent& evt) {
+                        auto t = weak_this.lock();
+                        if (!t) return;
+                        t->next_timer_handler(evt);
+                }, true);
+                next_timer->Start();
+            }
+
+            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override
+            {
+                close_or_abort(false, handler);
+            }
+
+            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
+                            int32_t timeout = RR_TIMEOUT_INFINITE) override
+            {
+                close_or_abort(true, handler);
+            }
+
+            StatusPtr Next() override {return nullptr;}
+            void Close() override {}
+            void Abort() override {}
+    };
+}
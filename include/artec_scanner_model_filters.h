@@ -0,0 +1,72 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/TRef.h>
+#include <artec/sdk/base/RefBase.h>
+#include <artec/sdk/base/AlgorithmWorkset.h>
+#include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/algorithms/IAlgorithm.h>
+#include "artec_scanner_util.h"
+#include <Eigen/Core>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Algorithms implemented by the driver rather than the SDK. They implement the SDK algorithm interface
+    // so they can be launched with launchJob and chained with the SDK algorithms in run_algorithms.
+
+    // Removes the vertices of each frame that are outside a region of interest, and the triangles that use
+    // them. The region is an oriented box, a convex hull given as half spaces, or the intersection of both.
+    // Frames are cropped in parallel using workset threadsCount threads. Frames with no triangles left are
+    // dropped, and the scans and frame transforms are otherwise unchanged.
+    class CropModelAlgorithm : public artec::sdk::base::RefBase<artec::sdk::algorithms::IAlgorithm>
+    {
+    protected:
+        // Box in the model frame in mm. Box is not used if box_half_size is zero.
+        Eigen::Matrix4d box_transform_inv;
+        Eigen::Vector3d box_half_size;
+        bool use_box = false;
+        // Half spaces in the model frame in mm. A point p is inside if hull_normals * p <= hull_offsets.
+        Eigen::Matrix<double, Eigen::Dynamic, 3> hull_normals;
+        Eigen::VectorXd hull_offsets;
+
+        // Returns nullptr if no triangles are left. frame_to_model is in mm.
+        artec::sdk::base::TRef<artec::sdk::base::IFrameMesh> crop_frame(artec::sdk::base::IFrameMesh* mesh,
+            const Eigen::Matrix4d& frame_to_model);
+
+    public:
+        CropModelAlgorithm(const experimental::artec_scanner::CropAlgorithmPtr& settings);
+
+        artec::sdk::base::ErrorCode run(artec::sdk::base::AlgorithmWorkset* workset) override;
+    };
+
+    // Keeps a frame only if its pose differs from the last kept frame of the scan by at least the translation or
+    // rotation threshold, then limits each scan to max_frame_count frames spread evenly along the path of the
+    // kept frames. The first frame of each scan is always kept. Runs in linear time in the number of frames, and
+    // the kept frame meshes are shared with the input model rather than copied.
+    class FrameDecimationModelAlgorithm : public artec::sdk::base::RefBase<artec::sdk::algorithms::IAlgorithm>
+    {
+    protected:
+        // Thresholds in mm and radians
+        double min_translation;
+        double min_rotation;
+        uint32_t max_frame_count;
+
+        // Indices of the frames of the scan to keep
+        std::vector<int> select_frames(artec::sdk::base::IScan* scan);
+
+    public:
+        FrameDecimationModelAlgorithm(const experimental::artec_scanner::FrameDecimationAlgorithmPtr& settings);
+
+        artec::sdk::base::ErrorCode run(artec::sdk::base::AlgorithmWorkset* workset) override;
+    };
+
+    void create_crop_algorithm(artec::sdk::algorithms::IAlgorithm** alg,
+        const experimental::artec_scanner::CropAlgorithmPtr& settings,
+        artec::sdk::base::ScannerType scanner_type);
+
+    void create_frame_decimation_algorithm(artec::sdk::algorithms::IAlgorithm** alg,
+        const experimental::artec_scanner::FrameDecimationAlgorithmPtr& settings,
+        artec::sdk::base::ScannerType scanner_type);
+}
@@ -0,0 +1,70 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/ScannerType.h>
+#include "artec_scanner_util.h"
+#include <yaml-cpp/yaml.h>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <map>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // One algorithm of a preset. settings holds the fields set in the preset file, which override the
+    // defaults of the algorithm for the scanner type of the input model.
+    struct AlgorithmPresetStep
+    {
+        std::string name;
+        // Name of the input step, or empty to use the input model
+        std::string input;
+        bool retain_output = false;
+        std::string algorithm;
+        YAML::Node settings;
+    };
+
+    struct AlgorithmPreset
+    {
+        std::string name;
+        std::vector<AlgorithmPresetStep> steps;
+        // Pipelines built for each scanner type the preset has been run with
+        std::map<int32_t, RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmPipelineNode> > pipelines;
+    };
+
+    using AlgorithmPresetPtr = boost::shared_ptr<AlgorithmPreset>;
+
+    // Named algorithm pipelines loaded from a YAML file. Presets are validated when loaded, and the algorithm
+    // settings structures are built once for each scanner type and reused by later runs.
+    class AlgorithmPresets
+    {
+    protected:
+        boost::mutex this_lock;
+        boost::optional<boost::filesystem::path> path;
+        std::map<std::string, AlgorithmPresetPtr> presets;
+
+        static AlgorithmPresetPtr parse_preset(const std::string& name, const YAML::Node& node);
+
+        static RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmPipelineNode>
+            build_pipeline(const AlgorithmPreset& preset, artec::sdk::base::ScannerType scanner_type);
+
+    public:
+        // Load presets from a YAML file, replacing the current presets. The current presets are kept if the
+        // file cannot be loaded or contains an invalid preset.
+        void Load(const boost::filesystem::path& path);
+
+        // Load the presets again from the last file passed to Load()
+        void Reload();
+
+        RobotRaconteur::RRListPtr<experimental::artec_scanner::AlgorithmPipelineNode>
+            GetPipeline(const std::string& name, artec::sdk::base::ScannerType scanner_type);
+
+        std::vector<std::string> GetPresetNames();
+    };
+
+    using AlgorithmPresetsPtr = boost::shared_ptr<AlgorithmPresets>;
+
+    // Set fields of an algorithm settings structure from a YAML map. Enum fields accept the enum value name or
+    // an integer, and a max_threads entry is stored in the extended field. Throws InvalidArgumentException for
+    // unknown fields or invalid values.
+    void apply_yaml_algorithm_settings(const RobotRaconteur::RRValuePtr& settings, const YAML::Node& node);
+}
@@ -0,0 +1,149 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/TRef.h>
+#include <artec/sdk/base/IJobObserver.h>
+#include <artec/sdk/base/AlgorithmWorkset.h>
+#include <artec/sdk/project/IProject.h>
+#include <artec/sdk/project/EntryInfo.h>
+#include "artec_scanner_util.h"
+#include "artec_scanner_algorithm.h"
+#include "artec_scanner_job_manager.h"
+#include "artec_scanner_project_cache.h"
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class ArtecScannerImpl;
+    class RRArtecModel;
+
+    // Project load or save job, prepared so it can either be executed synchronously or launched in the
+    // background
+    struct ModelProjectJob
+    {
+        bool save = false;
+        std::string project_name;
+        boost::filesystem::path project_dir;
+        boost::filesystem::path file_path;
+        artec::sdk::base::TRef<artec::sdk::project::IProject> project;
+        artec::sdk::base::TRef<artec::sdk::base::IJob> job;
+        // Output model for load, input model for save
+        boost::shared_ptr<RRArtecModel> model;
+        // Handle of the saved model, or of the loaded model once it has been added
+        int32_t model_handle = 0;
+        // Size of the project files for load, or the estimated size of the model for save
+        uint64_t bytes_total = 0;
+        uint32_t entries_total = 0;
+        // Project cache key of a load. If cache_hit is set, model shares the cached model and job is not set.
+        std::string cache_key;
+        bool cache_hit = false;
+    };
+
+    using ModelProjectJobPtr = boost::shared_ptr<ModelProjectJob>;
+
+    // Path of the .a3d file of a project in the project save path. Throws if the save path is not set or the
+    // project name is invalid.
+    boost::filesystem::path ProjectFilePath(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name);
+
+    // Open the project and create a loader for the entries with the given UUIDs, or for all of its entries if
+    // entry_uuids is empty. Throws if a UUID is not an entry of the project. If the same entries of the unchanged
+    // project are in the cache, the returned job shares the cached model and the project is not opened.
+    ModelProjectJobPtr PrepareModelLoad(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name, const std::vector<std::string>& entry_uuids = std::vector<std::string>(),
+        const ProjectCachePtr& cache = nullptr);
+
+    // Add a completed load to the cache and mark the loaded model as shared
+    void CacheLoadedModel(const ModelProjectJobPtr& job, const ProjectCachePtr& cache);
+
+    // Entry metadata of a project, read without loading any of the entries
+    RobotRaconteur::RRListPtr<experimental::artec_scanner::ProjectEntryInfo> ListProjectEntries(
+        const boost::optional<boost::filesystem::path>& save_path, const std::string& project_name);
+
+    // Entry UUIDs are exchanged with clients as 36 character hex strings of the 16 UUID bytes
+    std::string UuidToString(const artec::sdk::base::Uuid& uuid);
+    artec::sdk::base::Uuid UuidFromString(const std::string& str);
+
+    // Create the project directory and a saver for the model. Throws if the project already exists.
+    ModelProjectJobPtr PrepareModelSave(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name, boost::shared_ptr<RRArtecModel> model, int32_t model_handle);
+
+    // Save the scans of the model that are not yet stored in an existing project, and its composite container if
+    // it is not, as new entries of the project. Entry files already in the project are not rewritten. If the
+    // append fails, the new files are removed and the project file is restored. Throws if the project does not
+    // exist.
+    experimental::artec_scanner::ModelAppendResultPtr AppendModelToProject(
+        const boost::optional<boost::filesystem::path>& save_path, const std::string& project_name,
+        boost::shared_ptr<RRArtecModel> model, int32_t model_handle);
+
+    // Total size of the files in a directory
+    uint64_t DirectorySize(const boost::filesystem::path& dir);
+
+    // Runs a project load or save job in the background. The SDK only reports progress as a fraction, so the
+    // bytes and entries processed are estimated from the fraction until the job completes. A cancelled or
+    // failed save removes the partially written project directory.
+    class ModelProjectIO : public QueuedJobGenerator<ModelProjectIO,experimental::artec_scanner::ModelProjectStatusPtr>
+    {
+        protected:
+            boost::weak_ptr<ArtecScannerImpl> parent;
+            boost::shared_ptr<ArtecScannerImpl> GetParent();
+            bool artec_job_complete = false;
+            artec::sdk::base::ErrorCode artec_job_status = artec::sdk::base::ErrorCode_OK;
+
+            ModelProjectJobPtr job;
+            artec::sdk::base::AlgorithmWorkset workset;
+            boost::shared_ptr<AlgorithmProgressObserver> progress;
+
+            artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
+            // Threads assigned to the job while it runs
+            CpuBudgetLeasePtr cpu_lease;
+
+        public:
+            friend class ModelProjectIOJobObserver;
+
+            ModelProjectIO(boost::shared_ptr<ArtecScannerImpl> parent);
+
+            void Init(ModelProjectJobPtr job);
+
+            // Run the job to completion for a synchronous call. The job waits in the job queue like a job run
+            // from the generator. Returns the final status, or throws the error of the job.
+            experimental::artec_scanner::ModelProjectStatusPtr Run();
+
+            // Removes the project directory of a save that was never run or did not complete
+            ~ModelProjectIO();
+
+        protected:
+            // Launch the job once admitted by the job queue. Must be called with this_lock held.
+            void start_job() override;
+
+            bool job_complete() override;
+
+            // Cancels the running save or load
+            void stop_job(bool abort) override;
+
+            // Removes the project directory of a save that was queued
+            void job_dropped() override;
+
+            void project_job_complete(artec::sdk::base::ErrorCode result);
+
+            // Remove the project directory of a save that did not complete
+            void remove_partial_save();
+
+            void complete_gen(boost::function<void(const experimental::artec_scanner::ModelProjectStatusPtr&,
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler) override;
+
+            experimental::artec_scanner::ModelProjectStatusPtr running_status() override;
+    };
+
+    class ModelProjectIOJobObserver : public artec::sdk::base::JobObserverBase
+    {
+        boost::shared_ptr<ModelProjectIO> parent;
+
+    public:
+        ModelProjectIOJobObserver(boost::shared_ptr<ModelProjectIO> parent);
+
+        void completed (artec::sdk::base::ErrorCode result) override;
+    };
+}
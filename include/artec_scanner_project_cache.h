@@ -0,0 +1,60 @@
+#include "artec_scanner_util.h"
+#include <artec/sdk/base/TRef.h>
+#include <artec/sdk/base/IModel.h>
+#include <boost/filesystem.hpp>
+#include <list>
+#include <set>
+#include <unordered_map>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Models loaded from projects, keyed by the project file, the modification time and size of the project
+    // directory, and the entries loaded. Repeated loads of an unchanged project share the cached model as a
+    // read-only model instead of reading the project again. Least recently used entries are evicted when the
+    // estimated size of the cached models exceeds the memory budget.
+    class ProjectCache
+    {
+    protected:
+        struct Entry
+        {
+            std::string key;
+            artec::sdk::base::TRef<artec::sdk::base::IModel> model;
+            uint64_t content_id = 0;
+            size_t bytes = 0;
+        };
+
+        boost::mutex this_lock;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t budget_bytes = 0;
+        size_t total_bytes = 0;
+
+    public:
+        ProjectCache(size_t budget_bytes);
+
+        // Key for a load of the project file. entry_uuids are the normalized entry uuid strings loaded, or
+        // empty if all entries are loaded.
+        static std::string MakeKey(const boost::filesystem::path& file_path,
+            const std::vector<std::string>& entry_uuids);
+
+        // Returns false if the key is not in the cache
+        bool Get(const std::string& key, artec::sdk::base::TRef<artec::sdk::base::IModel>& model,
+            uint64_t& content_id);
+
+        // bytes is the estimated size of the model from EstimateModelBytes()
+        void Put(const std::string& key, artec::sdk::base::TRef<artec::sdk::base::IModel> model,
+            uint64_t content_id, size_t bytes);
+
+        void Clear();
+
+        size_t GetBytes();
+
+        // Estimated size of the cached models that are not in counted. The cached models are added to counted.
+        size_t GetBytes(std::set<artec::sdk::base::IModel*>& counted);
+    };
+
+    using ProjectCachePtr = boost::shared_ptr<ProjectCache>;
+}
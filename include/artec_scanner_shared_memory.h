@@ -0,0 +1,63 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/base/IModel.h>
+#include <artec/sdk/base/IFrameMesh.h>
+#include "artec_scanner_util.h"
+#include <boost/interprocess/mapped_region.hpp>
+#ifdef _WIN32
+#include <boost/interprocess/windows_shared_memory.hpp>
+#else
+#include <boost/interprocess/shared_memory_object.hpp>
+#endif
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Named shared memory region holding the raw vertex, normal, triangle, uv, and texture image buffers of a
+    // model or deferred capture, so clients on the same host can map the buffers without copying them through
+    // the transport. The region is removed when the object is destroyed.
+    //
+    // Layout: a 64 byte header, then the buffers of each mesh in order, each aligned to 64 bytes. The header is
+    // char[4] magic "ARSM", uint32 version 1, uint64 region size, uint32 mesh count, and zero padding. Vertices
+    // and normals are packed float32 x, y, z in mm, triangles are packed uint32 vertex index triplets, uvs are
+    // packed float32 u, v, and images are rows of pitch bytes in the SDK pixel format. The offsets and counts of
+    // each buffer are returned in the SharedMemoryRegion descriptor.
+    class SharedMemoryExport
+    {
+    protected:
+        std::string name;
+#ifdef _WIN32
+        boost::interprocess::windows_shared_memory shm;
+#else
+        boost::interprocess::shared_memory_object shm;
+#endif
+        boost::interprocess::mapped_region region;
+
+    public:
+        experimental::artec_scanner::SharedMemoryRegionPtr descriptor;
+
+        // Create and map a new region. Throws if a region with the name already exists.
+        SharedMemoryExport(const std::string& name, size_t size);
+
+        ~SharedMemoryExport();
+
+        const std::string& get_name() { return name; }
+
+        uint8_t* data() { return static_cast<uint8_t*>(region.get_address()); }
+
+        size_t size() { return region.get_size(); }
+    };
+
+    using SharedMemoryExportPtr = boost::shared_ptr<SharedMemoryExport>;
+
+    // Unique region name for an export of the handle, including the process id so several drivers on the same
+    // host do not collide
+    std::string SharedMemoryRegionName(int32_t handle);
+
+    // Export the composite meshes of the model, or the frame meshes if the model has no composite container
+    SharedMemoryExportPtr ExportModelSharedMemory(const std::string& name, artec::sdk::base::IModel* model);
+
+    // Export a single frame mesh, such as a reconstructed deferred capture
+    SharedMemoryExportPtr ExportFrameMeshSharedMemory(const std::string& name, artec::sdk::base::IFrameMesh* mesh);
+}
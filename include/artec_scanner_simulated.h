@@ -0,0 +1,68 @@
+#include "artec_scanner_backend.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/atomic.hpp>
+#include <vector>
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    struct SimulatedScannerSettings
+    {
+        // Number of vertices in each synthetic frame, rounded to a square grid
+        uint32_t vertex_count = 100000;
+        // Width and height of the synthetic texture in pixels
+        uint32_t texture_size = 1024;
+        // Standard deviation of the noise added to the surface in mm
+        double noise = 0.05;
+        // Time spent in capture() before returning the frame
+        uint32_t capture_latency_ms = 50;
+        // If set, frames are replayed from the .obj files in this directory instead of generated
+        boost::optional<boost::filesystem::path> replay_path;
+    };
+
+    class SimulatedScannerFrame : public ScannerFrame
+    {
+    public:
+        uint32_t frame_number = 0;
+        bool with_texture = false;
+    };
+
+    class SimulatedFrameProcessor : public ScannerFrameProcessor
+    {
+    protected:
+        SimulatedScannerSettings settings;
+        std::vector<boost::filesystem::path> replay_files;
+
+        void generate_frame(const SimulatedScannerFrame& frame, artec::sdk::base::IFrameMesh** mesh);
+        void replay_frame(const SimulatedScannerFrame& frame, artec::sdk::base::IFrameMesh** mesh);
+
+    public:
+        SimulatedFrameProcessor(const SimulatedScannerSettings& settings,
+            const std::vector<boost::filesystem::path>& replay_files);
+
+        void reconstruct(const ScannerFramePtr& frame, artec::sdk::base::IFrameMesh** mesh) override;
+    };
+
+    // Software scanner producing parametric surface frames with noise, or replaying frames from disk.
+    // Used to run the capture and conversion paths without a physical device.
+    class SimulatedScannerBackend : public ScannerBackend
+    {
+    protected:
+        SimulatedScannerSettings settings;
+        std::vector<boost::filesystem::path> replay_files;
+        boost::atomic<uint32_t> frame_count{0};
+
+    public:
+        SimulatedScannerBackend(const SimulatedScannerSettings& settings);
+
+        std::string get_serial() override;
+
+        ScannerFramePtr capture(bool with_texture) override;
+
+        ScannerFrameProcessorPtr create_frame_processor() override;
+
+        artec::sdk::capturing::IScanner* get_scanner() override;
+    };
+}
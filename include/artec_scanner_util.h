@@ -7,6 +7,8 @@
 #include <artec/sdk/base/IModel.h>
 #include <artec/sdk/base/ICancellationTokenSource.h>
 #include <com__robotraconteur__geometry__shapes.h>
+#include <Eigen/Core>
+#include <vector>
 
 #pragma once
 
@@ -40,8 +42,31 @@ namespace artec_scanner_robotraconteur_driver
 
     RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToStlBytes(artec::sdk::base::IMesh* mesh);
 
+    // Flat float32 and uint32 buffers of a mesh, copied in bulk from the SDK arrays. Vertices, normals, and
+    // uvs are interleaved x, y, z or u, v, and triangles are three vertex indices each.
+    experimental::artec_scanner::MeshBuffersPtr ConvertArtecFrameMeshToBuffers(artec::sdk::base::IFrameMesh* mesh);
+
+    experimental::artec_scanner::MeshBuffersPtr ConvertArtecCompositeMeshToBuffers(
+        artec::sdk::base::ICompositeMesh* mesh);
+
+    // Default precision of compact meshes in mm
+    const double CompactMeshDefaultPrecision = 0.05;
+
+    // Encode the vertices, normals, and triangles of a mesh in the compact mesh format. Positions are quantized to
+    // precision mm relative to the bounding box, normals are octahedral encoded in two bytes, and triangle indices
+    // are delta and varint encoded. If compress is set the payload is deflated. precision of zero or less uses
+    // CompactMeshDefaultPrecision. See examples/artec_compact_mesh.py for the format and a decoder.
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToCompactBytes(artec::sdk::base::IMesh* mesh,
+        double precision, bool compress);
+
     com::robotraconteur::geometry::Transform ConvertArtecTransformToRR(const artec::sdk::base::Matrix4x4D& transform);
 
+    // Artec transform as an Eigen matrix, with the translation in mm
+    Eigen::Matrix4d ConvertArtecTransformToEigen(const artec::sdk::base::Matrix4x4D& transform);
+
+    // Eigen matrix with the translation in mm to a Robot Raconteur transform in m
+    com::robotraconteur::geometry::Transform ConvertEigenTransformToRR(const Eigen::Matrix4d& transform);
+
     void ThrowArtecErrorCode(artec::sdk::base::ErrorCode ec, const std::string& user_msg);
 
     RobotRaconteur::RobotRaconteurExceptionPtr ArtecErrorToExceptionPtr(artec::sdk::base::ErrorCode ec, const std::string& user_msg);
@@ -50,4 +75,40 @@ namespace artec_scanner_robotraconteur_driver
     
     std::string ArtecErrorCodeLogMessage(artec::sdk::base::ErrorCode ec);
 
+    // Appends the scans of src to dst without copying frame meshes. The frame meshes are shared by reference,
+    // and transforms are copied by value. If first_frames is not empty, frames before first_frames[i] are
+    // skipped for scan i. Scans with no frames to copy are not added. If end_frames is set, it receives the
+    // frame count of each scan of src, which is the first frame of the next copy. Returns the number of frames
+    // copied.
+    size_t CopyModelFramesShallow(artec::sdk::base::IModel* src, artec::sdk::base::IModel* dst,
+        const std::vector<int>& first_frames = std::vector<int>(), std::vector<int>* end_frames = nullptr);
+
+    // Estimates the memory used by the frame meshes, composite meshes, and textures of a model. Frames shared
+    // with other models are counted in full.
+    size_t EstimateModelBytes(artec::sdk::base::IModel* model);
+
+    // Estimated memory of a model with the counts the estimate is based on. bytes includes texture_bytes.
+    struct ModelMemoryEstimate
+    {
+        size_t bytes = 0;
+        size_t texture_bytes = 0;
+        uint32_t frame_count = 0;
+        uint64_t vertex_count = 0;
+        uint64_t triangle_count = 0;
+    };
+
+    ModelMemoryEstimate EstimateModelMemory(artec::sdk::base::IModel* model);
+
+    // Estimates the memory used by a converted Robot Raconteur mesh
+    size_t EstimateRRMeshBytes(const com::robotraconteur::geometry::shapes::MeshPtr& mesh);
+
+    // Current resident memory (working set) of the driver process in bytes. Returns 0 if not available.
+    size_t GetResidentBytes();
+
+    // Counts the vertices and triangles of the frame meshes and composite meshes of a model
+    void CountModelGeometry(artec::sdk::base::IModel* model, uint64_t& vertex_count, uint64_t& triangle_count);
+
+    // User and kernel CPU time used by all threads of the driver process in seconds. Returns 0 if not available.
+    double GetProcessCpuSeconds();
+
 }
\ No newline at end of file
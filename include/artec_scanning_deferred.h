@@ -7,6 +7,9 @@
 #include <artec/sdk/base/IJobObserver.h>
 #include <artec/sdk/base/AlgorithmWorkset.h>
 #include "artec_scanner_util.h" 
+#include "artec_scanner_backend.h"
+#include "artec_scanner_cpu_budget.h"
+#include "artec_scanner_job_manager.h"
 
 #include <boost/thread/thread_pool.hpp>
 #include <list>
@@ -18,16 +21,15 @@ namespace artec_scanner_robotraconteur_driver
     class ArtecScannerImpl;
     struct RRDeferredCapture;
 
-    class DeferredCapturePrepare : public RobotRaconteur::Generator<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void >,
-        public RR_ENABLE_SHARED_FROM_THIS<DeferredCapturePrepare>
+    // Close stops the prepare threads after the frames in progress, and Next reports until they exit
+    class DeferredCapturePrepare
+        : public QueuedJobGenerator<DeferredCapturePrepare,experimental::artec_scanner::DeferredCapturePrepareStatusPtr>
     {
         protected:
             boost::weak_ptr<ArtecScannerImpl> parent;
             boost::shared_ptr<ArtecScannerImpl> GetParent();
             boost::mutex& data_lock;
-            boost::mutex this_lock;
 
-            RobotRaconteur::TimerPtr next_timer;
             std::list<boost::shared_ptr<RRDeferredCapture> > input_data;
 
             boost::atomic<int32_t> completed_count = 0;
@@ -35,18 +37,15 @@ namespace artec_scanner_robotraconteur_driver
 
             bool mesh = false;
             bool stl = false;
-            bool started = false;
-            bool closed = false;
-            bool aborted = false;
-            bool completed = false;
             bool prepare_completed = false;
             size_t active_thread_count = 0;
 
-            boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
-
             boost::thread_group thread_pool;
-            artec::sdk::base::TRef<artec::sdk::capturing::IScanner> scanner;
+            // Frame processor pool of each scanner, indexed by the scanner index of the deferred capture
+            std::vector<ScannerFrameProcessorPoolPtr> processor_pools;
+            CpuBudgetPtr cpu_budget;
+            // Threads assigned to the prepare threads, released when the last thread exits
+            CpuBudgetLeasePtr cpu_lease;
 
         public:
 
@@ -54,27 +53,17 @@ namespace artec_scanner_robotraconteur_driver
 
             void Init(std::list<boost::shared_ptr<RRDeferredCapture> >&& input_data, bool mesh, bool stl);
 
-            void AsyncNext(boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
-                override;
-
-            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
-
-            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
-
-            experimental::artec_scanner::DeferredCapturePrepareStatusPtr Next() override {return nullptr;}
-            void Close() override {}
-            void Abort() override {}
-
         protected:
 
             void complete_gen(boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler) override;
+
+            // Start the prepare threads once admitted by the job queue. The job ticket is released when the last
+            // thread exits.
+            void start_job() override;
 
-            void next_timer_handler(const RobotRaconteur::TimerEvent& evt);
+            bool job_complete() override;
 
-            void prepare();
+            experimental::artec_scanner::DeferredCapturePrepareStatusPtr running_status() override;
     };
 }
\ No newline at end of file
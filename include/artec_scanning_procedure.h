@@ -7,6 +7,11 @@
 #include <artec/sdk/base/IJobObserver.h>
 #include <artec/sdk/base/AlgorithmWorkset.h>
 #include "artec_scanner_util.h" 
+#include "artec_scanner_cpu_budget.h"
+#include "artec_scanner_job_manager.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <list>
 
 #pragma once
 
@@ -17,29 +22,85 @@ namespace artec_scanner_robotraconteur_driver
     class ScanningProcedureObserver;
     class ScanningProcedureJobObserver;
     class RRArtecModel;
-    class ScanningProcedure : public RobotRaconteur::Generator<experimental::artec_scanner::ScanningProcedureStatusPtr,void>,
-        public RR_ENABLE_SHARED_FROM_THIS<ScanningProcedure>
+
+    void ScanningProcedureSettingsToArtec(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings,
+        artec::sdk::scanning::ScanningProcedureSettings& desc);
+
+    // Copies frames out of the output model of a running scanning procedure. The SDK appends frames to the
+    // output model from its worker thread, so snapshot requests are queued and serviced from the scanning
+    // observer callbacks between frames. Once the procedure is not running, or while it has not reported a frame
+    // for stall_period, the copy is made directly.
+    class ScanningSnapshotQueue
+    {
+        protected:
+            struct Request
+            {
+                artec::sdk::base::IModel* dst = nullptr;
+                std::vector<int> first_frames;
+                // Frame count of each scan of the procedure output when the copy was made
+                std::vector<int> end_frames;
+                size_t frame_count = 0;
+                bool done = false;
+                // Set if the copy failed
+                std::string error;
+            };
+
+            boost::mutex this_lock;
+            boost::condition_variable snapshot_cv;
+            std::list<boost::shared_ptr<Request> > requests;
+            artec::sdk::base::IModel* direct_src = nullptr;
+            // Output model of the running procedure and the time of the last observer callback
+            artec::sdk::base::IModel* running_src = nullptr;
+            boost::system_time last_service;
+
+            static void copy_request(artec::sdk::base::IModel* src, Request& req);
+
+            // Copy all queued requests. Must be called with this_lock held.
+            void service_requests(artec::sdk::base::IModel* src);
+
+        public:
+            // Time without observer callbacks after which the procedure is treated as not producing frames
+            static const boost::posix_time::time_duration stall_period;
+
+            // Copies frames from the procedure output into dst, starting at first_frames for each scan. The
+            // procedure output is not modified. If end_frames is set, it receives the first frame of each scan for
+            // the next copy. Returns false if the request was not serviced before timeout. Throws if the copy
+            // failed.
+            bool Snapshot(artec::sdk::base::IModel* dst, const std::vector<int>& first_frames,
+                const boost::posix_time::time_duration& timeout, size_t& frame_count,
+                std::vector<int>* end_frames = nullptr);
+
+            // Called from the scanning observer on the SDK worker thread
+            void Service(artec::sdk::base::IModel* src);
+
+            // Set while the procedure is not running to service requests immediately
+            void SetDirect(artec::sdk::base::IModel* src);
+
+            // Called before the procedure is launched. Requests are queued for the observer callbacks, or copied
+            // from src if the procedure stalls.
+            void SetRunning(artec::sdk::base::IModel* src);
+    };
+
+    // Close stops scanning, and Next keeps reporting until the scanning job completes with the model
+    class ScanningProcedure
+        : public QueuedJobGenerator<ScanningProcedure,experimental::artec_scanner::ScanningProcedureStatusPtr>
     {
         protected:
             boost::weak_ptr<ArtecScannerImpl> parent;
             boost::shared_ptr<ArtecScannerImpl> GetParent();
-            boost::mutex this_lock;
             artec::sdk::base::TRef<artec::sdk::scanning::IScanningProcedure> scanning_procedure;
-            bool started = false;
-            bool closed = false;
-            bool aborted = false;
-            bool completed = false;
             bool artec_job_complete = false;
             artec::sdk::base::ErrorCode artec_job_status = artec::sdk::base::ErrorCode_UnknownExceptionType;
-            boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> next_handler;
             boost::shared_ptr<RRArtecModel> model;
             artec::sdk::base::AlgorithmWorkset workset;
             artec::sdk::base::TRef<artec::sdk::base::IModel> input_container;
             artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
-            RobotRaconteur::TimerPtr next_timer;
             boost::shared_ptr<ScanningProcedureObserver> observer;
             boost::shared_ptr<ScanningProcedureJobObserver> job_observer;
+            // Threads reserved in the CPU budget for real time registration while the procedure runs
+            CpuBudgetLeasePtr cpu_lease;
+            ScanningSnapshotQueue snapshot_queue;
+            boost::atomic<uint32_t> frame_count{0};
         public:
 
             friend class ScanningProcedureObserver;
@@ -47,30 +108,30 @@ namespace artec_scanner_robotraconteur_driver
 
             ScanningProcedure(boost::shared_ptr<ArtecScannerImpl> parent);
 
-            void Init(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings);
+            void Init(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings,
+                artec::sdk::capturing::IScanner* scanner);
 
-            void AsyncNext(boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout = RR_TIMEOUT_INFINITE )
-                override;
+            // Returns a new model sharing the frames scanned so far
+            boost::shared_ptr<RRArtecModel> Snapshot();
 
-            void AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+            // True from when the procedure is launched until the scanning job completes
+            bool IsScanning();
 
-            void AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                            int32_t timeout = RR_TIMEOUT_INFINITE) override;
+        protected:
+            // Launch the procedure once admitted by the job queue. Must be called with this_lock held.
+            void start_job() override;
 
-            experimental::artec_scanner::ScanningProcedureStatusPtr Next() override {return nullptr;}
-            void Close() override {}
-            void Abort() override {}
+            bool job_complete() override;
 
+            // Stops scanning if the procedure was launched
+            void stop_job(bool abort) override;
+
+            experimental::artec_scanner::ScanningProcedureStatusPtr running_status() override;
 
-        protected:
             void scan_job_complete(artec::sdk::base::ErrorCode result);
 
             void complete_gen(boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
-                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler);
-
-            void next_timer_handler(const RobotRaconteur::TimerEvent& evt);
+                const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler) override;
     };
 
     class ScanningProcedureObserver : public artec::sdk::scanning::ScanningProcedureObserverBase
@@ -85,6 +146,9 @@ namespace artec_scanner_robotraconteur_driver
         void onFrameCaptured(const artec::sdk::scanning::RegistrationInfo* frameInfo) override;
 
         void onScanningFinished (int scannerIndex) override;
+
+    protected:
+        void service_snapshots(bool frame_scanned);
     };
 
     class ScanningProcedureJobObserver : public artec::sdk::base::JobObserverBase
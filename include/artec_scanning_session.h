@@ -0,0 +1,116 @@
+#include "experimental__artec_scanner.h"
+#include "experimental__artec_scanner_stubskel.h"
+#include <artec/sdk/capturing/IScanner.h>
+#include <artec/sdk/scanning/IScanningProcedure.h>
+#include <artec/sdk/scanning/IScanningProcedureObserver.h>
+#include <artec/sdk/base/TRef.h>
+#include <artec/sdk/base/IJobObserver.h>
+#include <artec/sdk/base/AlgorithmWorkset.h>
+#include "artec_scanner_util.h"
+#include "artec_scanning_procedure.h"
+#include "artec_scanner_job_manager.h"
+
+#pragma once
+
+namespace artec_scanner_robotraconteur_driver
+{
+    class ArtecScannerImpl;
+    class RRArtecModel;
+    class ScanningSessionObserver;
+    class ScanningSessionJobObserver;
+
+    // Scanning procedure that is created and launched once and kept running between scans. Scans are
+    // recorded by switching the procedure state, and cut_segment() returns the frames recorded since the
+    // previous cut as a new model without tearing down the procedure. The procedure output keeps every frame
+    // recorded by the session until the session is freed.
+    class ScanningSession : public experimental::artec_scanner::ScanningSession_default_impl,
+        public RR_ENABLE_SHARED_FROM_THIS<ScanningSession>
+    {
+        protected:
+            boost::weak_ptr<ArtecScannerImpl> parent;
+            boost::shared_ptr<ArtecScannerImpl> GetParent();
+            boost::mutex this_lock;
+            // Serializes cut_segment() without holding this_lock while waiting for the snapshot
+            boost::mutex cut_segment_lock;
+            artec::sdk::base::TRef<artec::sdk::scanning::IScanningProcedure> scanning_procedure;
+            bool running = false;
+            artec::sdk::base::ErrorCode artec_job_status = artec::sdk::base::ErrorCode_OK;
+            experimental::artec_scanner::ScanningState::ScanningState state;
+            boost::shared_ptr<RRArtecModel> model;
+            artec::sdk::base::AlgorithmWorkset workset;
+            artec::sdk::base::TRef<artec::sdk::base::IModel> input_container;
+            artec::sdk::base::TRef<artec::sdk::base::ICancellationTokenSource> ct_source;
+            boost::shared_ptr<ScanningSessionObserver> observer;
+            boost::shared_ptr<ScanningSessionJobObserver> job_observer;
+            // Job slot held while the session runs
+            JobTicketPtr job_ticket;
+            // Threads reserved in the CPU budget for real time registration while the session runs
+            CpuBudgetLeasePtr cpu_lease;
+            ScanningSnapshotQueue snapshot_queue;
+            boost::atomic<uint32_t> frame_count{0};
+            // First frame of the current segment for each scan in the output model. Guarded by
+            // cut_segment_lock.
+            std::vector<int> segment_start;
+            uint32_t segment_start_frame_count = 0;
+
+            void set_state(experimental::artec_scanner::ScanningState::ScanningState state);
+
+            void scan_job_complete(artec::sdk::base::ErrorCode result);
+
+        public:
+            friend class ScanningSessionObserver;
+            friend class ScanningSessionJobObserver;
+
+            ScanningSession(boost::shared_ptr<ArtecScannerImpl> parent);
+
+            // Creates and launches the scanning procedure. The session takes a job slot for as long as it runs,
+            // so Init throws OperationFailedException if no slot is available instead of waiting in the queue.
+            void Init(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings,
+                artec::sdk::capturing::IScanner* scanner);
+
+            // Stops the scanning procedure. The session cannot be used after Stop().
+            void Stop();
+
+            experimental::artec_scanner::ScanningState::ScanningState get_state() override;
+
+            uint32_t get_frame_count() override;
+
+            uint32_t get_segment_frame_count() override;
+
+            void preview() override;
+
+            void record() override;
+
+            void pause() override;
+
+            void continue_record() override;
+
+            int32_t cut_segment() override;
+    };
+
+    using ScanningSessionPtr = boost::shared_ptr<ScanningSession>;
+
+    class ScanningSessionObserver : public artec::sdk::scanning::ScanningProcedureObserverBase
+    {
+        boost::weak_ptr<ScanningSession> parent;
+
+    public:
+        ScanningSessionObserver(boost::shared_ptr<ScanningSession> parent);
+
+        void onFrameScanned(const artec::sdk::scanning::RegistrationInfo* frameInfo) override;
+
+        void onFrameCaptured(const artec::sdk::scanning::RegistrationInfo* frameInfo) override;
+
+        void onScanningFinished (int scannerIndex) override;
+    };
+
+    class ScanningSessionJobObserver : public artec::sdk::base::JobObserverBase
+    {
+        boost::shared_ptr<ScanningSession> parent;
+
+    public:
+        ScanningSessionJobObserver(boost::shared_ptr<ScanningSession> parent);
+
+        void completed (artec::sdk::base::ErrorCode result) override;
+    };
+}
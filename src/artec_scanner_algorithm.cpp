@@ -5,6 +5,8 @@
 #include <artec/sdk/algorithms/Algorithms.h>
 #include <artec/sdk/base/IScan.h>
 
+#include <algorithm>
+
 namespace asdk {
     using namespace artec::sdk::base;
     using namespace artec::sdk::algorithms;
@@ -34,270 +36,488 @@ boost::shared_ptr<ArtecScannerImpl> RunAlgorithms::GetParent()
 }
 
 RunAlgorithms::RunAlgorithms(boost::shared_ptr<ArtecScannerImpl> parent)
+    : QueuedJobGenerator("run_algorithms", "Run Algorithms", false)
 {
     this->parent = parent;
 }
 
-void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model, 
-    const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms)
+static asdk::ScannerType get_input_scanner_type(const boost::shared_ptr<RRArtecModel>& input_model)
 {
     if (input_model->model->getSize() <= 0)
     {
         RR_ARTEC_LOG_ERROR("Model passed to run_algorithms does not contain any scans")
         throw RR::InvalidArgumentException("Model passed to run_algorithms does not contain any scans");
     }
+    return input_model->model->getElement(0)->getScannerType();
+}
 
-    this->input_model = input_model;
-
-    auto scanner_type = input_model->model->getElement(0)->getScannerType();
+void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model, 
+    const RobotRaconteur::RRListPtr<RobotRaconteur::RRValue>& algorithms)
+{
+    RR_NULL_CHECK(algorithms);
+    auto scanner_type = get_input_scanner_type(input_model);
 
-    std::vector<asdk::TRef<asdk::IAlgorithm> > artec_algs;
+    std::vector<RunAlgorithmsNodePtr> new_nodes;
     for(auto& alg : *algorithms)
     {
-        asdk::TRef<asdk::IAlgorithm> artec_alg;
-        auto alg_rr_type = alg->RRType();
-        // Look at type of each algorithm and dispatch appropriately
-        if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::AutoAlignAlgorithm>(alg);
-            create_auto_align_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
-        {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(alg);
-            create_fast_fusion_algorithm(&artec_alg, alg2, scanner_type); 
-        }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
+        auto node = boost::make_shared<RunAlgorithmsNode>();
+        // Feed output of last algorithm as input to next algorithm
+        node->input = static_cast<int32_t>(new_nodes.size()) - 1;
+        create_algorithm(&node->algorithm, alg, scanner_type);
+        node->name = alg->RRType();
+        node->cache_key = algorithm_settings_key(alg);
+        node->max_threads = algorithm_max_threads(alg);
+        new_nodes.push_back(node);
+    }
+
+    init_nodes(input_model, new_nodes);
+}
+
+void RunAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model,
+    const RobotRaconteur::RRListPtr<rr_artec::AlgorithmPipelineNode>& pipeline)
+{
+    RR_NULL_CHECK(pipeline);
+    auto scanner_type = get_input_scanner_type(input_model);
+
+    std::vector<RunAlgorithmsNodePtr> new_nodes;
+    std::map<std::string,int32_t> node_names;
+    for(auto& pipeline_node : *pipeline)
+    {
+        RR_NULL_CHECK(pipeline_node);
+        auto node = boost::make_shared<RunAlgorithmsNode>();
+        node->name = pipeline_node->name;
+        if (node->name.empty() || node_names.find(node->name) != node_names.end())
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(alg);
-            create_fast_mesh_simplification_algorithm(&artec_alg, alg2, scanner_type); 
+            RR_ARTEC_LOG_ERROR("Pipeline node names must be unique and not empty: " << node->name);
+            throw RR::InvalidArgumentException("Pipeline node names must be unique and not empty: " + node->name);
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
+
+        if (!pipeline_node->input.empty())
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(alg);
-            create_global_registration_algorithm(&artec_alg, alg2, scanner_type); 
+            auto e = node_names.find(pipeline_node->input);
+            if (e == node_names.end())
+            {
+                RR_ARTEC_LOG_ERROR("Pipeline node " << node->name << " input " << pipeline_node->input 
+                    << " must be listed before the node");
+                throw RR::InvalidArgumentException("Pipeline node " + node->name + " input " 
+                    + pipeline_node->input + " must be listed before the node");
+            }
+            node->input = e->second;
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
+
+        create_algorithm(&node->algorithm, pipeline_node->algorithm, scanner_type);
+        node->cache_key = algorithm_settings_key(pipeline_node->algorithm);
+        node->max_threads = algorithm_max_threads(pipeline_node->algorithm);
+        node->retain_output = pipeline_node->retain_output.value != 0;
+        node_names.insert(std::make_pair(node->name, static_cast<int32_t>(new_nodes.size())));
+        new_nodes.push_back(node);
+    }
+
+    init_nodes(input_model, new_nodes);
+}
+
+void RunAlgorithms::init_nodes(boost::shared_ptr<RRArtecModel> input_model, std::vector<RunAlgorithmsNodePtr>& nodes)
+{
+    if (nodes.empty())
+    {
+        RR_ARTEC_LOG_ERROR("No algorithms specified to run_algorithms");
+        throw RR::InvalidArgumentException("No algorithms specified");
+    }
+
+    std::string input_key = "model:" + boost::lexical_cast<std::string>(input_model->content_id);
+    for (uint32_t i=0; i<nodes.size(); i++)
+    {
+        auto& node = nodes.at(i);
+        auto input = node->input;
+        if (input >= 0)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::LoopClosureAlgorithm>(alg);
-            create_loop_closure_algorithm(&artec_alg, alg2, scanner_type); 
+            nodes.at(input)->children.push_back(i);
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
+        // Inputs are listed first so the input key is already complete
+        node->cache_key = (input >= 0 ? nodes.at(input)->cache_key : input_key) + "|" + node->cache_key;
+    }
+
+    this->input_model = input_model;
+    this->nodes.swap(nodes);
+    auto parent = GetParent();
+    this->cache = parent->algorithm_cache;
+    this->cpu_budget = parent->cpu_budget;
+    this->job_manager = parent->job_manager;
+}
+
+void RunAlgorithms::resolve_cached_nodes()
+{
+    // Children are listed after their inputs, so visiting in reverse resolves the children first
+    for (int32_t i=static_cast<int32_t>(nodes.size())-1; i>=0; i--)
+    {
+        auto& node = nodes.at(i);
+        auto cached = cache ? cache->Get(node->cache_key) : nullptr;
+        if (cached)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(alg);
-            create_mesh_simplification_algorithm(&artec_alg, alg2, scanner_type); 
+            // New handle sharing the cached model, like models loaded from the project cache, so the handles do
+            // not share the persisted and memory estimate state of the cache entry
+            node->output_model = RR_MAKE_SHARED<RRArtecModel>(cached->model, cached->content_id);
+            node->output_bytes = EstimateModelBytes(cached->model);
+            cached_model_bytes += node->output_bytes;
+            add_model_bytes(node->output_bytes);
+            node->started = true;
+            node->complete = true;
+            node->cache_hit = true;
+            node->cached = true;
+            cache_hits++;
+            RR_ARTEC_LOG_INFO("Algorithm " << i << ": " << node->name << " result found in cache");
+            continue;
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
+
+        bool needed = node->children.empty() || node->retain_output;
+        for (auto c : node->children)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(alg);
-            create_outliers_removal_algorithm(&artec_alg, alg2, scanner_type); 
+            if (!nodes.at(c)->complete)
+            {
+                needed = true;
+            }
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
+
+        if (!needed)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(alg);
-            create_poisson_fusion_algorithm(&artec_alg, alg2, scanner_type); 
+            node->started = true;
+            node->complete = true;
+            node->skipped = true;
+            continue;
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
+        cache_misses++;
+    }
+
+    for (uint32_t i=0; i<nodes.size(); i++)
+    {
+        if (nodes.at(i)->complete)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(alg);
-            create_serial_registration_algorithm(&artec_alg, alg2, scanner_type); 
+            release_node_input(i);
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
+    }
+}
+
+void RunAlgorithms::release_node_input(uint32_t node_index)
+{
+    auto input = nodes.at(node_index)->input;
+    if (input < 0)
+    {
+        for (auto& node : nodes)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(alg);
-            create_small_objects_filter_algorithm(&artec_alg, alg2, scanner_type); 
+            if (node->input < 0 && !node->complete)
+            {
+                return;
+            }
         }
-        else
-        if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
+        if (input_model)
         {
-            auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(alg);
-            create_texturization_algorithm(&artec_alg, alg2, scanner_type); 
+            model_bytes -= input_model_bytes;
+            input_model.reset();
         }
-        
+        return;
+    }
 
-        if (!artec_alg)
+    auto& input_node = nodes.at(input);
+    if (input_node->retain_output || !input_node->output_model)
+    {
+        return;
+    }
+    for (auto c : input_node->children)
+    {
+        if (!nodes.at(c)->complete)
         {
-            RR_ARTEC_LOG_ERROR("Invalid algorithm type: " << alg_rr_type);
-            throw RR::InvalidArgumentException("Invalid algorithm type: " + alg_rr_type);
+            return;
         }
-
-        artec_algs.push_back(std::move(artec_alg));
     }
-
-    if (artec_algs.empty())
+    RR_ARTEC_LOG_INFO("Releasing output of algorithm " << input << ": " << input_node->name);
+    model_bytes -= input_node->output_bytes;
+    if (input_node->cached)
     {
-        RR_ARTEC_LOG_ERROR("No algorithms specified to run_algorithms");
-        throw RR::InvalidArgumentException("No algorithms specified");
+        // The cache keeps the model until it is evicted, so it now counts as held by the cache only
+        cached_model_bytes -= input_node->output_bytes;
     }
+    input_node->output_model.reset();
+}
 
-    artec_algorithms.swap(artec_algs);
+void RunAlgorithms::add_model_bytes(size_t bytes)
+{
+    model_bytes += bytes;
+    update_peak_model_bytes();
 }
 
-void RunAlgorithms::AsyncNext(boost::function<void(const experimental::artec_scanner::RunAlgorithmsStatusPtr&,
-    const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout)
+void RunAlgorithms::update_peak_model_bytes()
 {
-    boost::mutex::scoped_lock lock(this_lock);
-        if (aborted)
-        {
-            throw RR::OperationAbortedException("Scanning Procedure operation was aborted");
-        }
-        if (closed || completed)
-        {
-            throw RR::StopIterationException("");
-        }
+    // Cached results stay resident after the run releases them, so the cache is part of the peak
+    size_t cache_bytes = cache ? cache->GetBytes() : 0;
+    size_t other_cache_bytes = cache_bytes > cached_model_bytes ? cache_bytes - cached_model_bytes : 0;
+    peak_model_bytes = std::max(peak_model_bytes, model_bytes + other_cache_bytes);
+}
+
+void RunAlgorithms::update_peak_resident_bytes()
+{
+    peak_resident_bytes = std::max(peak_resident_bytes, GetResidentBytes());
+}
 
-        if (!started)
+void RunAlgorithms::launch_ready_nodes()
+{
+    for (uint32_t i=0; i<nodes.size(); i++)
+    {
+        if (failed_algorithm >= 0)
         {
-            RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
-            auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), 0);
-            auto job = artec_algorithms.at(0);
-            current_input_model = input_model;
-            current_output_model = RR_MAKE_SHARED<RRArtecModel>();
-            current_workset.in = current_input_model->model;
-            current_workset.out = current_output_model->model;
-            current_workset.cancellation = ct_source->getToken();
-            current_workset.progress = nullptr;
-            current_workset.threadsCount = 0;
-
-            RR_CALL_ARTEC(asdk::launchJob(job, &current_workset, job_observer), 
-                "Error launching scanning procedure");
-            started = true;
-            auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->output_model_handle = 0;
-            ret->current_algorithm = 0;
-            RR_ARTEC_LOG_INFO("Started scanning procedure")
-            lock.unlock();
-            handler(ret, nullptr);
             return;
         }
 
-        if (next_handler)
+        auto& node = nodes.at(i);
+        if (node->started)
+        {
+            continue;
+        }
+        if (node->input >= 0 && !nodes.at(node->input)->complete)
         {
-            throw RR::InvalidOperationException("Next call already in progress");
+            continue;
         }
 
-        if (artec_job_complete)
+        auto node_input_model = node->input >= 0 ? nodes.at(node->input)->output_model : input_model;
+        node->output_model = RR_MAKE_SHARED<RRArtecModel>();
+        node->workset.in = node_input_model->model;
+        node->workset.out = node->output_model->model;
+        node->workset.cancellation = ct_source->getToken();
+        node->progress = boost::make_shared<AlgorithmProgressObserver>();
+        node->workset.progress = node->progress.get();
+        node->cpu_lease = cpu_budget->Acquire(node->max_threads);
+        node->workset.threadsCount = node->cpu_lease->get_threads();
+        node->start_time = std::chrono::steady_clock::now();
+
+        auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), i);
+        auto res = asdk::launchJob(node->algorithm, &node->workset, job_observer);
+        if (res != asdk::ErrorCode_OK)
         {
-            complete_gen(handler);
+            RR_ARTEC_LOG_ERROR(ArtecErrorCodeLogMessage(res) << "Error launching algorithm " << node->name);
+            failed_algorithm = i;
+            artec_job_status = res;
+            node->cpu_lease.reset();
+            // Stop the branches that are already running
+            ct_source->cancel();
             return;
         }
+        node->started = true;
+        running_count++;
+        current_algorithm = i;
+        RR_ARTEC_LOG_INFO("Launched algorithm " << i << ": " << node->name << " with " 
+            << node->workset.threadsCount << " threads");
+    }
+}
 
-        if (last_algorithm_update < current_algorithm)
+rr_artec::RunAlgorithmsStatusPtr RunAlgorithms::running_status()
+{
+    auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
+    ret->action_status = started ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::queued;
+    ret->output_model_handle = 0;
+    ret->output_model_handles = RR::AllocateEmptyRRArray<int32_t>(0);
+    ret->current_algorithm = current_algorithm;
+    ret->cache_hits = cache_hits;
+    ret->cache_misses = cache_misses;
+    ret->stage_model_handles = RR::AllocateEmptyRRMap<std::string,RR::RRArray<int32_t> >();
+    update_peak_model_bytes();
+    update_peak_resident_bytes();
+    ret->peak_model_bytes = peak_model_bytes;
+    ret->peak_resident_bytes = peak_resident_bytes;
+    fill_progress(ret);
+    ret->job_id = job_id;
+    ret->queue_position = started ? 0 : job_manager->GetQueuePosition(job_id);
+    last_algorithm_update = current_algorithm;
+    return ret;
+}
+
+void RunAlgorithms::fill_progress(const rr_artec::RunAlgorithmsStatusPtr& status)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto stage_elapsed = RR::AllocateRRArray<double>(nodes.size());
+    double completed_fraction = 0.0;
+    for (size_t i=0; i<nodes.size(); i++)
+    {
+        auto& node = nodes.at(i);
+        double elapsed = 0.0;
+        double fraction = 0.0;
+        if (node->cache_hit || node->skipped)
         {
-            auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->output_model_handle = 0;
-            ret->current_algorithm = current_algorithm;
-            last_algorithm_update = current_algorithm;
-            lock.unlock();
-            handler(ret, nullptr);
-            return;
+            fraction = 1.0;
         }
+        else if (node->started)
+        {
+            auto end_time = node->complete ? node->end_time : now;
+            elapsed = std::chrono::duration<double>(end_time - node->start_time).count();
+            if (node->complete)
+            {
+                fraction = 1.0;
+            }
+            else
+            {
+                int32_t total = node->progress->total.load(boost::memory_order_relaxed);
+                int32_t current = node->progress->current.load(boost::memory_order_relaxed);
+                if (total > 0)
+                {
+                    fraction = std::min(1.0, std::max(0.0, static_cast<double>(current) / total));
+                }
+            }
+        }
+        (*stage_elapsed)[i] = elapsed;
+        completed_fraction += fraction;
+    }
+    completed_fraction /= nodes.size();
 
-        next_handler = handler;
+    auto& node = nodes.at(current_algorithm);
+    status->progress_current = node->progress ? node->progress->current.load(boost::memory_order_relaxed) : 0;
+    status->progress_total = node->progress ? node->progress->total.load(boost::memory_order_relaxed) : 0;
+    status->progress = completed_fraction;
+    status->stage_elapsed = stage_elapsed;
 
-        RR_WEAK_PTR<RunAlgorithms> weak_this = shared_from_this();
-        next_timer = RR::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5), 
-            [weak_this](const RR::TimerEvent& evt) {
-                auto t = weak_this.lock();
-                if (!t) return;
-                t->next_timer_handler(evt);
-        }, true);
-        next_timer->Start();
+    // Extrapolate from the overall fraction complete, smoothed across status updates
+    if (completed_fraction >= 1.0)
+    {
+        eta = 0.0;
+    }
+    else if (completed_fraction > 0.0)
+    {
+        double run_elapsed = std::chrono::duration<double>(now - start_time).count();
+        double estimate = run_elapsed * (1.0 - completed_fraction) / completed_fraction;
+        eta = eta < 0.0 ? estimate : 0.7 * eta + 0.3 * estimate;
     }
+    status->eta = eta;
+}
 
-void RunAlgorithms::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                int32_t timeout)
+void RunAlgorithms::start_job()
 {
-    boost::mutex::scoped_lock lock(this_lock);
-    if (closed || aborted)
+    started = true;
+    try
     {
-        lock.unlock();
-        handler(nullptr);
-        return;
+        RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
+        start_time = std::chrono::steady_clock::now();
+        input_model_bytes = EstimateModelBytes(input_model->model);
+        add_model_bytes(input_model_bytes);
+        update_peak_resident_bytes();
+        resolve_cached_nodes();
+        launch_ready_nodes();
+        if (running_count == 0)
+        {
+            if (failed_algorithm >= 0)
+            {
+                ThrowArtecErrorCode(artec_job_status, "Error launching algorithm");
+            }
+            // All results were found in the cache
+            job_ticket.reset();
+            artec_job_complete = true;
+            return;
+        }
     }
-    closed = true;
-    this->ct_source->cancel();
-    lock.unlock();
-    handler(nullptr);
+    catch (std::exception&)
+    {
+        completed = true;
+        job_ticket.reset();
+        throw;
+    }
+    RR_ARTEC_LOG_INFO("Started run algorithms job " << job_id)
 }
 
-void RunAlgorithms::AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                int32_t timeout)
+bool RunAlgorithms::job_complete()
 {
-     boost::mutex::scoped_lock lock(this_lock);
-    if (closed || aborted)
+    return artec_job_complete;
+}
+
+bool RunAlgorithms::status_updated()
+{
+    return last_algorithm_update != current_algorithm;
+}
+
+void RunAlgorithms::stop_job(bool abort)
+{
+    if (ct_source)
     {
-        lock.unlock();
-        handler(nullptr);
-        return;
+        this->ct_source->cancel();
     }
-    aborted = true;
-    this->ct_source->cancel();
-    lock.unlock();
-    handler(nullptr);
 }
 
 void RunAlgorithms::algorithm_job_complete(artec::sdk::base::ErrorCode result, uint32_t job_number)
 {
-    boost::mutex::scoped_lock lock(this_lock);
-    auto next_algorithm = current_algorithm+1;
-    
-    if ((next_algorithm) < artec_algorithms.size() && result == asdk::ErrorCode_OK)
+    size_t output_bytes = 0;
+    bool cached = false;
+    if (result == asdk::ErrorCode_OK)
     {
-        auto job = artec_algorithms.at(next_algorithm);
-        // Feed output of last algorithm as input to next algorithm
-        current_input_model = current_output_model;
-        current_output_model = RR_MAKE_SHARED<RRArtecModel>();
-        current_workset.in = current_input_model->model;
-        current_workset.out = current_output_model->model;
-
-        auto job_observer = new RunAlgorithmsJobObserver(shared_from_this(), next_algorithm);
-        RR_CALL_ARTEC(asdk::launchJob(job, &current_workset, job_observer), 
-                "Error launching next algorithm");
-        
-        current_algorithm = next_algorithm;
-        auto h = next_handler;
-        next_handler.clear();
-        if (h)
+        auto& completed_node = nodes.at(job_number);
+        output_bytes = EstimateModelBytes(completed_node->output_model->model);
+        // Intermediate outputs are cached too, so a later run that only changes the following algorithms can
+        // start from them. The run still releases its own reference as soon as the children complete, and the
+        // cache evicts the least recently used results beyond its memory budget.
+        if (cache)
         {
-            auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->output_model_handle = 0;
-            ret->current_algorithm = current_algorithm;
-            last_algorithm_update = current_algorithm;
-            lock.unlock();
-            h(ret, nullptr);
-            return;
+            cache->Put(completed_node->cache_key, RR_MAKE_SHARED<RRArtecModel>(completed_node->output_model->model,
+                completed_node->output_model->content_id), output_bytes);
+            completed_node->output_model->shared = true;
+            cached = true;
         }
     }
-    else
+
+    boost::mutex::scoped_lock lock(this_lock);
+    auto& node = nodes.at(job_number);
+    node->complete = true;
+    node->end_time = std::chrono::steady_clock::now();
+    node->cpu_lease.reset();
+    node->output_bytes = output_bytes;
+    running_count--;
+    if (cached)
     {
-        artec_job_complete = true;
+        node->cached = true;
+        cached_model_bytes += output_bytes;
+    }
+    add_model_bytes(output_bytes);
+    update_peak_resident_bytes();
+    // Drop the input of this node if no other node still needs it
+    release_node_input(job_number);
+    RR_ARTEC_LOG_INFO("Algorithm " << job_number << " complete: " << (int32_t)result);
+
+    if (result != asdk::ErrorCode_OK && failed_algorithm < 0)
+    {
+        failed_algorithm = job_number;
         artec_job_status = result;
+        // Cancel the other branches so the failure is reported promptly
+        ct_source->cancel();
+    }
+
+    launch_ready_nodes();
+
+    if (running_count > 0)
+    {
         auto h = next_handler;
-        next_handler.clear();
-        if (h)
+        if (h && last_algorithm_update != current_algorithm)
         {
+            next_handler.clear();
             try
             {
                 next_timer->Stop();
             }
             catch (std::exception&) {}
+            auto ret = running_status();
+            lock.unlock();
+            h(ret, nullptr);
+        }
+        return;
+    }
 
-            complete_gen(h);
-            return;
+    artec_job_complete = true;
+    // Free the job slot for queued jobs
+    job_ticket.reset();
+    auto h = next_handler;
+    next_handler.clear();
+    if (h)
+    {
+        try
+        {
+            next_timer->Stop();
         }
+        catch (std::exception&) {}
+
+        complete_gen(h);
+        return;
     }
 }
 
@@ -310,34 +530,63 @@ void RunAlgorithms::complete_gen(boost::function<void(const experimental::artec_
 
     if (artec_job_status != asdk::ErrorCode_OK)
     {
-        auto exp = ArtecErrorToExceptionPtr(artec_job_status, "Run Algorithms execution failed for algorithm: " + current_algorithm);
+        std::string failed_name = failed_algorithm >= 0 ? nodes.at(failed_algorithm)->name : "";
+        auto exp = ArtecErrorToExceptionPtr(artec_job_status, "Run Algorithms execution failed for algorithm: "
+            + boost::lexical_cast<std::string>(failed_algorithm) + " " + failed_name);
         handler(nullptr, exp);
         return;
     }
 
-    auto handle = GetParent()->add_model(current_output_model);
+    auto parent = GetParent();
+    std::vector<int32_t> handles;
+    auto stage_handles = RR::AllocateEmptyRRMap<std::string,RR::RRArray<int32_t> >();
+    for (auto& node : nodes)
+    {
+        if (node->children.empty())
+        {
+            auto h = parent->add_model(node->output_model);
+            // Results from the cache were checkpointed by the run that computed them
+            if (!node->cache_hit)
+            {
+                parent->autosave_model(h, node->output_model, "algorithm");
+            }
+            handles.push_back(h);
+            if (node->retain_output)
+            {
+                stage_handles->insert(std::make_pair(node->name, RR::ScalarToRRArray<int32_t>(h)));
+            }
+        }
+        else if (node->retain_output)
+        {
+            auto h = parent->add_model(node->output_model);
+            stage_handles->insert(std::make_pair(node->name, RR::ScalarToRRArray<int32_t>(h)));
+        }
+    }
+    update_peak_resident_bytes();
+
     auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
     ret->action_status = rr_action::ActionStatusCode::complete;
-    ret->output_model_handle = handle;
+    ret->output_model_handle = handles.back();
+    ret->output_model_handles = RR::AttachRRArrayCopy(handles.data(), handles.size());
     ret->current_algorithm = current_algorithm;
+    ret->cache_hits = cache_hits;
+    ret->cache_misses = cache_misses;
+    ret->stage_model_handles = stage_handles;
+    ret->peak_model_bytes = peak_model_bytes;
+    ret->peak_resident_bytes = peak_resident_bytes;
+    fill_progress(ret);
+    ret->job_id = job_id;
+    ret->queue_position = 0;
+    RR_ARTEC_LOG_INFO("Run Algorithms cache hits: " << cache_hits << " misses: " << cache_misses);
+    RR_ARTEC_LOG_INFO("Run Algorithms peak model bytes: " << peak_model_bytes << " peak resident bytes: " 
+        << peak_resident_bytes);
     handler(ret,nullptr);
 }
 
-void RunAlgorithms::next_timer_handler(const RobotRaconteur::TimerEvent& evt)
+void AlgorithmProgressObserver::report(int current, int total)
 {
-    boost::mutex::scoped_lock lock(this_lock);
-    auto h = next_handler;
-    next_handler.clear();
-    if (h)
-    {
-        auto ret = rr_artec::RunAlgorithmsStatusPtr(new rr_artec::RunAlgorithmsStatus());
-        ret->action_status = rr_action::ActionStatusCode::running;
-        ret->output_model_handle = 0;
-        ret->current_algorithm = current_algorithm;
-        last_algorithm_update = current_algorithm;
-        h(ret, nullptr);
-        return;
-    }
+    this->current.store(current, boost::memory_order_relaxed);
+    this->total.store(total, boost::memory_order_relaxed);
 }
 
 RunAlgorithmsJobObserver::RunAlgorithmsJobObserver(boost::shared_ptr<RunAlgorithms> parent, uint32_t job_number)
@@ -0,0 +1,92 @@
+#include "artec_scanner_algorithm_cache.h"
+#include "artec_scanner_impl.h"
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    AlgorithmResultCache::AlgorithmResultCache(size_t budget_bytes)
+    {
+        this->budget_bytes = budget_bytes;
+    }
+
+    boost::shared_ptr<RRArtecModel> AlgorithmResultCache::Get(const std::string& key)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = index.find(key);
+        if (e == index.end())
+        {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, e->second);
+        return e->second->model;
+    }
+
+    void AlgorithmResultCache::Put(const std::string& key, boost::shared_ptr<RRArtecModel> model, size_t bytes)
+    {
+        if (budget_bytes == 0)
+        {
+            return;
+        }
+
+        if (bytes > budget_bytes)
+        {
+            RR_ARTEC_LOG_INFO("Algorithm result of " << bytes << " bytes is larger than the cache budget");
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = index.find(key);
+        if (e != index.end())
+        {
+            total_bytes -= e->second->bytes;
+            entries.erase(e->second);
+            index.erase(e);
+        }
+
+        while (!entries.empty() && total_bytes + bytes > budget_bytes)
+        {
+            auto& lru = entries.back();
+            RR_ARTEC_LOG_INFO("Evicting algorithm result of " << lru.bytes << " bytes from cache");
+            total_bytes -= lru.bytes;
+            index.erase(lru.key);
+            entries.pop_back();
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.model = model;
+        entry.bytes = bytes;
+        entries.push_front(std::move(entry));
+        index.insert(std::make_pair(key, entries.begin()));
+        total_bytes += bytes;
+    }
+
+    void AlgorithmResultCache::Clear()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        index.clear();
+        entries.clear();
+        total_bytes = 0;
+    }
+
+    size_t AlgorithmResultCache::GetBytes()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return total_bytes;
+    }
+
+    size_t AlgorithmResultCache::GetBytes(std::set<artec::sdk::base::IModel*>& counted)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        size_t bytes = 0;
+        for (auto& e : entries)
+        {
+            if (counted.insert(static_cast<artec::sdk::base::IModel*>(e.model->model)).second)
+            {
+                bytes += e.bytes;
+            }
+        }
+        return bytes;
+    }
+}
@@ -4,6 +4,13 @@
 #include <artec/sdk/base/IScan.h>
 
 #include "artec_scanner_impl.h"
+#include "artec_scanner_model_filters.h"
+
+#include <algorithm>
+#include <boost/algorithm/string/predicate.hpp>
+#include <iomanip>
+#include <limits>
+#include <sstream>
 
 #define RR_ARTEC_PREFIX "experimental.artec_scanner."
 
@@ -186,6 +193,289 @@ void create_outliers_removal_algorithm(artec::sdk::algorithms::IAlgorithm** alg,
     RR_CALL_ARTEC(asdk::createOutliersRemovalAlgorithm(alg, &s), "Could not create OutlierRemovalsAlgorithm");
 }
 
+void create_algorithm(artec::sdk::algorithms::IAlgorithm** alg,
+    const RobotRaconteur::RRValuePtr& settings,
+    artec::sdk::base::ScannerType scanner_type)
+{
+    RR_NULL_CHECK(settings);
+    *alg = nullptr;
+    auto alg_rr_type = settings->RRType();
+    // Look at type of each algorithm and dispatch appropriately
+    if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::AutoAlignAlgorithm>(settings);
+        create_auto_align_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(settings);
+        create_fast_fusion_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(settings);
+        create_fast_mesh_simplification_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(settings);
+        create_global_registration_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::LoopClosureAlgorithm>(settings);
+        create_loop_closure_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(settings);
+        create_mesh_simplification_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(settings);
+        create_outliers_removal_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(settings);
+        create_poisson_fusion_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(settings);
+        create_serial_registration_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(settings);
+        create_small_objects_filter_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(settings);
+        create_texturization_algorithm(alg, alg2, scanner_type); 
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "CropAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::CropAlgorithm>(settings);
+        create_crop_algorithm(alg, alg2, scanner_type);
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FrameDecimationAlgorithm"))
+    {
+        auto alg2 = RR_DYNAMIC_POINTER_CAST<rr_artec::FrameDecimationAlgorithm>(settings);
+        create_frame_decimation_algorithm(alg, alg2, scanner_type);
+    }
+
+    if (!*alg)
+    {
+        RR_ARTEC_LOG_ERROR("Invalid algorithm type: " << alg_rr_type);
+        throw RR::InvalidArgumentException("Invalid algorithm type: " + alg_rr_type);
+    }
+}
+
+std::string algorithm_settings_key(const RobotRaconteur::RRValuePtr& settings)
+{
+    RR_NULL_CHECK(settings);
+    auto alg_rr_type = settings->RRType();
+    std::ostringstream o;
+    o << std::setprecision(std::numeric_limits<float>::max_digits10);
+    o << alg_rr_type << "{";
+    if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
+    {
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(settings);
+        o << "resolution=" << s->resolution << ",radius=" << s->radius
+            << ",generate_normals=" << (int)s->generate_normals.value;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(settings);
+        o << "triangle_number=" << s->triangle_number << ",keep_boundary=" << (int)s->keep_boundary.value
+            << ",enable_additional_criteria=" << (int)s->enable_additional_criteria.value
+            << ",enable_distance_threshold=" << (int)s->enable_distance_threshold.value
+            << ",distance_threshold=" << s->distance_threshold
+            << ",enable_angle_threshold=" << (int)s->enable_angle_threshold.value
+            << ",angle_threshold=" << s->angle_threshold
+            << ",enable_aspect_ratio_threshold=" << (int)s->enable_aspect_ratio_threshold.value
+            << ",aspect_ratio_threshold=" << s->aspect_ratio_threshold;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(settings);
+        o << "registration_type=" << (int)s->registration_type;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
+    {
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(settings);
+        o << "simplify_type=" << (int)s->simplify_type << ",simplify_metrics=" << (int)s->simplify_metrics
+            << ",triangle_number=" << s->triangle_number << ",keep_boundary=" << (int)s->keep_boundary.value
+            << ",angle_threshold=" << s->angle_threshold << ",remesh_edge_threshold=" << s->remesh_edge_threshold
+            << ",error=" << s->error;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(settings);
+        o << "standard_deviation_multiplier=" << s->standard_deviation_multiplier
+            << ",resolution=" << s->resolution;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(settings);
+        o << "fusion_type=" << (int)s->fusion_type << ",fill_type=" << (int)s->fill_type
+            << ",resolution=" << s->resolution << ",max_hole_radius=" << s->max_hole_radius
+            << ",remove_targets=" << (int)s->remove_targets.value
+            << ",target_inner_size=" << s->target_inner_size << ",target_outer_size=" << s->target_outer_size
+            << ",generate_normals=" << (int)s->generate_normals.value
+            << ",input_filter_type=" << (int)s->input_filter_type;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(settings);
+        o << "registration_type=" << (int)s->registration_type;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(settings);
+        o << "filter_type=" << (int)s->filter_type << ",filter_threshold=" << s->filter_threshold;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(settings);
+        o << "texturize_type=" << (int)s->texturize_type << ",texturize_resolution=" << (int)s->texturize_resolution
+            << ",enable_background_segmentation=" << (int)s->enable_background_segmentation.value
+            << ",enable_ambient_lighting_compensation=" << (int)s->enable_ambient_lighting_compensation.value
+            << ",atlas_unfolding_polygon_limit=" << s->atlas_unfolding_polygon_limit
+            << ",enable_texture_inpainting=" << (int)s->enable_texture_inpainting.value
+            << ",use_texture_normalization=" << (int)s->use_texture_normalization.value
+            << ",input_filter_type=" << (int)s->input_filter_type;
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "CropAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::CropAlgorithm>(settings);
+        auto& r = s->box_transform.s.rotation.s;
+        auto& t = s->box_transform.s.translation.s;
+        o << "box_transform=" << r.w << "," << r.x << "," << r.y << "," << r.z << "," << t.x << "," << t.y << "," << t.z
+            << ",box_size=" << s->box_size.s.x << "," << s->box_size.s.y << "," << s->box_size.s.z << ",hull=";
+        size_t plane_count = s->hull_normals ? s->hull_normals->size() : 0;
+        for (size_t i=0; i<plane_count; i++)
+        {
+            auto& n = s->hull_normals->at(i).s;
+            o << n.x << "," << n.y << "," << n.z << ",";
+            if (s->hull_offsets && i < s->hull_offsets->size())
+            {
+                o << (*s->hull_offsets)[i];
+            }
+            o << ";";
+        }
+    }
+    else
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FrameDecimationAlgorithm"))
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FrameDecimationAlgorithm>(settings);
+        o << "min_translation=" << s->min_translation << ",min_rotation=" << s->min_rotation
+            << ",max_frame_count=" << s->max_frame_count;
+    }
+    else
+    {
+        RR_ARTEC_LOG_ERROR("Invalid algorithm type: " << alg_rr_type);
+        throw RR::InvalidArgumentException("Invalid algorithm type: " + alg_rr_type);
+    }
+    o << "}";
+    return o.str();
+}
+
+template<typename T>
+static uint32_t extended_max_threads(const RobotRaconteur::RRValuePtr& settings)
+{
+    auto s = RR_DYNAMIC_POINTER_CAST<T>(settings);
+    if (!s || !s->extended)
+    {
+        return 0;
+    }
+    auto e = s->extended->find("max_threads");
+    if (e == s->extended->end() || !e->second)
+    {
+        return 0;
+    }
+
+    if (auto a = RR_DYNAMIC_POINTER_CAST<RR::RRArray<uint32_t> >(e->second))
+    {
+        return RR::RRArrayToScalar(a);
+    }
+    if (auto a = RR_DYNAMIC_POINTER_CAST<RR::RRArray<int32_t> >(e->second))
+    {
+        return static_cast<uint32_t>(std::max(0, RR::RRArrayToScalar(a)));
+    }
+    if (auto a = RR_DYNAMIC_POINTER_CAST<RR::RRArray<double> >(e->second))
+    {
+        return static_cast<uint32_t>(std::max(0.0, RR::RRArrayToScalar(a)));
+    }
+    RR_ARTEC_LOG_ERROR("Algorithm max_threads must be a uint32, int32, or double scalar");
+    throw RR::InvalidArgumentException("Algorithm max_threads must be a uint32, int32, or double scalar");
+}
+
+uint32_t algorithm_max_threads(const RobotRaconteur::RRValuePtr& settings)
+{
+    RR_NULL_CHECK(settings);
+    auto alg_rr_type = settings->RRType();
+    if (alg_rr_type == (RR_ARTEC_PREFIX "AutoAlignAlgorithm"))
+        return extended_max_threads<rr_artec::AutoAlignAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastFusionAlgorithm"))
+        return extended_max_threads<rr_artec::FastFusionAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm"))
+        return extended_max_threads<rr_artec::FastMeshSimplificationAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm"))
+        return extended_max_threads<rr_artec::GlobalRegistrationAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "LoopClosureAlgorithm"))
+        return extended_max_threads<rr_artec::LoopClosureAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "MeshSimplificationAlgorithm"))
+        return extended_max_threads<rr_artec::MeshSimplificationAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "OutliersRemovalAlgorithm"))
+        return extended_max_threads<rr_artec::OutliersRemovalAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "PoissonFusionAlgorithm"))
+        return extended_max_threads<rr_artec::PoissonFusionAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SerialRegistrationAlgorithm"))
+        return extended_max_threads<rr_artec::SerialRegistrationAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm"))
+        return extended_max_threads<rr_artec::SmallObjectsFilterAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "TexturizationAlgorithm"))
+        return extended_max_threads<rr_artec::TexturizationAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "CropAlgorithm"))
+        return extended_max_threads<rr_artec::CropAlgorithm>(settings);
+    if (alg_rr_type == (RR_ARTEC_PREFIX "FrameDecimationAlgorithm"))
+        return extended_max_threads<rr_artec::FrameDecimationAlgorithm>(settings);
+    return 0;
+}
+
 RobotRaconteur::RRValuePtr util_initialize_algorithm(boost::shared_ptr<RRArtecModel> model, const std::string& algorithm)
 {
     if (model->model->getSize() <= 0)
@@ -195,7 +485,11 @@ RobotRaconteur::RRValuePtr util_initialize_algorithm(boost::shared_ptr<RRArtecMo
     }
 
     auto scanner_type = model->model->getElement(0)->getScannerType();
+    return util_initialize_algorithm(algorithm, scanner_type);
+}
 
+RobotRaconteur::RRValuePtr util_initialize_algorithm(const std::string& algorithm, asdk::ScannerType scanner_type)
+{
     if (algorithm == "AutoAlignAlgorithm" || algorithm == RR_ARTEC_PREFIX "AutoAlignAlgorithm" )
     {
         return rr_artec::AutoAlignAlgorithmPtr(new rr_artec::AutoAlignAlgorithm());
@@ -316,8 +610,62 @@ RobotRaconteur::RRValuePtr util_initialize_algorithm(boost::shared_ptr<RRArtecMo
         return rr;
     }
 
+    if (algorithm == "CropAlgorithm" || algorithm == RR_ARTEC_PREFIX "CropAlgorithm" )
+    {
+        return util_new_algorithm_settings(algorithm);
+    }
+
+    if (algorithm == "FrameDecimationAlgorithm" || algorithm == RR_ARTEC_PREFIX "FrameDecimationAlgorithm" )
+    {
+        auto rr = rr_artec::FrameDecimationAlgorithmPtr(new rr_artec::FrameDecimationAlgorithm());
+        rr->min_translation = 0.005;
+        rr->min_rotation = 0.05;
+        rr->max_frame_count = 0;
+        return rr;
+    }
+
     RR_ARTEC_LOG_ERROR("Invalid algorithm requested: " << algorithm);
     throw RR::InvalidArgumentException("Invalid algorithm requested");
 }
 
+RobotRaconteur::RRValuePtr util_new_algorithm_settings(const std::string& algorithm)
+{
+    std::string a = algorithm;
+    if (boost::starts_with(a, RR_ARTEC_PREFIX))
+    {
+        a = a.substr(sizeof(RR_ARTEC_PREFIX) - 1);
+    }
+    if (a == "AutoAlignAlgorithm") return rr_artec::AutoAlignAlgorithmPtr(new rr_artec::AutoAlignAlgorithm());
+    if (a == "FastFusionAlgorithm") return rr_artec::FastFusionAlgorithmPtr(new rr_artec::FastFusionAlgorithm());
+    if (a == "FastMeshSimplificationAlgorithm") 
+        return rr_artec::FastMeshSimplificationAlgorithmPtr(new rr_artec::FastMeshSimplificationAlgorithm());
+    if (a == "GlobalRegistrationAlgorithm") 
+        return rr_artec::GlobalRegistrationAlgorithmPtr(new rr_artec::GlobalRegistrationAlgorithm());
+    if (a == "LoopClosureAlgorithm") return rr_artec::LoopClosureAlgorithmPtr(new rr_artec::LoopClosureAlgorithm());
+    if (a == "MeshSimplificationAlgorithm") 
+        return rr_artec::MeshSimplificationAlgorithmPtr(new rr_artec::MeshSimplificationAlgorithm());
+    if (a == "OutliersRemovalAlgorithm") 
+        return rr_artec::OutliersRemovalAlgorithmPtr(new rr_artec::OutliersRemovalAlgorithm());
+    if (a == "PoissonFusionAlgorithm") 
+        return rr_artec::PoissonFusionAlgorithmPtr(new rr_artec::PoissonFusionAlgorithm());
+    if (a == "SerialRegistrationAlgorithm") 
+        return rr_artec::SerialRegistrationAlgorithmPtr(new rr_artec::SerialRegistrationAlgorithm());
+    if (a == "SmallObjectsFilterAlgorithm") 
+        return rr_artec::SmallObjectsFilterAlgorithmPtr(new rr_artec::SmallObjectsFilterAlgorithm());
+    if (a == "TexturizationAlgorithm") 
+        return rr_artec::TexturizationAlgorithmPtr(new rr_artec::TexturizationAlgorithm());
+    if (a == "CropAlgorithm")
+    {
+        // Identity box pose and no region. The region must be set before the algorithm is run.
+        auto rr = rr_artec::CropAlgorithmPtr(new rr_artec::CropAlgorithm());
+        rr->box_transform.s.rotation.s.w = 1.0;
+        rr->hull_normals = RR::AllocateEmptyRRNamedArray<rr_geom::Vector3>(0);
+        rr->hull_offsets = RR::AllocateEmptyRRArray<double>(0);
+        return rr;
+    }
+    if (a == "FrameDecimationAlgorithm") 
+        return rr_artec::FrameDecimationAlgorithmPtr(new rr_artec::FrameDecimationAlgorithm());
+    return nullptr;
+}
+
 }
\ No newline at end of file
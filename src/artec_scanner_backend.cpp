@@ -0,0 +1,135 @@
+#include "artec_scanner_backend.h"
+
+#include <artec/sdk/capturing/IScanner.h>
+#include <artec/sdk/capturing/IFrameProcessor.h>
+#include <artec/sdk/capturing/IFrame.h>
+#include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/IImage.h>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    ScannerFrameProcessorPool::ScannerFrameProcessorPool(ScannerBackendPtr backend)
+    {
+        this->backend = backend;
+    }
+
+    void ScannerFrameProcessorPool::Prepare(size_t count)
+    {
+        while (true)
+        {
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                if (idle.size() >= count)
+                {
+                    return;
+                }
+            }
+            auto processor = backend->create_frame_processor();
+            boost::mutex::scoped_lock lock(this_lock);
+            idle.push_back(processor);
+        }
+    }
+
+    ScannerFrameProcessorPtr ScannerFrameProcessorPool::Acquire()
+    {
+        ScannerFrameProcessorPtr processor;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (!idle.empty())
+            {
+                processor = idle.back();
+                idle.pop_back();
+            }
+        }
+        if (!processor)
+        {
+            processor = backend->create_frame_processor();
+        }
+
+        RR_WEAK_PTR<ScannerFrameProcessorPool> weak_this = shared_from_this();
+        return ScannerFrameProcessorPtr(processor.get(), [weak_this, processor](ScannerFrameProcessor*)
+        {
+            auto t = weak_this.lock();
+            if (!t) return;
+            t->Release(processor);
+        });
+    }
+
+    void ScannerFrameProcessorPool::Release(const ScannerFrameProcessorPtr& processor)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        idle.push_back(processor);
+    }
+
+    ArtecSdkFrameProcessor::ArtecSdkFrameProcessor(asdk::IScanner* scanner)
+    {
+        RR_CALL_ARTEC(scanner->createFrameProcessor(&processor), "error creating frame processor");
+    }
+
+    void ArtecSdkFrameProcessor::reconstruct(const ScannerFramePtr& frame, asdk::IFrameMesh** mesh)
+    {
+        auto sdk_frame = RR_DYNAMIC_POINTER_CAST<ArtecSdkScannerFrame>(frame);
+        if (!sdk_frame)
+        {
+            RR_ARTEC_LOG_ERROR("Frame was not captured by an Artec SDK scanner");
+            throw RR::InvalidArgumentException("Frame was not captured by an Artec SDK scanner");
+        }
+        *mesh = nullptr;
+        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( mesh, sdk_frame->frame ), "Error reconstructing mesh");
+    }
+
+    ArtecSdkScannerBackend::ArtecSdkScannerBackend(asdk::IScanner* scanner, const std::string& serial)
+    {
+        this->scanner = scanner;
+        this->serial = serial;
+    }
+
+    std::string ArtecSdkScannerBackend::get_serial()
+    {
+        return serial;
+    }
+
+    size_t ArtecSdkScannerFrame::estimate_bytes()
+    {
+        if (!frame)
+        {
+            return 0;
+        }
+        size_t bytes = 0;
+        if (asdk::IImage* depth = frame->getDepth())
+        {
+            bytes += static_cast<size_t>(depth->getPitch()) * depth->getHeight();
+        }
+        if (asdk::IImage* texture = frame->getTexture())
+        {
+            bytes += static_cast<size_t>(texture->getPitch()) * texture->getHeight();
+        }
+        return bytes;
+    }
+
+    ScannerFramePtr ArtecSdkScannerBackend::capture(bool with_texture)
+    {
+        auto frame = boost::make_shared<ArtecSdkScannerFrame>();
+        frame->frame = nullptr;
+        RR_CALL_ARTEC(scanner->capture( &frame->frame, with_texture), "Error capturing from scanner");
+        return frame;
+    }
+
+    ScannerFrameProcessorPtr ArtecSdkScannerBackend::create_frame_processor()
+    {
+        return boost::make_shared<ArtecSdkFrameProcessor>(scanner);
+    }
+
+    asdk::IScanner* ArtecSdkScannerBackend::get_scanner()
+    {
+        return scanner;
+    }
+}
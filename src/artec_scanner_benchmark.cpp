@@ -0,0 +1,376 @@
+#include "artec_scanner_benchmark.h"
+#include "artec_scanner_algorithm_util.h"
+#include "artec_scanner_impl.h"
+
+#include <artec/sdk/algorithms/Algorithms.h>
+#include <artec/sdk/base/IScan.h>
+
+#include <algorithm>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::algorithms;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+namespace rr_action = com::robotraconteur::action;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Period of the resident memory samples taken while a stage runs
+    static const int32_t resident_sample_period_ms = 50;
+
+    void BenchmarkProgressObserver::report(int current, int total)
+    {
+        AlgorithmProgressObserver::report(current, total);
+        sample();
+    }
+
+    void BenchmarkProgressObserver::sample()
+    {
+        uint64_t bytes = GetResidentBytes();
+        uint64_t prev = peak_resident_bytes.load(boost::memory_order_relaxed);
+        while (bytes > prev && !peak_resident_bytes.compare_exchange_weak(prev, bytes, boost::memory_order_relaxed)) {}
+    }
+
+    boost::shared_ptr<ArtecScannerImpl> BenchmarkAlgorithms::GetParent()
+    {
+        auto p = parent.lock();
+        if (!p) {
+            RR_ARTEC_LOG_ERROR("ArtecScannerImpl parent has been released");
+            throw RR::InvalidOperationException("ArtecScannerImpl parent has been released");
+        }
+        return p;
+    }
+
+    BenchmarkAlgorithms::BenchmarkAlgorithms(boost::shared_ptr<ArtecScannerImpl> parent)
+        : QueuedJobGenerator("benchmark_algorithms", "Benchmark Algorithms", false)
+    {
+        this->parent = parent;
+        // Process CPU time and resident memory include every running job, so nothing else is admitted while
+        // the benchmark runs
+        this->exclusive_job = true;
+    }
+
+    void BenchmarkAlgorithms::Init(boost::shared_ptr<RRArtecModel> input_model,
+        const RR::RRListPtr<rr_artec::BenchmarkVariant>& variants)
+    {
+        RR_NULL_CHECK(variants);
+        if (input_model->model->getSize() <= 0)
+        {
+            RR_ARTEC_LOG_ERROR("Model passed to benchmark_algorithms does not contain any scans")
+            throw RR::InvalidArgumentException("Model passed to benchmark_algorithms does not contain any scans");
+        }
+        auto scanner_type = input_model->model->getElement(0)->getScannerType();
+
+        std::vector<BenchmarkVariantStages> new_variants;
+        uint32_t new_total_stages = 0;
+        for (auto& variant : *variants)
+        {
+            RR_NULL_CHECK(variant);
+            RR_NULL_CHECK(variant->algorithms);
+            BenchmarkVariantStages stages;
+            stages.name = variant->name.empty() ? boost::lexical_cast<std::string>(new_variants.size())
+                : variant->name;
+            if (variant->algorithms->empty())
+            {
+                RR_ARTEC_LOG_ERROR("Benchmark variant " << stages.name << " does not contain any algorithms");
+                throw RR::InvalidArgumentException("Benchmark variant " + stages.name
+                    + " does not contain any algorithms");
+            }
+            for (auto& alg : *variant->algorithms)
+            {
+                TRef<asdk::IAlgorithm> algorithm;
+                create_algorithm(&algorithm, alg, scanner_type);
+                stages.algorithms.push_back(algorithm);
+                stages.algorithm_names.push_back(alg->RRType());
+                stages.max_threads.push_back(algorithm_max_threads(alg));
+            }
+            new_total_stages += static_cast<uint32_t>(stages.algorithms.size());
+            new_variants.push_back(stages);
+        }
+
+        if (new_variants.empty())
+        {
+            RR_ARTEC_LOG_ERROR("No variants specified to benchmark_algorithms");
+            throw RR::InvalidArgumentException("No variants specified");
+        }
+
+        this->input_model = input_model;
+        this->variants.swap(new_variants);
+        this->total_stages = new_total_stages;
+        this->results = RR::AllocateEmptyRRList<rr_artec::BenchmarkStageResult>();
+        auto parent = GetParent();
+        this->cpu_budget = parent->cpu_budget;
+        this->job_manager = parent->job_manager;
+    }
+
+    void BenchmarkAlgorithms::start_job()
+    {
+        started = true;
+        try
+        {
+            RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
+        }
+        catch (std::exception&)
+        {
+            completed = true;
+            job_ticket.reset();
+            throw;
+        }
+        RR_ARTEC_LOG_INFO("Started benchmark algorithms job " << job_id << " with " << variants.size()
+            << " variants")
+        launch_next_stage();
+    }
+
+    bool BenchmarkAlgorithms::job_complete()
+    {
+        return benchmark_complete;
+    }
+
+    bool BenchmarkAlgorithms::status_updated()
+    {
+        return last_result_update != results->size();
+    }
+
+    void BenchmarkAlgorithms::stop_job(bool abort)
+    {
+        if (ct_source)
+        {
+            this->ct_source->cancel();
+        }
+    }
+
+    void BenchmarkAlgorithms::launch_next_stage()
+    {
+        while (current_variant < variants.size())
+        {
+            auto& variant = variants.at(current_variant);
+            if (current_stage >= variant.algorithms.size())
+            {
+                // Discard the output of the last stage of the variant
+                current_variant++;
+                current_stage = 0;
+                stage_input.reset();
+                continue;
+            }
+
+            auto in = current_stage == 0 ? input_model : stage_input;
+            stage_output = RR_MAKE_SHARED<RRArtecModel>();
+            workset.in = in->model;
+            workset.out = stage_output->model;
+            workset.cancellation = ct_source->getToken();
+            progress = boost::make_shared<BenchmarkProgressObserver>();
+            progress->sample();
+            workset.progress = progress.get();
+            cpu_lease = cpu_budget->Acquire(variant.max_threads.at(current_stage));
+            workset.threadsCount = cpu_lease->get_threads();
+            stage_start_time = std::chrono::steady_clock::now();
+            stage_start_cpu_time = GetProcessCpuSeconds();
+
+            auto job_observer = new BenchmarkAlgorithmsJobObserver(shared_from_this());
+            auto res = asdk::launchJob(variant.algorithms.at(current_stage), &workset, job_observer);
+            if (res != asdk::ErrorCode_OK)
+            {
+                RR_ARTEC_LOG_ERROR(ArtecErrorCodeLogMessage(res) << "Error launching benchmark variant "
+                    << variant.name << " algorithm " << current_stage << ": "
+                    << variant.algorithm_names.at(current_stage));
+                cpu_lease.reset();
+                std::string msg;
+                std::string suberr;
+                ArtecErrorCodeMessage(res, msg, suberr);
+                add_stage_result(false, "Error launching algorithm: " + msg, 0, 0, 0);
+                continue;
+            }
+            RR_ARTEC_LOG_INFO("Launched benchmark variant " << variant.name << " algorithm " << current_stage << ": "
+                << variant.algorithm_names.at(current_stage) << " with " << workset.threadsCount << " threads");
+
+            // Algorithms report progress irregularly, so resident memory is also sampled periodically
+            auto stage_progress = progress;
+            sample_timer = RR::RobotRaconteurNode::s()->CreateTimer(
+                boost::posix_time::milliseconds(resident_sample_period_ms),
+                [stage_progress](const RR::TimerEvent& evt) {
+                    stage_progress->sample();
+            }, false);
+            sample_timer->Start();
+            return;
+        }
+
+        benchmark_complete = true;
+        // Free the job slot for queued jobs
+        job_ticket.reset();
+    }
+
+    void BenchmarkAlgorithms::add_stage_result(bool success, const std::string& error, uint64_t output_model_bytes,
+        uint64_t vertex_count, uint64_t triangle_count)
+    {
+        auto& variant = variants.at(current_variant);
+        progress->sample();
+
+        auto r = rr_artec::BenchmarkStageResultPtr(new rr_artec::BenchmarkStageResult());
+        r->variant = current_variant;
+        r->variant_name = variant.name;
+        r->stage = current_stage;
+        r->algorithm = variant.algorithm_names.at(current_stage);
+        r->success.value = success ? 1 : 0;
+        r->error = error;
+        r->wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - stage_start_time).count();
+        r->cpu_time = std::max(0.0, GetProcessCpuSeconds() - stage_start_cpu_time);
+        r->peak_resident_bytes = progress->peak_resident_bytes.load(boost::memory_order_relaxed);
+        r->output_model_bytes = output_model_bytes;
+        r->vertex_count = vertex_count;
+        r->triangle_count = triangle_count;
+        results->push_back(r);
+        completed_stages++;
+
+        if (success)
+        {
+            // The previous input is released here, so only the latest output of the variant is held
+            stage_input = stage_output;
+            current_stage++;
+        }
+        else
+        {
+            // Skip the rest of the variant
+            completed_stages += static_cast<uint32_t>(variant.algorithms.size()) - current_stage - 1;
+            current_variant++;
+            current_stage = 0;
+            stage_input.reset();
+        }
+        stage_output.reset();
+        progress.reset();
+    }
+
+    void BenchmarkAlgorithms::stage_job_complete(artec::sdk::base::ErrorCode result)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        cpu_lease.reset();
+        if (sample_timer)
+        {
+            try
+            {
+                sample_timer->Stop();
+            }
+            catch (std::exception&) {}
+            sample_timer.reset();
+        }
+        if (result == asdk::ErrorCode_OK)
+        {
+            uint64_t vertex_count = 0;
+            uint64_t triangle_count = 0;
+            CountModelGeometry(stage_output->model, vertex_count, triangle_count);
+            auto output_model_bytes = EstimateModelBytes(stage_output->model);
+            add_stage_result(true, "", output_model_bytes, vertex_count, triangle_count);
+        }
+        else
+        {
+            std::string msg;
+            std::string suberr;
+            ArtecErrorCodeMessage(result, msg, suberr);
+            RR_ARTEC_LOG_ERROR(ArtecErrorCodeLogMessage(result) << "Benchmark variant "
+                << variants.at(current_variant).name << " algorithm " << current_stage << " failed");
+            add_stage_result(false, msg, 0, 0, 0);
+        }
+        RR_ARTEC_LOG_INFO("Benchmark stage complete: " << (int32_t)result);
+
+        if (closed || aborted)
+        {
+            benchmark_complete = true;
+            stage_input.reset();
+            job_ticket.reset();
+        }
+        else
+        {
+            launch_next_stage();
+        }
+
+        auto h = next_handler;
+        next_handler.clear();
+        if (!h)
+        {
+            return;
+        }
+        try
+        {
+            next_timer->Stop();
+        }
+        catch (std::exception&) {}
+
+        if (benchmark_complete)
+        {
+            complete_gen(h);
+            return;
+        }
+        auto ret = running_status();
+        lock.unlock();
+        h(ret, nullptr);
+    }
+
+    rr_artec::BenchmarkAlgorithmsStatusPtr BenchmarkAlgorithms::running_status()
+    {
+        auto ret = rr_artec::BenchmarkAlgorithmsStatusPtr(new rr_artec::BenchmarkAlgorithmsStatus());
+        ret->action_status = started ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::queued;
+        ret->current_variant = current_variant;
+        ret->current_stage = current_stage;
+        double stage_fraction = 0.0;
+        if (progress)
+        {
+            int32_t total = progress->total.load(boost::memory_order_relaxed);
+            int32_t current = progress->current.load(boost::memory_order_relaxed);
+            if (total > 0)
+            {
+                stage_fraction = std::min(1.0, std::max(0.0, static_cast<double>(current) / total));
+            }
+        }
+        ret->progress = (completed_stages + stage_fraction) / total_stages;
+        // Copy so the list is not modified while the status is being sent
+        ret->results = RR::AllocateEmptyRRList<rr_artec::BenchmarkStageResult>();
+        for (auto& r : *results)
+        {
+            ret->results->push_back(r);
+        }
+        ret->job_id = job_id;
+        ret->queue_position = started ? 0 : job_manager->GetQueuePosition(job_id);
+        last_result_update = results->size();
+        return ret;
+    }
+
+    void BenchmarkAlgorithms::complete_gen(boost::function<void(const rr_artec::BenchmarkAlgorithmsStatusPtr&,
+        const RR::RobotRaconteurExceptionPtr&)> handler)
+    {
+        RR_ARTEC_LOG_INFO("Benchmark Algorithms execution complete");
+
+        completed = true;
+
+        if (aborted)
+        {
+            handler(nullptr, RR_MAKE_SHARED<RR::OperationAbortedException>(aborted_message()));
+            return;
+        }
+
+        auto ret = running_status();
+        ret->action_status = rr_action::ActionStatusCode::complete;
+        for (auto& r : *results)
+        {
+            RR_ARTEC_LOG_INFO("Benchmark " << r->variant_name << " stage " << r->stage << " " << r->algorithm
+                << ": success: " << (r->success.value != 0) << " wall: " << r->wall_time << " s cpu: " << r->cpu_time
+                << " s peak resident bytes: " << r->peak_resident_bytes << " triangles: " << r->triangle_count);
+        }
+        handler(ret,nullptr);
+    }
+
+    BenchmarkAlgorithmsJobObserver::BenchmarkAlgorithmsJobObserver(boost::shared_ptr<BenchmarkAlgorithms> parent)
+    {
+        this->parent = parent;
+    }
+
+    void BenchmarkAlgorithmsJobObserver::completed(artec::sdk::base::ErrorCode result)
+    {
+        auto p = parent;
+        parent.reset();
+        if (!p) return;
+        p->stage_job_complete(result);
+    }
+}
@@ -0,0 +1,336 @@
+#include "artec_scanner_checkpoint.h"
+#include "artec_scanner_impl.h"
+#include "artec_scanner_project.h"
+
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/base/AlgorithmWorkset.h>
+#include <artec/sdk/algorithms/Algorithms.h>
+
+#include <yaml-cpp/yaml.h>
+#include <boost/regex.hpp>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::algorithms;
+};
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Written after the project is saved, so a checkpoint directory without it was interrupted
+    static const char* checkpoint_info_file = "checkpoint.yaml";
+
+    boost::filesystem::path CheckpointDir(const boost::optional<boost::filesystem::path>& save_path)
+    {
+        if (!save_path)
+        {
+            RR_ARTEC_LOG_ERROR("Project save path not specified")
+            throw RR::InvalidOperationException("Project save path not specified");
+        }
+        return *save_path / "checkpoints";
+    }
+
+    static rr_artec::CheckpointInfoPtr read_checkpoint_info(const boost::filesystem::path& dir)
+    {
+        YAML::Node node = YAML::LoadFile((dir / checkpoint_info_file).string());
+        auto ret = rr_artec::CheckpointInfoPtr(new rr_artec::CheckpointInfo());
+        ret->checkpoint_name = dir.filename().string();
+        ret->source = node["source"].as<std::string>();
+        ret->model_handle = node["model_handle"].as<int32_t>();
+        ret->scan_count = node["scan_count"].as<uint32_t>();
+        ret->created_time = node["created_time"].as<double>();
+        ret->bytes = DirectorySize(dir);
+        return ret;
+    }
+
+    RR::RRListPtr<rr_artec::CheckpointInfo> ListCheckpoints(const boost::filesystem::path& checkpoint_dir)
+    {
+        std::vector<rr_artec::CheckpointInfoPtr> checkpoints;
+        boost::system::error_code ec;
+        for (boost::filesystem::directory_iterator it(checkpoint_dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (!boost::filesystem::is_regular_file(it->path() / checkpoint_info_file))
+            {
+                continue;
+            }
+            try
+            {
+                checkpoints.push_back(read_checkpoint_info(it->path()));
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_ERROR("Could not read checkpoint " << it->path() << ": " << e.what());
+            }
+        }
+        std::sort(checkpoints.begin(), checkpoints.end(),
+            [](const rr_artec::CheckpointInfoPtr& a, const rr_artec::CheckpointInfoPtr& b)
+            { return a->created_time < b->created_time; });
+
+        auto ret = RR::AllocateEmptyRRList<rr_artec::CheckpointInfo>();
+        for (auto& c : checkpoints)
+        {
+            ret->push_back(c);
+        }
+        return ret;
+    }
+
+    bool IsCompleteCheckpoint(const boost::filesystem::path& checkpoint_dir, const std::string& checkpoint_name)
+    {
+        auto dir = ProjectFilePath(checkpoint_dir, checkpoint_name).parent_path();
+        return boost::filesystem::is_regular_file(dir / checkpoint_info_file);
+    }
+
+    void DeleteCheckpoint(const boost::filesystem::path& checkpoint_dir, const std::string& checkpoint_name)
+    {
+        auto dir = ProjectFilePath(checkpoint_dir, checkpoint_name).parent_path();
+        if (!boost::filesystem::is_directory(dir))
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to delete invalid checkpoint: " << checkpoint_name);
+            throw RR::InvalidArgumentException("Invalid checkpoint name");
+        }
+        boost::filesystem::remove_all(dir);
+        RR_ARTEC_LOG_INFO("Deleted checkpoint " << checkpoint_name);
+    }
+
+    // Lowest CPU priority, and idle I/O priority where the platform supports it, for the calling thread
+    static void set_background_thread_priority()
+    {
+#ifdef _WIN32
+        // Background mode also lowers the I/O and memory priority of the thread
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#else
+        pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+        // IOPRIO_WHO_PROCESS with IOPRIO_CLASS_IDLE
+        syscall(SYS_ioprio_set, 1, tid, 3 << 13);
+#endif
+#endif
+    }
+
+    ModelCheckpointer::ModelCheckpointer(const boost::filesystem::path& checkpoint_dir, double bandwidth,
+        uint32_t max_checkpoints, boost::function<bool()> capture_active)
+        : checkpoint_dir(checkpoint_dir), bandwidth(bandwidth), max_checkpoints(max_checkpoints),
+        capture_active(capture_active)
+    {
+    }
+
+    void ModelCheckpointer::Start()
+    {
+        boost::filesystem::create_directories(checkpoint_dir);
+
+        boost::system::error_code ec;
+        for (boost::filesystem::directory_iterator it(checkpoint_dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (boost::filesystem::is_directory(it->path())
+                && !boost::filesystem::exists(it->path() / checkpoint_info_file))
+            {
+                boost::system::error_code ec2;
+                boost::filesystem::remove_all(it->path(), ec2);
+                RR_ARTEC_LOG_INFO("Removed interrupted checkpoint " << it->path());
+            }
+        }
+
+        thread = boost::thread(boost::bind(&ModelCheckpointer::thread_func, this));
+        RR_ARTEC_LOG_INFO("Autosave checkpoints enabled in " << checkpoint_dir);
+    }
+
+    ModelCheckpointer::~ModelCheckpointer()
+    {
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            stopping = true;
+            if (!queue.empty())
+            {
+                RR_ARTEC_LOG_WARNING("Dropping " << queue.size() << " pending checkpoints on shutdown");
+            }
+            queue.clear();
+        }
+        cv.notify_all();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void ModelCheckpointer::Enqueue(boost::shared_ptr<RRArtecModel> model, int32_t model_handle,
+        const std::string& source)
+    {
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (stopping)
+            {
+                return;
+            }
+            Request r;
+            r.model = model;
+            r.model_handle = model_handle;
+            r.source = source;
+            queue.push_back(r);
+            while (queue.size() > max_pending)
+            {
+                RR_ARTEC_LOG_WARNING("Checkpoint queue full, dropping checkpoint of model "
+                    << queue.front().model_handle);
+                queue.pop_front();
+            }
+        }
+        cv.notify_all();
+    }
+
+    void ModelCheckpointer::thread_func()
+    {
+        set_background_thread_priority();
+
+        while (true)
+        {
+            Request request;
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                while (!stopping && queue.empty())
+                {
+                    cv.wait(lock);
+                }
+                // Defer while scanning or capturing, rechecking periodically. capture_active locks the driver, so
+                // it is called without this_lock held.
+                while (!stopping && capture_active)
+                {
+                    lock.unlock();
+                    bool active = capture_active();
+                    lock.lock();
+                    if (!active || stopping)
+                    {
+                        break;
+                    }
+                    cv.timed_wait(lock, boost::posix_time::seconds(1));
+                }
+                if (stopping)
+                {
+                    return;
+                }
+                if (queue.empty())
+                {
+                    continue;
+                }
+                request = queue.front();
+                queue.pop_front();
+            }
+
+            auto start_time = std::chrono::steady_clock::now();
+            uint64_t bytes = 0;
+            try
+            {
+                bytes = save_checkpoint(request);
+                remove_old_checkpoints();
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_ERROR("Checkpoint of model " << request.model_handle << " failed: " << e.what());
+            }
+            request.model.reset();
+
+            if (bandwidth > 0.0)
+            {
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                double wait = static_cast<double>(bytes) / bandwidth - elapsed;
+                if (wait > 0.0)
+                {
+                    auto deadline = boost::get_system_time()
+                        + boost::posix_time::milliseconds(static_cast<int64_t>(wait * 1000.0));
+                    boost::mutex::scoped_lock lock(this_lock);
+                    while (!stopping && cv.timed_wait(lock, deadline)) {}
+                }
+            }
+        }
+    }
+
+    uint64_t ModelCheckpointer::save_checkpoint(const Request& request)
+    {
+        auto now = std::chrono::system_clock::now();
+        std::time_t now_t = std::chrono::system_clock::to_time_t(now);
+        std::tm now_tm;
+#ifdef _WIN32
+        gmtime_s(&now_tm, &now_t);
+#else
+        gmtime_r(&now_t, &now_tm);
+#endif
+        std::stringstream name_ss;
+        name_ss << "checkpoint_" << std::put_time(&now_tm, "%Y%m%d_%H%M%S") << "_" << request.model_handle;
+        std::string checkpoint_name = name_ss.str();
+
+        auto job = PrepareModelSave(checkpoint_dir, checkpoint_name, request.model, request.model_handle);
+        try
+        {
+            asdk::AlgorithmWorkset save_workset = {request.model->model, nullptr, nullptr, 0};
+            RR_CALL_ARTEC(asdk::executeJob(job->job, &save_workset), "Error saving checkpoint");
+
+            YAML::Emitter out;
+            out << YAML::BeginMap;
+            out << YAML::Key << "source" << YAML::Value << request.source;
+            out << YAML::Key << "model_handle" << YAML::Value << request.model_handle;
+            out << YAML::Key << "scan_count" << YAML::Value << request.model->model->getSize();
+            out << YAML::Key << "created_time" << YAML::Value
+                << std::chrono::duration<double>(now.time_since_epoch()).count();
+            out << YAML::EndMap;
+
+            auto info_tmp = job->project_dir / (std::string(checkpoint_info_file) + ".tmp");
+            {
+                std::ofstream f(info_tmp.string());
+                f << out.c_str();
+                if (!f)
+                {
+                    throw RR::OperationFailedException("Could not write checkpoint info");
+                }
+            }
+            boost::filesystem::rename(info_tmp, job->project_dir / checkpoint_info_file);
+        }
+        catch (std::exception&)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(job->project_dir, ec);
+            throw;
+        }
+        uint64_t bytes = DirectorySize(job->project_dir);
+        RR_ARTEC_LOG_INFO("Saved checkpoint " << checkpoint_name << " of model " << request.model_handle
+            << " from " << request.source << " (" << bytes << " bytes)");
+        return bytes;
+    }
+
+    void ModelCheckpointer::remove_old_checkpoints()
+    {
+        if (max_checkpoints == 0)
+        {
+            return;
+        }
+        auto checkpoints = ListCheckpoints(checkpoint_dir);
+        size_t count = checkpoints->size();
+        for (auto& c : *checkpoints)
+        {
+            if (count <= max_checkpoints)
+            {
+                break;
+            }
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(checkpoint_dir / c->checkpoint_name, ec);
+            RR_ARTEC_LOG_INFO("Removed old checkpoint " << c->checkpoint_name);
+            count--;
+        }
+    }
+}
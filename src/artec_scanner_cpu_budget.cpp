@@ -0,0 +1,101 @@
+#include "artec_scanner_cpu_budget.h"
+
+#include <boost/thread.hpp>
+#include <algorithm>
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    const uint32_t CpuBudget::realtime_threads;
+
+    CpuBudgetLease::CpuBudgetLease(boost::shared_ptr<CpuBudget> budget, uint32_t threads, bool reserved)
+    {
+        this->budget = budget;
+        this->threads = threads;
+        this->reserved = reserved;
+    }
+
+    CpuBudgetLease::~CpuBudgetLease()
+    {
+        auto b = budget.lock();
+        if (!b) return;
+        b->Release(threads, reserved);
+    }
+
+    CpuBudget::CpuBudget(uint32_t total_threads)
+    {
+        SetTotalThreads(total_threads);
+    }
+
+    CpuBudgetLeasePtr CpuBudget::Acquire(uint32_t max_threads)
+    {
+        uint32_t threads;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            uint32_t shared_threads = total_threads > reserved_threads ? total_threads - reserved_threads : 1;
+            uint32_t fair_share = shared_threads / std::max(expected_jobs, active_jobs + 1);
+            uint32_t free_threads = assigned_threads < total_threads ? total_threads - assigned_threads : 0;
+            threads = std::min(fair_share, free_threads);
+            if (max_threads > 0)
+            {
+                threads = std::min(threads, max_threads);
+            }
+            threads = std::max(threads, 1u);
+            assigned_threads += threads;
+            active_jobs++;
+        }
+        RR_ARTEC_LOG_INFO("Assigned " << threads << " of " << total_threads << " CPU threads to job");
+        return boost::make_shared<CpuBudgetLease>(shared_from_this(), threads, false);
+    }
+
+    CpuBudgetLeasePtr CpuBudget::AcquireRealtime()
+    {
+        uint32_t threads;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            // Leave at least one thread for the other jobs
+            threads = std::max(1u, std::min(realtime_threads, total_threads - 1));
+            assigned_threads += threads;
+            reserved_threads += threads;
+        }
+        RR_ARTEC_LOG_INFO("Reserved " << threads << " of " << total_threads << " CPU threads for scanning");
+        return boost::make_shared<CpuBudgetLease>(shared_from_this(), threads, true);
+    }
+
+    void CpuBudget::Release(uint32_t threads, bool reserved)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        assigned_threads -= std::min(assigned_threads, threads);
+        if (reserved)
+        {
+            reserved_threads -= std::min(reserved_threads, threads);
+        }
+        else if (active_jobs > 0)
+        {
+            active_jobs--;
+        }
+    }
+
+    uint32_t CpuBudget::GetTotalThreads()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return total_threads;
+    }
+
+    void CpuBudget::SetTotalThreads(uint32_t total_threads)
+    {
+        if (total_threads == 0)
+        {
+            total_threads = std::max(1u, boost::thread::hardware_concurrency());
+        }
+        boost::mutex::scoped_lock lock(this_lock);
+        this->total_threads = total_threads;
+    }
+
+    void CpuBudget::SetExpectedJobs(uint32_t expected_jobs)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        this->expected_jobs = std::max(1u, expected_jobs);
+    }
+}
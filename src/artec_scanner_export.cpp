@@ -0,0 +1,537 @@
+#include "artec_scanner_export.h"
+#include "artec_scanner_checkpoint.h"
+
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/base/IMesh.h>
+#include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/ICompositeMesh.h>
+#include <artec/sdk/base/ICompositeContainer.h>
+#include <artec/sdk/base/IArrayPoint3F.h>
+#include <artec/sdk/base/IArrayIndexTriplet.h>
+#include <Eigen/Dense>
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+};
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    // Vertices or triangles encoded by one worker at a time. Bounds the memory used for encoded data to about
+    // 2 * threads chunks.
+    static const int export_chunk_size = 1 << 18;
+
+    namespace
+    {
+        struct ExportMesh
+        {
+            asdk::IMesh* mesh = nullptr;
+            std::string name;
+            Eigen::Matrix4f transform;
+            bool identity = true;
+            int vertex_count = 0;
+            int triangle_count = 0;
+            uint64_t vertex_offset = 0;
+        };
+
+        struct ExportChunk
+        {
+            size_t mesh;
+            bool faces;
+            int begin;
+            int end;
+        };
+    }
+
+    static std::string export_format_extension(rr_artec::ModelExportFormat::ModelExportFormat format)
+    {
+        switch (format)
+        {
+            case rr_artec::ModelExportFormat::ply:
+                return ".ply";
+            case rr_artec::ModelExportFormat::obj:
+                return ".obj";
+            case rr_artec::ModelExportFormat::stl:
+                return ".stl";
+            default:
+                RR_ARTEC_LOG_ERROR("Invalid model export format: " << static_cast<int>(format));
+                throw RR::InvalidArgumentException("Invalid model export format");
+        }
+    }
+
+    boost::filesystem::path ExportFilePath(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& path, rr_artec::ModelExportFormat::ModelExportFormat format)
+    {
+        if (!save_path)
+        {
+            RR_ARTEC_LOG_ERROR("Project save path not specified")
+            throw RR::InvalidOperationException("Project save path not specified");
+        }
+        boost::filesystem::path rel_path(path);
+        if (path.empty() || rel_path.has_root_path() || !rel_path.has_filename())
+        {
+            RR_ARTEC_LOG_ERROR("Invalid export path specified: " << path);
+            throw RR::InvalidArgumentException("Invalid export path");
+        }
+        for (auto& p : rel_path)
+        {
+            if (p == ".." || p == ".")
+            {
+                RR_ARTEC_LOG_ERROR("Invalid export path specified: " << path);
+                throw RR::InvalidArgumentException("Invalid export path");
+            }
+        }
+        std::string ext = export_format_extension(format);
+        if (!rel_path.has_extension())
+        {
+            rel_path += ext;
+        }
+        else if (boost::algorithm::to_lower_copy(rel_path.extension().string()) != ext)
+        {
+            RR_ARTEC_LOG_ERROR("Export path extension does not match the format: " << path);
+            throw RR::InvalidArgumentException("Export path extension must be " + ext);
+        }
+
+        // Projects are saved in save_path/<project_name>, and checkpoints are projects too
+        auto first_dir = (*save_path) / *rel_path.begin();
+        if (first_dir == CheckpointDir(save_path)
+            || boost::filesystem::exists(first_dir / (rel_path.begin()->string() + ".a3d")))
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to export into a project or checkpoint directory: " << path);
+            throw RR::InvalidArgumentException("Export path must not be inside a project or checkpoint directory");
+        }
+        return (*save_path) / rel_path;
+    }
+
+    static std::vector<ExportMesh> collect_export_meshes(asdk::IModel* model)
+    {
+        std::vector<ExportMesh> ret;
+        asdk::ICompositeContainer* container = model->getCompositeContainer();
+        if (container && container->getSize() > 0)
+        {
+            Eigen::Matrix4f container_transform =
+                ConvertArtecTransformToEigen(container->getContainerTransformation()).cast<float>();
+            for (int i=0; i<container->getSize(); i++)
+            {
+                ExportMesh m;
+                m.mesh = container->getElement(i);
+                m.name = "composite_" + boost::lexical_cast<std::string>(i);
+                m.transform = container_transform
+                    * ConvertArtecTransformToEigen(container->getTransformation(i)).cast<float>();
+                ret.push_back(m);
+            }
+        }
+        else
+        {
+            for (int i=0; i<model->getSize(); i++)
+            {
+                asdk::IScan* scan = model->getElement(i);
+                Eigen::Matrix4f scan_transform =
+                    ConvertArtecTransformToEigen(scan->getScanTransformation()).cast<float>();
+                for (int j=0; j<scan->getSize(); j++)
+                {
+                    ExportMesh m;
+                    m.mesh = scan->getElement(j);
+                    m.name = "scan_" + boost::lexical_cast<std::string>(i) + "_frame_"
+                        + boost::lexical_cast<std::string>(j);
+                    m.transform = scan_transform
+                        * ConvertArtecTransformToEigen(scan->getTransformation(j)).cast<float>();
+                    ret.push_back(m);
+                }
+            }
+        }
+
+        uint64_t vertex_offset = 0;
+        for (auto& m : ret)
+        {
+            if (m.mesh)
+            {
+                asdk::IArrayPoint3F* points = m.mesh->getPoints();
+                asdk::IArrayIndexTriplet* triangles = m.mesh->getTriangles();
+                m.vertex_count = points ? points->getSize() : 0;
+                m.triangle_count = (triangles && m.vertex_count > 0) ? triangles->getSize() : 0;
+            }
+            m.identity = m.transform.isIdentity();
+            m.vertex_offset = vertex_offset;
+            vertex_offset += m.vertex_count;
+        }
+        return ret;
+    }
+
+    static inline Eigen::Vector3f export_vertex(const ExportMesh& m, const asdk::Point3F& p)
+    {
+        Eigen::Vector3f v(p.x, p.y, p.z);
+        if (!m.identity)
+        {
+            v = m.transform.block<3,3>(0,0) * v + m.transform.block<3,1>(0,3);
+        }
+        return v;
+    }
+
+    static inline void append_bytes(std::string& out, const void* data, size_t size)
+    {
+        out.append(reinterpret_cast<const char*>(data), size);
+    }
+
+    // Encoded data is little endian, matching the hosts supported by the SDK
+    static void encode_chunk(rr_artec::ModelExportFormat::ModelExportFormat format, const ExportMesh& m,
+        const ExportChunk& chunk, std::string& out)
+    {
+        const asdk::Point3F* points = m.mesh->getPoints()->getPointer();
+        asdk::IArrayIndexTriplet* triangle_array = m.mesh->getTriangles();
+        const asdk::IndexTriplet* triangles = triangle_array ? triangle_array->getPointer() : nullptr;
+        int n = chunk.end - chunk.begin;
+        out.clear();
+        char line[128];
+
+        switch (format)
+        {
+            case rr_artec::ModelExportFormat::ply:
+            {
+                if (!chunk.faces)
+                {
+                    out.reserve(static_cast<size_t>(n) * 12);
+                    for (int i=chunk.begin; i<chunk.end; i++)
+                    {
+                        Eigen::Vector3f v = export_vertex(m, points[i]);
+                        append_bytes(out, v.data(), 12);
+                    }
+                }
+                else
+                {
+                    out.reserve(static_cast<size_t>(n) * 13);
+                    int32_t offset = static_cast<int32_t>(m.vertex_offset);
+                    for (int i=chunk.begin; i<chunk.end; i++)
+                    {
+                        uint8_t count = 3;
+                        int32_t ind[3] = {offset + triangles[i].x, offset + triangles[i].y, offset + triangles[i].z};
+                        append_bytes(out, &count, 1);
+                        append_bytes(out, ind, 12);
+                    }
+                }
+                break;
+            }
+            case rr_artec::ModelExportFormat::obj:
+            {
+                if (!chunk.faces)
+                {
+                    out.reserve(static_cast<size_t>(n) * 36);
+                    if (chunk.begin == 0)
+                    {
+                        out += "o " + m.name + "\n";
+                    }
+                    for (int i=chunk.begin; i<chunk.end; i++)
+                    {
+                        Eigen::Vector3f v = export_vertex(m, points[i]);
+                        int len = std::snprintf(line, sizeof(line), "v %.7g %.7g %.7g\n", v.x(), v.y(), v.z());
+                        out.append(line, len);
+                    }
+                }
+                else
+                {
+                    out.reserve(static_cast<size_t>(n) * 24);
+                    // OBJ indices are one based
+                    uint64_t offset = m.vertex_offset + 1;
+                    for (int i=chunk.begin; i<chunk.end; i++)
+                    {
+                        int len = std::snprintf(line, sizeof(line), "f %llu %llu %llu\n",
+                            static_cast<unsigned long long>(offset + triangles[i].x),
+                            static_cast<unsigned long long>(offset + triangles[i].y),
+                            static_cast<unsigned long long>(offset + triangles[i].z));
+                        out.append(line, len);
+                    }
+                }
+                break;
+            }
+            case rr_artec::ModelExportFormat::stl:
+            {
+                out.reserve(static_cast<size_t>(n) * 50);
+                for (int i=chunk.begin; i<chunk.end; i++)
+                {
+                    Eigen::Vector3f v[3] = {export_vertex(m, points[triangles[i].x]),
+                        export_vertex(m, points[triangles[i].y]), export_vertex(m, points[triangles[i].z])};
+                    Eigen::Vector3f normal = (v[1] - v[0]).cross(v[2] - v[0]).normalized();
+                    if (!normal.allFinite())
+                    {
+                        normal.setZero();
+                    }
+                    uint16_t attr = 0;
+                    append_bytes(out, normal.data(), 12);
+                    for (int k=0; k<3; k++)
+                    {
+                        append_bytes(out, v[k].data(), 12);
+                    }
+                    append_bytes(out, &attr, 2);
+                }
+                break;
+            }
+            default:
+                throw RR::InvalidArgumentException("Invalid model export format");
+        }
+    }
+
+    static void add_export_chunks(std::vector<ExportChunk>& chunks, size_t mesh, bool faces, int count)
+    {
+        for (int begin=0; begin<count; begin+=export_chunk_size)
+        {
+            chunks.push_back(ExportChunk{mesh, faces, begin, std::min(count, begin + export_chunk_size)});
+        }
+    }
+
+    rr_artec::ModelExportResultPtr ExportModel(asdk::IModel* model,
+        rr_artec::ModelExportFormat::ModelExportFormat format, const boost::filesystem::path& file_path,
+        uint32_t threads, bool overwrite)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+        export_format_extension(format);
+        if (!overwrite && boost::filesystem::exists(file_path))
+        {
+            RR_ARTEC_LOG_ERROR("Export file already exists: " << file_path);
+            throw RR::InvalidOperationException("Export file already exists");
+        }
+
+        std::vector<ExportMesh> meshes = collect_export_meshes(model);
+        uint64_t vertex_count = 0;
+        uint64_t triangle_count = 0;
+        uint32_t mesh_count = 0;
+        for (auto& m : meshes)
+        {
+            vertex_count += m.vertex_count;
+            triangle_count += m.triangle_count;
+            if (m.triangle_count > 0)
+            {
+                mesh_count++;
+            }
+        }
+        if (mesh_count == 0)
+        {
+            RR_ARTEC_LOG_ERROR("Model has no meshes to export");
+            throw RR::InvalidOperationException("Model has no meshes to export");
+        }
+        if (format == rr_artec::ModelExportFormat::ply && vertex_count > static_cast<uint64_t>(INT32_MAX))
+        {
+            RR_ARTEC_LOG_ERROR("Model has too many vertices for PLY export: " << vertex_count);
+            throw RR::InvalidOperationException("Model has too many vertices for PLY export");
+        }
+        if (format == rr_artec::ModelExportFormat::stl && triangle_count > static_cast<uint64_t>(UINT32_MAX))
+        {
+            RR_ARTEC_LOG_ERROR("Model has too many triangles for STL export: " << triangle_count);
+            throw RR::InvalidOperationException("Model has too many triangles for STL export");
+        }
+
+        std::vector<ExportChunk> chunks;
+        std::string header;
+        switch (format)
+        {
+            case rr_artec::ModelExportFormat::ply:
+            {
+                header = "ply\nformat binary_little_endian 1.0\ncomment units mm\nelement vertex "
+                    + boost::lexical_cast<std::string>(vertex_count) + "\nproperty float x\nproperty float y\n"
+                    "property float z\nelement face " + boost::lexical_cast<std::string>(triangle_count)
+                    + "\nproperty list uchar int vertex_indices\nend_header\n";
+                // All vertices are written before all faces
+                for (size_t i=0; i<meshes.size(); i++)
+                {
+                    add_export_chunks(chunks, i, false, meshes[i].vertex_count);
+                }
+                for (size_t i=0; i<meshes.size(); i++)
+                {
+                    add_export_chunks(chunks, i, true, meshes[i].triangle_count);
+                }
+                break;
+            }
+            case rr_artec::ModelExportFormat::obj:
+            {
+                header = "# units mm\n";
+                for (size_t i=0; i<meshes.size(); i++)
+                {
+                    add_export_chunks(chunks, i, false, meshes[i].vertex_count);
+                    add_export_chunks(chunks, i, true, meshes[i].triangle_count);
+                }
+                break;
+            }
+            case rr_artec::ModelExportFormat::stl:
+            {
+                header.assign(80, '\0');
+                const char title[] = "artec_scanner_robotraconteur_driver export, units mm";
+                std::memcpy(&header[0], title, sizeof(title) - 1);
+                uint32_t stl_count = static_cast<uint32_t>(triangle_count);
+                append_bytes(header, &stl_count, 4);
+                for (size_t i=0; i<meshes.size(); i++)
+                {
+                    add_export_chunks(chunks, i, true, meshes[i].triangle_count);
+                }
+                break;
+            }
+            default:
+                throw RR::InvalidArgumentException("Invalid model export format");
+        }
+
+        boost::filesystem::create_directories(file_path.parent_path());
+        boost::filesystem::path temp_path = file_path;
+        temp_path += ".part";
+
+        uint64_t bytes_written = 0;
+        try
+        {
+            std::vector<char> file_buffer(1 << 20);
+            std::ofstream file;
+            file.rdbuf()->pubsetbuf(file_buffer.data(), file_buffer.size());
+            file.open(temp_path.string(), std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                RR_ARTEC_LOG_ERROR("Could not open export file " << temp_path);
+                throw RR::OperationFailedException("Could not open export file");
+            }
+            file.write(header.data(), header.size());
+            bytes_written += header.size();
+
+            // The encode threads run for the whole export. Each encodes the next chunk into a ring of buffers
+            // up to window chunks ahead of the chunk being written, and this thread writes the chunks in order.
+            size_t thread_count = std::min(std::max<size_t>(1, threads), std::max<size_t>(1, chunks.size()));
+            size_t window = thread_count * 2;
+            std::vector<std::string> buffers(window);
+            std::vector<char> encoded(window, 0);
+            boost::mutex encode_lock;
+            boost::condition_variable encode_cv;
+            size_t next_chunk = 0;
+            size_t write_chunk = 0;
+            bool failed = false;
+            bool stopped = false;
+
+            auto worker = [&]() {
+                while (true)
+                {
+                    size_t k;
+                    {
+                        boost::mutex::scoped_lock lock(encode_lock);
+                        while (!stopped && !failed && next_chunk < chunks.size()
+                            && next_chunk >= write_chunk + window)
+                        {
+                            encode_cv.wait(lock);
+                        }
+                        if (stopped || failed || next_chunk >= chunks.size())
+                        {
+                            return;
+                        }
+                        k = next_chunk++;
+                    }
+                    try
+                    {
+                        auto& chunk = chunks[k];
+                        encode_chunk(format, meshes[chunk.mesh], chunk, buffers[k % window]);
+                    }
+                    catch (std::exception& e)
+                    {
+                        RR_ARTEC_LOG_ERROR("Error encoding export mesh: " << e.what());
+                        boost::mutex::scoped_lock lock(encode_lock);
+                        failed = true;
+                        encode_cv.notify_all();
+                        return;
+                    }
+                    boost::mutex::scoped_lock lock(encode_lock);
+                    encoded[k % window] = 1;
+                    encode_cv.notify_all();
+                }
+            };
+
+            boost::thread_group encode_threads;
+            auto stop_encode_threads = [&]() {
+                {
+                    boost::mutex::scoped_lock lock(encode_lock);
+                    stopped = true;
+                }
+                encode_cv.notify_all();
+                encode_threads.join_all();
+            };
+
+            try
+            {
+                for (size_t i=0; i<thread_count; i++)
+                {
+                    encode_threads.create_thread(worker);
+                }
+
+                for (size_t k=0; k<chunks.size(); k++)
+                {
+                    {
+                        boost::mutex::scoped_lock lock(encode_lock);
+                        while (!failed && !encoded[k % window])
+                        {
+                            encode_cv.wait(lock);
+                        }
+                        if (failed)
+                        {
+                            break;
+                        }
+                    }
+
+                    auto& b = buffers[k % window];
+                    file.write(b.data(), b.size());
+                    bytes_written += b.size();
+                    if (!file)
+                    {
+                        RR_ARTEC_LOG_ERROR("Error writing export file " << temp_path);
+                        throw RR::OperationFailedException("Error writing export file");
+                    }
+
+                    boost::mutex::scoped_lock lock(encode_lock);
+                    encoded[k % window] = 0;
+                    write_chunk = k + 1;
+                    encode_cv.notify_all();
+                }
+            }
+            catch (...)
+            {
+                stop_encode_threads();
+                throw;
+            }
+            stop_encode_threads();
+            if (failed)
+            {
+                throw RR::OperationFailedException("Error encoding export mesh");
+            }
+
+            file.close();
+            if (!file)
+            {
+                RR_ARTEC_LOG_ERROR("Error writing export file " << temp_path);
+                throw RR::OperationFailedException("Error writing export file");
+            }
+            // Check again in case the file was created while encoding
+            if (!overwrite && boost::filesystem::exists(file_path))
+            {
+                RR_ARTEC_LOG_ERROR("Export file already exists: " << file_path);
+                throw RR::InvalidOperationException("Export file already exists");
+            }
+            boost::filesystem::rename(temp_path, file_path);
+        }
+        catch (std::exception&)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(temp_path, ec);
+            throw;
+        }
+
+        auto ret = rr_artec::ModelExportResultPtr(new rr_artec::ModelExportResult());
+        ret->format = format;
+        ret->mesh_count = mesh_count;
+        ret->vertex_count = vertex_count;
+        ret->triangle_count = triangle_count;
+        ret->bytes_written = bytes_written;
+        ret->export_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        return ret;
+    }
+}
@@ -8,6 +8,8 @@
 #include <artec/sdk/base/Log.h>
 #include <artec/sdk/base/io/ObjIO.h>
 #include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/IArrayPoint3F.h>
+#include <artec/sdk/base/IArrayIndexTriplet.h>
 #include <artec/sdk/base/TArrayRef.h>
 #include <artec/sdk/project/IProject.h>
 #include <artec/sdk/project/EntryInfo.h>
@@ -15,16 +17,30 @@
 #include <artec/sdk/project/ProjectLoaderSettings.h>
 #include <artec/sdk/project/ProjectSaverSettings.h>
 #include <artec/sdk/base/ICompositeContainer.h>
+#include <artec/sdk/algorithms/Algorithms.h>
 
 #include "artec_scanner_util.h"
 #include "artec_scanning_procedure.h"
+#include "artec_scanning_session.h"
 #include "artec_scanner_algorithm.h"
 #include "artec_scanner_algorithm_util.h"
+#include "artec_scanner_benchmark.h"
 #include "artec_scanning_deferred.h"
+#include "artec_scanner_project.h"
+#include "artec_scanner_export.h"
+#include "artec_scanner_shared_memory.h"
+#include "artec_scanner_checkpoint.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/algorithm/copy.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <set>
+#include <sstream>
 
 namespace asdk {
     using namespace artec::sdk::base;
@@ -42,14 +58,162 @@ namespace rr_artec = experimental::artec_scanner;
 
 namespace artec_scanner_robotraconteur_driver
 {
-    void ArtecScannerImpl::Init(artec::sdk::capturing::IScanner* scanner)
+    // Single triangle mesh used to initialize the mesh conversion without capturing a frame
+    static TRef<asdk::IFrameMesh> CreateWarmUpFrameMesh()
     {
-        this->scanner=scanner;
-        if (scanner)
+        TArrayRef<asdk::IArrayPoint3F> points;
+        RR_CALL_ARTEC(asdk::createArrayPoint3F(&points, 3), "Error allocating warm up points");
+        TArrayRef<asdk::IArrayIndexTriplet> triangles;
+        RR_CALL_ARTEC(asdk::createArrayIndexTriplet(&triangles, 1), "Error allocating warm up triangles");
+        points[0].x = 0.0f; points[0].y = 0.0f; points[0].z = 300.0f;
+        points[1].x = 1.0f; points[1].y = 0.0f; points[1].z = 300.0f;
+        points[2].x = 0.0f; points[2].y = 1.0f; points[2].z = 300.0f;
+        triangles[0].x = 0; triangles[0].y = 1; triangles[0].z = 2;
+
+        TRef<asdk::IFrameMesh> mesh;
+        RR_CALL_ARTEC(asdk::createFrameMesh(&mesh), "Error creating warm up frame mesh");
+        mesh->setPoints(points);
+        mesh->setTriangles(triangles);
+        return mesh;
+    }
+
+    void ArtecScannerImpl::Init(const std::vector<ArtecScannerDevicePtr>& devices)
+    {
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            auto& device = devices.at(i);
+            device->index = boost::numeric_cast<uint32_t>(i);
+            device->processor_pool = boost::make_shared<ScannerFrameProcessorPool>(device->backend);
+        }
+        this->devices = devices;
+    }
+
+    void ArtecScannerImpl::StartWarmUp()
+    {
+        RR_WEAK_PTR<ArtecScannerImpl> weak_this = shared_from_this();
+        boost::thread([weak_this]()
+        {
+            auto t = weak_this.lock();
+            if (!t) return;
+            t->WarmUp();
+        }).detach();
+    }
+
+    void ArtecScannerImpl::WarmUp()
+    {
+        RR_ARTEC_LOG_INFO("Begin scanner warm up");
+        auto t0 = std::chrono::steady_clock::now();
+        for (auto& device : devices)
+        {
+            try
+            {
+                {
+                    boost::mutex::scoped_lock lock(device->lock);
+                    device->processor = device->backend->create_frame_processor();
+                }
+                device->processor_pool->Prepare(cpu_budget->GetTotalThreads());
+
+                if (warm_up_capture)
+                {
+                    // Throwaway capture to initialize the SDK and the frame processor
+                    rr_artec::ScannerCaptureResultPtr result;
+                    capture_device(device, true, result);
+                    RR_ARTEC_LOG_INFO("Scanner " << device->index << " warm up capture took " 
+                        << (result->capture_time + result->reconstruct_time + result->convert_time) << " s");
+                }
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_ERROR("Error warming up scanner " << device->index << ": " << e.what());
+            }
+        }
+
+        try
+        {
+            auto mesh = CreateWarmUpFrameMesh();
+            ConvertArtecFrameMeshToRR(mesh);
+        }
+        catch (std::exception& e)
+        {
+            RR_ARTEC_LOG_ERROR("Error warming up mesh conversion: " << e.what());
+        }
+
+        if (!artec::sdk::algorithms::checkAlgorithmsPermission())
+        {
+            RR_ARTEC_LOG_WARNING("Artec Algorithms not available on this computer");
+        }
+
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            ready = true;
+            time_to_ready = t;
+        }
+        ready_cv.notify_all();
+        RR_ARTEC_LOG_INFO("Scanner ready after " << t << " s warm up");
+    }
+
+    void ArtecScannerImpl::set_warm_up_capture(bool enable)
+    {
+        warm_up_capture = enable;
+    }
+
+    void ArtecScannerImpl::wait_ready()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto deadline = boost::get_system_time() + boost::posix_time::seconds(120);
+        while (!ready)
         {
-            RR_CALL_ARTEC(scanner->createFrameProcessor(&processor), "error creating frame processor");      
+            if (!ready_cv.timed_wait(lock, deadline))
+            {
+                break;
+            }
         }
+        if (!ready)
+        {
+            RR_ARTEC_LOG_ERROR("Timed out waiting for scanner warm up");
+            throw RR::InvalidOperationException("Scanner is not ready");
+        }
+    }
 
+    RR::rr_bool ArtecScannerImpl::get_ready()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return RR::rr_bool(ready ? 1 : 0);
+    }
+
+    double ArtecScannerImpl::get_time_to_ready()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return time_to_ready;
+    }
+
+    ArtecScannerDevicePtr ArtecScannerImpl::get_device(uint32_t index)
+    {
+        wait_ready();
+        if (devices.empty())
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
+            throw RR::InvalidOperationException("No scanner available");
+        }
+        if (index >= devices.size())
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use invalid scanner index: " << index);
+            throw RR::InvalidArgumentException("Invalid scanner index");
+        }
+        return devices.at(index);
+    }
+
+    asdk::IScanner* ArtecScannerImpl::get_procedure_scanner(uint32_t scanner_index)
+    {
+        auto device = get_device(scanner_index);
+        asdk::IScanner* scanner = device->backend->get_scanner();
+        if (scanner == nullptr)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
+            throw RR::InvalidOperationException("No scanner available");
+        }
+        return scanner;
     }
 
     void ArtecScannerImpl::set_save_path(boost::optional<boost::filesystem::path> save_path)
@@ -69,44 +233,238 @@ namespace artec_scanner_robotraconteur_driver
         this->save_path = save_path;
     }
 
-    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::capture(RR::rr_bool with_texture)
+    void ArtecScannerImpl::set_cpu_threads(uint32_t threads)
     {
-        if (this->scanner == nullptr)
+        cpu_budget->SetTotalThreads(threads);
+        RR_ARTEC_LOG_INFO("CPU thread budget set to " << cpu_budget->GetTotalThreads() << " threads");
+    }
+
+    void ArtecScannerImpl::set_job_limits(uint32_t max_concurrent_jobs, uint32_t max_queued_jobs)
+    {
+        job_manager->set_max_concurrent_jobs(max_concurrent_jobs);
+        job_manager->set_max_queued_jobs(max_queued_jobs);
+        RR_ARTEC_LOG_INFO("Job limits set to " << max_concurrent_jobs << " concurrent and " << max_queued_jobs 
+            << " queued jobs");
+    }
+
+    void ArtecScannerImpl::set_algorithm_presets_path(const boost::filesystem::path& path)
+    {
+        algorithm_presets->Load(path);
+    }
+
+    rr_artec::JobQueuePtr ArtecScannerImpl::get_jobs()
+    {
+        return job_manager;
+    }
+
+    void ArtecScannerImpl::set_algorithm_cache_size(size_t bytes)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        algorithm_cache = boost::make_shared<AlgorithmResultCache>(bytes);
+        RR_ARTEC_LOG_INFO("Algorithm result cache size set to " << bytes << " bytes");
+    }
+
+    void ArtecScannerImpl::set_project_cache_size(size_t bytes)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        project_cache = boost::make_shared<ProjectCache>(bytes);
+        RR_ARTEC_LOG_INFO("Project cache size set to " << bytes << " bytes");
+    }
+
+    void ArtecScannerImpl::set_autosave(double bandwidth, uint32_t max_checkpoints)
+    {
+        auto checkpoint_dir = CheckpointDir(save_path);
+        auto new_checkpointer = boost::make_shared<ModelCheckpointer>(checkpoint_dir, bandwidth, max_checkpoints,
+            boost::bind(&ArtecScannerImpl::capture_active, this));
+        new_checkpointer->Start();
+        boost::mutex::scoped_lock lock(this_lock);
+        checkpointer = new_checkpointer;
+        RR_ARTEC_LOG_INFO("Autosave enabled with bandwidth limit " << bandwidth << " bytes/s and " << max_checkpoints
+            << " checkpoints kept");
+    }
+
+    void ArtecScannerImpl::autosave_model(int32_t model_handle, const RRArtecModelPtr& model,
+        const std::string& source)
+    {
+        boost::shared_ptr<ModelCheckpointer> c;
         {
-            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
-            throw RR::InvalidOperationException("No scanner available");
+            boost::mutex::scoped_lock lock(this_lock);
+            c = checkpointer;
+        }
+        if (c)
+        {
+            c->Enqueue(model, model_handle, source);
+        }
+    }
+
+    bool ArtecScannerImpl::capture_active()
+    {
+        boost::shared_ptr<ScanningProcedure> proc;
+        std::vector<boost::shared_ptr<ScanningSession> > sessions;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            proc = active_scanning_procedure.lock();
+            boost::copy(scanning_sessions | boost::adaptors::map_values, std::back_inserter(sessions));
         }
-        RR_ARTEC_LOG_INFO("Begin scanner capture");
-        TRef<asdk::IFrame> frame;
+        if (proc && proc->IsScanning())
+        {
+            return true;
+        }
+        for (auto& s : sessions)
+        {
+            auto state = s->get_state();
+            if (state == rr_artec::ScanningState::record || state == rr_artec::ScanningState::continue_record)
+            {
+                return true;
+            }
+        }
+        for (auto& d : devices)
+        {
+            boost::mutex::scoped_try_lock lock(d->lock);
+            if (!lock.owns_lock())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::capture(RR::rr_bool with_texture)
+    {
+        return capture(0, with_texture.value != 0);
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr ArtecScannerImpl::capture(uint32_t scanner_index,
+        bool with_texture)
+    {
+        auto device = get_device(scanner_index);
+        RR_ARTEC_LOG_INFO("Begin scanner " << scanner_index << " capture");
+        rr_artec::ScannerCaptureResultPtr result;
+        capture_device(device, with_texture, result);
+        RR_ARTEC_LOG_INFO("Scanner capture complete");
+        return result->mesh;
+    }
+
+    void ArtecScannerImpl::capture_device(const ArtecScannerDevicePtr& device, bool with_texture, 
+        rr_artec::ScannerCaptureResultPtr& result)
+    {
+        ScannerFramePtr frame;
         TRef<asdk::IFrameMesh> mesh;
-        frame = nullptr;
         mesh = nullptr;
-        asdk::ErrorCode ec = asdk::ErrorCode_OK;
-        RR_CALL_ARTEC(scanner->capture( &frame, with_texture.value != 0), "Error capturing from scanner");
         
-        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &mesh, frame ), "Error reconstructing mesh");
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            boost::mutex::scoped_lock lock(device->lock);
+            frame = device->backend->capture(with_texture);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        {
+            boost::mutex::scoped_lock lock(device->lock);
+            if (!device->processor)
+            {
+                device->processor = device->backend->create_frame_processor();
+            }
+            device->processor->reconstruct(frame, &mesh);
+        }
+        auto t2 = std::chrono::steady_clock::now();
         
-        com::robotraconteur::geometry::shapes::MeshPtr rr_mesh = ConvertArtecFrameMeshToRR(mesh);
-        RR_ARTEC_LOG_INFO("Scanner capture complete");
-        return rr_mesh;
+        auto rr_mesh = ConvertArtecFrameMeshToRR(mesh);
+        auto t3 = std::chrono::steady_clock::now();
+
+        result.reset(new rr_artec::ScannerCaptureResult());
+        result->scanner_index = device->index;
+        result->scanner_serial = device->backend->get_serial();
+        result->mesh = rr_mesh;
+        result->capture_time = std::chrono::duration<double>(t1 - t0).count();
+        result->reconstruct_time = std::chrono::duration<double>(t2 - t1).count();
+        result->convert_time = std::chrono::duration<double>(t3 - t2).count();
     }
 
-    RR::RRArrayPtr<uint8_t> ArtecScannerImpl::capture_stl()
+    uint32_t ArtecScannerImpl::get_scanner_count()
     {
-        if (this->scanner == nullptr)
-        {
-            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
-            throw RR::InvalidOperationException("No scanner available");
-        }
-        RR_ARTEC_LOG_INFO("Begin scanner capture");
-        TRef<asdk::IFrame> frame;
-        TRef<asdk::IFrameMesh> mesh;
-        frame = nullptr;
-        mesh = nullptr;
-        asdk::ErrorCode ec = asdk::ErrorCode_OK;
-        RR_CALL_ARTEC(scanner->capture( &frame, false), "Error capturing from scanner");
-        
-        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( &mesh, frame ), "Error reconstructing mesh");
+        return boost::numeric_cast<uint32_t>(devices.size());
+    }
+
+    RR::RRListPtr<rr_artec::ScannerCaptureResult> ArtecScannerImpl::capture_all(RR::rr_bool with_texture)
+    {
+        wait_ready();
+        if (devices.empty())
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
+            throw RR::InvalidOperationException("No scanner available");
+        }
+
+        RR_ARTEC_LOG_INFO("Begin capture on " << devices.size() << " scanners");
+        std::vector<rr_artec::ScannerCaptureResultPtr> results(devices.size());
+        std::vector<std::exception_ptr> errors(devices.size());
+
+        // Trigger every head at once so a multi-head capture costs one capture latency
+        boost::thread_group capture_threads;
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            capture_threads.create_thread([this, i, with_texture, &results, &errors]
+            {
+                try
+                {
+                    capture_device(devices.at(i), with_texture.value != 0, results.at(i));
+                }
+                catch (...)
+                {
+                    errors.at(i) = std::current_exception();
+                }
+            });
+        }
+        capture_threads.join_all();
+
+        for (size_t i=0; i<errors.size(); i++)
+        {
+            if (errors.at(i))
+            {
+                RR_ARTEC_LOG_ERROR("Capture failed on scanner " << i);
+                std::rethrow_exception(errors.at(i));
+            }
+        }
+
+        auto ret = RR::AllocateEmptyRRList<rr_artec::ScannerCaptureResult>();
+        for (auto& r : results)
+        {
+            ret->push_back(r);
+        }
+        RR_ARTEC_LOG_INFO("Capture on " << devices.size() << " scanners complete");
+        return ret;
+    }
+
+    rr_artec::ScannerHeadPtr ArtecScannerImpl::get_scanners(int32_t scanner_index)
+    {
+        if (scanner_index < 0 || static_cast<size_t>(scanner_index) >= devices.size())
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to get invalid scanner: " << scanner_index);
+            throw RR::InvalidArgumentException("Invalid scanner index");
+        }
+        return RR_MAKE_SHARED<RRScannerHead>(shared_from_this(), static_cast<uint32_t>(scanner_index));
+    }
+
+    RR::RRArrayPtr<uint8_t> ArtecScannerImpl::capture_stl()
+    {
+        return capture_stl(0);
+    }
+
+    RR::RRArrayPtr<uint8_t> ArtecScannerImpl::capture_stl(uint32_t scanner_index)
+    {
+        auto device = get_device(scanner_index);
+        RR_ARTEC_LOG_INFO("Begin scanner " << scanner_index << " capture");
+        TRef<asdk::IFrameMesh> mesh;
+        mesh = nullptr;
+        {
+            boost::mutex::scoped_lock lock(device->lock);
+            auto frame = device->backend->capture(false);
+        
+            if (!device->processor)
+            {
+                device->processor = device->backend->create_frame_processor();
+            }
+            device->processor->reconstruct(frame, &mesh);
+        }
         
         auto stl_bytes = ConvertArtecMeshToStlBytes(mesh);
         RR_ARTEC_LOG_INFO("Scanner capture complete");
@@ -117,23 +475,115 @@ namespace artec_scanner_robotraconteur_driver
                 ArtecScannerImpl::run_scanning_procedure(
                 const rr_artec::ScanningProcedureSettingsPtr& settings)
     {
-        if (this->scanner == nullptr)
-        {
-            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
-            throw RR::InvalidOperationException("No scanner available");
-        }
+        return run_scanning_procedure(0, settings);
+    }
+
+    RR::GeneratorPtr<rr_artec::ScanningProcedureStatusPtr,void>
+                ArtecScannerImpl::run_scanning_procedure(uint32_t scanner_index,
+                const rr_artec::ScanningProcedureSettingsPtr& settings)
+    {
+        auto scanner = get_procedure_scanner(scanner_index);
         auto proc = RR_MAKE_SHARED<ScanningProcedure>(shared_from_this());
-        proc->Init(settings);
+        proc->Init(settings, scanner);
         RR_ARTEC_LOG_INFO("ScanningProcedure generator returned to client. Call Next() to begin.");
         return proc;
     }
 
+    void ArtecScannerImpl::add_scanning_procedure(uint32_t job_id, boost::shared_ptr<ScanningProcedure> procedure)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        for (auto e = scanning_procedures.begin(); e != scanning_procedures.end(); )
+        {
+            if (e->second.expired())
+            {
+                e = scanning_procedures.erase(e);
+            }
+            else
+            {
+                ++e;
+            }
+        }
+        scanning_procedures.insert(std::make_pair(job_id, procedure));
+    }
+
+    int32_t ArtecScannerImpl::scanning_procedure_snapshot(uint32_t job_id)
+    {
+        boost::shared_ptr<ScanningProcedure> proc;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            auto e = scanning_procedures.find(job_id);
+            if (e != scanning_procedures.end())
+            {
+                proc = e->second.lock();
+            }
+        }
+        if (!proc)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to snapshot invalid scanning procedure job: " << job_id);
+            throw RR::InvalidArgumentException("Invalid scanning procedure job id");
+        }
+        auto model = proc->Snapshot();
+        return add_model(model);
+    }
+
     ArtecScannerImpl::~ArtecScannerImpl()
     {
-        if (processor)
+        // Stop the checkpoint thread before the state it checks is destroyed
+        checkpointer.reset();
+    }
+
+    int32_t ArtecScannerImpl::scanning_session_create(const rr_artec::ScanningProcedureSettingsPtr& settings)
+    {
+        return scanning_session_create(0, settings);
+    }
+
+    int32_t ArtecScannerImpl::scanning_session_create(uint32_t scanner_index,
+        const rr_artec::ScanningProcedureSettingsPtr& settings)
+    {
+        auto scanner = get_procedure_scanner(scanner_index);
+        auto session = RR_MAKE_SHARED<ScanningSession>(shared_from_this());
+        session->Init(settings, scanner);
+        boost::mutex::scoped_lock lock(this_lock);
+        auto h = ++handle_cnt;
+        scanning_sessions.insert(std::make_pair(h, session));
+        RR_ARTEC_LOG_INFO("Created scanning session handle: " << h);
+        return h;
+    }
+
+    rr_artec::ScanningSessionPtr ArtecScannerImpl::get_scanning_sessions(int32_t session_handle)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = scanning_sessions.find(session_handle);
+        if (e == scanning_sessions.end())
         {
-            processor->release();
+            RR_ARTEC_LOG_ERROR("Attempt to get invalid scanning session: " << session_handle);
+            throw RR::InvalidArgumentException("Invalid scanning session handle");
         }
+        return e->second;
+    }
+
+    void ArtecScannerImpl::scanning_session_free(int32_t session_handle)
+    {
+        boost::shared_ptr<ScanningSession> session;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            auto e = scanning_sessions.find(session_handle);
+            if (e == scanning_sessions.end())
+            {
+                RR_ARTEC_LOG_ERROR("Attempt to free invalid scanning session: " << session_handle);
+                throw RR::InvalidArgumentException("Invalid scanning session handle");
+            }
+            session = e->second;
+            scanning_sessions.erase(e);
+        }
+        try
+        {
+            RR::ServerContext::GetCurrentServerContext()->ReleaseServicePath("scanning_sessions[" + 
+                boost::lexical_cast<std::string>(session_handle) + "]");
+        }
+        catch (std::exception&) {}
+        session->Stop();
+        RR_ARTEC_LOG_INFO("Freed scanning session: " << session_handle);
     }
 
     int32_t ArtecScannerImpl::add_model(RRArtecModelPtr model)
@@ -183,6 +633,7 @@ namespace artec_scanner_robotraconteur_driver
             throw RR::InvalidArgumentException("Invalid workset handle");
         }
         models.erase(e);
+        shared_memory_exports.erase(model_handle);
         try
         {
             RR::ServerContext::GetCurrentServerContext()->ReleaseServicePath("models[" + 
@@ -193,89 +644,169 @@ namespace artec_scanner_robotraconteur_driver
         RR_ARTEC_LOG_INFO("Freed model: " << model_handle);
     }
 
-    int32_t ArtecScannerImpl::model_load(const std::string& project_name)
+    int32_t ArtecScannerImpl::load_model(const ModelProjectJobPtr& job, const std::string& operation)
     {
-        if (!save_path)
+        if (!job->cache_hit)
         {
-            RR_ARTEC_LOG_ERROR("model_load called but project save path not specified")
-            throw RR::InvalidOperationException("Project save path not specified");
+            // The size of the project files is used as the estimate of the loaded model size
+            check_memory_limit(job->bytes_total, operation);
         }
-        boost::regex r_project_name("^[\\w\\-]+$");
-        if(!boost::regex_match(project_name,r_project_name))
+        auto gen = RR_MAKE_SHARED<ModelProjectIO>(shared_from_this());
+        gen->Init(job);
+        return gen->Run()->model_handle;
+    }
+
+    int32_t ArtecScannerImpl::model_load(const std::string& project_name)
+    {
+        return load_model(PrepareModelLoad(save_path, project_name, std::vector<std::string>(), project_cache),
+            "model_load");
+    }
+
+    void ArtecScannerImpl::model_save(int32_t model_handle,const std::string& project_name)
+    {
+        RRArtecModelPtr model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(model_handle));
+        auto gen = RR_MAKE_SHARED<ModelProjectIO>(shared_from_this());
+        gen->Init(PrepareModelSave(save_path, project_name, model, model_handle));
+        gen->Run();
+    }
+
+    RR::GeneratorPtr<rr_artec::ModelProjectStatusPtr,void > 
+        ArtecScannerImpl::model_load_async(const std::string& project_name, int32_t priority)
+    {
+        auto job = PrepareModelLoad(save_path, project_name, std::vector<std::string>(), project_cache);
+        if (!job->cache_hit)
         {
-            RR_ARTEC_LOG_ERROR("Invalid project name specified: " << project_name);
-            throw RR::InvalidArgumentException("Invalid project name");
+            check_memory_limit(job->bytes_total, "model_load_async");
         }
+        auto gen = RR_MAKE_SHARED<ModelProjectIO>(shared_from_this());
+        gen->Init(job);
+        gen->SetJobPriority(priority);
+        RR_ARTEC_LOG_INFO("Model load generator returned to client. Call Next() to begin.");
+        return gen;
+    }
 
-        
-        auto file_path = ((*save_path) / project_name / (project_name + ".a3d"));
-        RR_ARTEC_LOG_INFO("Begin load model from file " << file_path);
-        asdk::TRef<asdk::IProject> project;
+    RR::GeneratorPtr<rr_artec::ModelProjectStatusPtr,void > 
+        ArtecScannerImpl::model_save_async(int32_t model_handle, const std::string& project_name,
+        int32_t priority)
+    {
+        RRArtecModelPtr model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(model_handle));
+        auto gen = RR_MAKE_SHARED<ModelProjectIO>(shared_from_this());
+        gen->Init(PrepareModelSave(save_path, project_name, model, model_handle));
+        gen->SetJobPriority(priority);
+        RR_ARTEC_LOG_INFO("Model save generator returned to client. Call Next() to begin.");
+        return gen;
+    }
+
+    rr_artec::ModelAppendResultPtr ArtecScannerImpl::model_append(int32_t model_handle,
+        const std::string& project_name)
+    {
+        RRArtecModelPtr model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(model_handle));
+        return AppendModelToProject(save_path, project_name, model, model_handle);
+    }
 
-        RR_CALL_ARTEC(asdk::openProject(&project, file_path.c_str()), "Could not open project");
+    RR::RRListPtr<rr_artec::ProjectEntryInfo> ArtecScannerImpl::project_list_entries(const std::string& project_name)
+    {
+        return ListProjectEntries(save_path, project_name);
+    }
 
-        int num_entries = project->getEntryCount();
-        asdk::TRef<asdk::IArrayUuid> uuids;
-        RR_CALL_ARTEC(asdk::createArrayUuid(&uuids, num_entries), "Could not allocate project load uuids");
-        for (int i=0; i<num_entries; i++)
+    int32_t ArtecScannerImpl::model_load_entries(const std::string& project_name,
+        const RR::RRListPtr<RR::RRArray<char> >& entry_uuids)
+    {
+        if (!entry_uuids || entry_uuids->empty())
         {
-            asdk::EntryInfo entry;
-            RR_CALL_ARTEC(project->getEntry(i, &entry), "Could not get entry info");
-            uuids->setElement(i, entry.uuid);       
+            RR_ARTEC_LOG_ERROR("No entries specified to load from project " << project_name);
+            throw RR::InvalidArgumentException("No entries specified");
+        }
+        std::vector<std::string> uuids;
+        for (auto& e : *entry_uuids)
+        {
+            uuids.push_back(RR::RRArrayToString(e));
         }
 
-        asdk::ProjectLoaderSettings loader_settings;
-        loader_settings.entryList = uuids;
-        asdk::TRef<asdk::IJob> loader;
-        RR_CALL_ARTEC(project->createLoader(&loader, &loader_settings), "Could not create loader");
-        auto model = RR_MAKE_SHARED<RRArtecModel>();
-        asdk::AlgorithmWorkset load_workset = {nullptr, model->model, nullptr, 0};
-        RR_CALL_ARTEC(asdk::executeJob(loader, &load_workset), "Error loading model");
+        return load_model(PrepareModelLoad(save_path, project_name, uuids, project_cache), "model_load_entries");
+    }
 
-        int32_t model_handle = add_model(model);
-        RR_ARTEC_LOG_INFO("Loaded model: " << model_handle << " from file " << file_path);
-        return model_handle;
+    rr_artec::ModelExportResultPtr ArtecScannerImpl::model_export(int32_t model_handle,
+        rr_artec::ModelExportFormat::ModelExportFormat format, const std::string& path, RR::rr_bool overwrite)
+    {
+        RRArtecModelPtr model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(model_handle));
+        auto file_path = ExportFilePath(save_path, path, format);
+        // Exports are synchronous, so the call waits for the job queue to admit the export
+        auto job_ticket = job_manager->SubmitWait("model_export");
+        RR_ARTEC_LOG_INFO("Begin export model: " << model_handle << " to file " << file_path);
+        auto cpu_lease = cpu_budget->Acquire();
+        auto ret = ExportModel(model->model, format, file_path, cpu_lease->get_threads(), overwrite.value != 0);
+        ret->path = boost::filesystem::relative(file_path, *save_path).generic_string();
+        RR_ARTEC_LOG_INFO("Exported model: " << model_handle << " to file " << file_path << " (" << ret->bytes_written
+            << " bytes in " << ret->export_time << " s)");
+        return ret;
     }
 
-    void ArtecScannerImpl::model_save(int32_t model_handle,const std::string& project_name)
+    rr_artec::SharedMemoryRegionPtr ArtecScannerImpl::model_export_shared_memory(int32_t model_handle)
     {
-        if (!save_path)
+        RRArtecModelPtr model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(model_handle));
+        auto shm = ExportModelSharedMemory(SharedMemoryRegionName(model_handle), model->model);
         {
-            RR_ARTEC_LOG_ERROR("model_save called but project save path not specified")
-            throw RR::InvalidOperationException("Project save path not specified");
+            boost::mutex::scoped_lock lock(this_lock);
+            if (models.find(model_handle) == models.end())
+            {
+                RR_ARTEC_LOG_ERROR("Model " << model_handle << " freed during shared memory export");
+                throw RR::InvalidArgumentException("Invalid model handle");
+            }
+            shared_memory_exports[model_handle].push_back(shm);
         }
-        boost::regex r_project_name("^[\\w\\-]+$");
-        if(!boost::regex_match(project_name,r_project_name))
+        RR_ARTEC_LOG_INFO("Exported model: " << model_handle << " to shared memory region " << shm->get_name()
+            << " (" << shm->size() << " bytes)");
+        return shm->descriptor;
+    }
+
+    void ArtecScannerImpl::shared_memory_release(const std::string& name)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        for (auto& e : shared_memory_exports)
         {
-            RR_ARTEC_LOG_ERROR("Invalid project name specified: " << project_name);
-            throw RR::InvalidArgumentException("Invalid project name");
+            auto& exports = e.second;
+            for (auto it = exports.begin(); it != exports.end(); ++it)
+            {
+                if ((*it)->get_name() == name)
+                {
+                    int32_t handle = e.first;
+                    exports.erase(it);
+                    if (exports.empty())
+                    {
+                        shared_memory_exports.erase(handle);
+                    }
+                    RR_ARTEC_LOG_INFO("Released shared memory region " << name);
+                    return;
+                }
+            }
         }
+        RR_ARTEC_LOG_ERROR("Attempt to release invalid shared memory region: " << name);
+        throw RR::InvalidArgumentException("Invalid shared memory region name");
+    }
 
-        auto project_dir = *save_path / project_name;
-        if (boost::filesystem::exists(project_dir))
+    RR::RRListPtr<rr_artec::CheckpointInfo> ArtecScannerImpl::checkpoint_list()
+    {
+        return ListCheckpoints(CheckpointDir(save_path));
+    }
+
+    int32_t ArtecScannerImpl::checkpoint_load(const std::string& checkpoint_name)
+    {
+        auto checkpoint_dir = CheckpointDir(save_path);
+        if (!IsCompleteCheckpoint(checkpoint_dir, checkpoint_name))
         {
-            RR_ARTEC_LOG_ERROR("Project directory already exists: " << project_dir);
-            throw RR::InvalidArgumentException("Project name already exstis");
+            RR_ARTEC_LOG_ERROR("Attempt to load invalid checkpoint: " << checkpoint_name);
+            throw RR::InvalidArgumentException("Invalid checkpoint name");
         }
+        int32_t model_handle = load_model(PrepareModelLoad(checkpoint_dir, checkpoint_name,
+            std::vector<std::string>(), project_cache), "checkpoint_load");
+        RR_ARTEC_LOG_INFO("Loaded checkpoint " << checkpoint_name << " as model: " << model_handle);
+        return model_handle;
+    }
 
-        RRArtecModelPtr model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(model_handle));
-
-        asdk::ProjectSaverSettings save_settings;
-        
-        boost::filesystem::create_directory(project_dir);
-        auto file_path = ((project_dir) / (project_name + ".a3d"));
-        save_settings.path = file_path.c_str();
-        RR_ARTEC_LOG_INFO("Begin save model: " << model_handle << " to file " << file_path);
-        RR_CALL_ARTEC(asdk::generateUuid(&save_settings.projectId), "Error generating project UUID");
-        asdk::ProjectSettings project_settings;
-        project_settings.path = file_path.c_str();
-        asdk::TRef<asdk::IProject> project;
-        asdk::createNewProject(&project, &project_settings);
-        asdk::TRef<asdk::IJob> saver;
-        RR_CALL_ARTEC(project->createSaver(&saver, &save_settings), "Error creating project saver");
-        asdk::AlgorithmWorkset save_workset = {model->model, nullptr, nullptr, 0};
-        RR_CALL_ARTEC(asdk::executeJob(saver, &save_workset), "Error saving model");
-        RR_ARTEC_LOG_INFO("Saved model: " << model_handle << " to file " << file_path);
+    void ArtecScannerImpl::checkpoint_delete(const std::string& checkpoint_name)
+    {
+        DeleteCheckpoint(CheckpointDir(save_path), checkpoint_name);
     }
 
     RobotRaconteur::RRValuePtr ArtecScannerImpl::initialize_algorithm(int32_t input_model_handle, const std::string& algorithm)
@@ -285,26 +816,96 @@ namespace artec_scanner_robotraconteur_driver
     }
 
     RR::GeneratorPtr<rr_artec::RunAlgorithmsStatusPtr,void >
-        ArtecScannerImpl::run_algorithms(int32_t input_model_handle, const RR::RRListPtr<RR::RRValue>& algorithms)
+        ArtecScannerImpl::run_algorithms(int32_t input_model_handle, const RR::RRListPtr<RR::RRValue>& algorithms,
+        int32_t priority)
     {
         auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
+        // Algorithm outputs are estimated to be about the size of the input model
+        check_memory_limit(model->get_memory_estimate().bytes, "run_algorithms");
         auto gen = RR_MAKE_SHARED<RunAlgorithms>(shared_from_this());
         gen->Init(model, algorithms);
+        gen->SetJobPriority(priority);
         RR_ARTEC_LOG_INFO("RunAlgorithms generator returned to client. Call Next() to begin.");
         return gen;
     }
 
+    RR::GeneratorPtr<rr_artec::RunAlgorithmsStatusPtr,void >
+        ArtecScannerImpl::run_algorithm_pipeline(int32_t input_model_handle, 
+        const RR::RRListPtr<rr_artec::AlgorithmPipelineNode>& pipeline, int32_t priority)
+    {
+        auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
+        check_memory_limit(model->get_memory_estimate().bytes, "run_algorithm_pipeline");
+        auto gen = RR_MAKE_SHARED<RunAlgorithms>(shared_from_this());
+        gen->Init(model, pipeline);
+        gen->SetJobPriority(priority);
+        RR_ARTEC_LOG_INFO("RunAlgorithms pipeline generator returned to client. Call Next() to begin.");
+        return gen;
+    }
+
+    RR::GeneratorPtr<rr_artec::RunAlgorithmsStatusPtr,void >
+        ArtecScannerImpl::run_preset(int32_t input_model_handle, const std::string& preset_name, int32_t priority)
+    {
+        auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
+        if (model->model->getSize() <= 0)
+        {
+            RR_ARTEC_LOG_ERROR("Model passed to run_preset does not contain any scans");
+            throw RR::InvalidArgumentException("Model passed to run_preset does not contain any scans");
+        }
+        auto scanner_type = model->model->getElement(0)->getScannerType();
+        auto pipeline = algorithm_presets->GetPipeline(preset_name, scanner_type);
+        check_memory_limit(model->get_memory_estimate().bytes, "run_preset");
+        auto gen = RR_MAKE_SHARED<RunAlgorithms>(shared_from_this());
+        gen->Init(model, pipeline);
+        gen->SetJobPriority(priority);
+        RR_ARTEC_LOG_INFO("RunAlgorithms preset " << preset_name << " generator returned to client. Call Next() to begin.");
+        return gen;
+    }
+
+    RR::RRListPtr<RR::RRArray<char> > ArtecScannerImpl::get_preset_names()
+    {
+        auto ret = RR::AllocateEmptyRRList<RR::RRArray<char> >();
+        for (auto& name : algorithm_presets->GetPresetNames())
+        {
+            ret->push_back(RR::stringToRRArray(name));
+        }
+        return ret;
+    }
+
+    void ArtecScannerImpl::reload_presets()
+    {
+        algorithm_presets->Reload();
+    }
+
+    RR::GeneratorPtr<rr_artec::BenchmarkAlgorithmsStatusPtr,void >
+        ArtecScannerImpl::benchmark_algorithms(int32_t input_model_handle, 
+        const RR::RRListPtr<rr_artec::BenchmarkVariant>& variants, int32_t priority)
+    {
+        auto model = RR_DYNAMIC_POINTER_CAST<RRArtecModel>(get_models(input_model_handle));
+        check_memory_limit(model->get_memory_estimate().bytes, "benchmark_algorithms");
+        auto gen = RR_MAKE_SHARED<BenchmarkAlgorithms>(shared_from_this());
+        gen->Init(model, variants);
+        gen->SetJobPriority(priority);
+        RR_ARTEC_LOG_INFO("BenchmarkAlgorithms generator returned to client. Call Next() to begin.");
+        return gen;
+    }
+
     int32_t ArtecScannerImpl::capture_deferred(RobotRaconteur::rr_bool with_texture)
     {
-        if (this->scanner == nullptr)
+        return capture_deferred(0, with_texture.value != 0);
+    }
+
+    int32_t ArtecScannerImpl::capture_deferred(uint32_t scanner_index, bool with_texture)
+    {
+        auto device = get_device(scanner_index);
+        check_memory_limit(last_deferred_capture_bytes.load(), "capture_deferred");
+        RR_ARTEC_LOG_INFO("Begin scanner " << scanner_index << " capture");
+        RRDeferredCapturePtr capture = boost::make_shared<RRDeferredCapture>();
+        capture->scanner_index = scanner_index;
         {
-            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
-            throw RR::InvalidOperationException("No scanner available");
+            boost::mutex::scoped_lock lock(device->lock);
+            capture->frame = device->backend->capture(with_texture);
         }
-        RR_ARTEC_LOG_INFO("Begin scanner capture");
-        RRDeferredCapturePtr capture = boost::make_shared<RRDeferredCapture>();
-        capture->frame = nullptr;
-        RR_CALL_ARTEC(scanner->capture( &capture->frame, false), "Error capturing from scanner");
+        last_deferred_capture_bytes.store(capture->estimate_bytes());
         int32_t handle;
         {
             boost::mutex::scoped_lock lock(this_lock);
@@ -318,19 +919,9 @@ namespace artec_scanner_robotraconteur_driver
 
     void ArtecScannerImpl::deferred_capture_to_iframemesh(const RRDeferredCapturePtr& capture, asdk::IFrameMesh** frame_mesh)
     {
-        if (this->scanner == nullptr)
-        {
-            RR_ARTEC_LOG_ERROR("Attempt to use scanner when no scanner is available");
-            throw RR::InvalidOperationException("No scanner available");
-        }
-
-        TRef<asdk::IFrameProcessor> processor;
-        if ( scanner->createFrameProcessor( &processor ) != asdk::ErrorCode_OK )
-        {
-            return;
-        }
-        *frame_mesh = nullptr;
-        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh( frame_mesh, capture->frame ), "Error reconstructing mesh");
+        auto device = get_device(capture->scanner_index);
+        auto processor = device->processor_pool->Acquire();
+        processor->reconstruct(capture->frame, frame_mesh);
     }
 
     RRDeferredCapturePtr ArtecScannerImpl::get_deferred_capture(int32_t deferred_capture_handle)
@@ -379,6 +970,48 @@ namespace artec_scanner_robotraconteur_driver
         return stl_bytes;
     }
 
+    RobotRaconteur::RRArrayPtr<uint8_t > ArtecScannerImpl::getf_deferred_capture_compact(
+        int32_t deferred_capture_handle, double precision, RR::rr_bool compress)
+    {
+        RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
+        asdk::TRef<asdk::IFrameMesh> frame_mesh;
+        deferred_capture_to_iframemesh(capture, &frame_mesh);
+        auto compact_bytes = ConvertArtecMeshToCompactBytes(frame_mesh, precision, compress.value != 0);
+        RR_ARTEC_LOG_INFO("Deferred capture to compact bytes complete");
+        return compact_bytes;
+    }
+
+    rr_artec::MeshBuffersPtr ArtecScannerImpl::getf_deferred_capture_buffers(int32_t deferred_capture_handle)
+    {
+        RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
+        asdk::TRef<asdk::IFrameMesh> frame_mesh;
+        deferred_capture_to_iframemesh(capture, &frame_mesh);
+        auto buffers = ConvertArtecFrameMeshToBuffers(frame_mesh);
+        RR_ARTEC_LOG_INFO("Deferred capture to mesh buffers complete");
+        return buffers;
+    }
+
+    rr_artec::SharedMemoryRegionPtr ArtecScannerImpl::deferred_capture_export_shared_memory(
+        int32_t deferred_capture_handle)
+    {
+        RRDeferredCapturePtr capture = get_deferred_capture(deferred_capture_handle);
+        asdk::TRef<asdk::IFrameMesh> frame_mesh;
+        deferred_capture_to_iframemesh(capture, &frame_mesh);
+        auto shm = ExportFrameMeshSharedMemory(SharedMemoryRegionName(deferred_capture_handle), frame_mesh);
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            if (deferred_captures.find(deferred_capture_handle) == deferred_captures.end())
+            {
+                RR_ARTEC_LOG_ERROR("Deferred capture " << deferred_capture_handle << " freed during shared memory export");
+                throw RR::InvalidArgumentException("Invalid deferred_capture_handle");
+            }
+            shared_memory_exports[deferred_capture_handle].push_back(shm);
+        }
+        RR_ARTEC_LOG_INFO("Exported deferred capture: " << deferred_capture_handle << " to shared memory region "
+            << shm->get_name() << " (" << shm->size() << " bytes)");
+        return shm->descriptor;
+    }
+
     void ArtecScannerImpl::deferred_capture_free(const RobotRaconteur::RRArrayPtr<int32_t>& deferred_capture_handle)
     {
         if (!deferred_capture_handle)
@@ -389,16 +1022,176 @@ namespace artec_scanner_robotraconteur_driver
         for (auto k : *deferred_capture_handle)
         {
             deferred_captures.erase(k);
+            shared_memory_exports.erase(k);
         }
     }
 
+    RR::RRListPtr<rr_artec::MemoryUsage> ArtecScannerImpl::get_memory_usage()
+    {
+        std::map<int32_t,RRArtecModelPtr> models_copy;
+        std::map<int32_t,RRDeferredCapturePtr> captures_copy;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            models_copy = models;
+            captures_copy = deferred_captures;
+        }
+
+        std::map<asdk::IModel*, int> model_refs;
+        for (auto& e : models_copy)
+        {
+            model_refs[static_cast<asdk::IModel*>(e.second->model)]++;
+        }
+
+        auto ret = RR::AllocateEmptyRRList<rr_artec::MemoryUsage>();
+        for (auto& e : models_copy)
+        {
+            auto estimate = e.second->get_memory_estimate();
+            rr_artec::MemoryUsagePtr usage(new rr_artec::MemoryUsage());
+            usage->handle_type = "model";
+            usage->handle = e.first;
+            usage->bytes = estimate.bytes;
+            usage->texture_bytes = estimate.texture_bytes;
+            usage->frame_count = estimate.frame_count;
+            usage->vertex_count = estimate.vertex_count;
+            usage->triangle_count = estimate.triangle_count;
+            usage->shared.value = (e.second->shared || model_refs[static_cast<asdk::IModel*>(e.second->model)] > 1) ? 1 : 0;
+            ret->push_back(usage);
+        }
+        for (auto& e : captures_copy)
+        {
+            rr_artec::MemoryUsagePtr usage(new rr_artec::MemoryUsage());
+            usage->handle_type = "deferred_capture";
+            usage->handle = e.first;
+            usage->bytes = e.second->estimate_bytes();
+            usage->frame_count = 1;
+            ret->push_back(usage);
+        }
+        return ret;
+    }
+
+    uint64_t ArtecScannerImpl::get_memory_used()
+    {
+        std::map<int32_t,RRArtecModelPtr> models_copy;
+        std::map<int32_t,RRDeferredCapturePtr> captures_copy;
+        AlgorithmResultCachePtr algorithm_cache_copy;
+        ProjectCachePtr project_cache_copy;
+        uint64_t shared_memory_bytes = 0;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            models_copy = models;
+            captures_copy = deferred_captures;
+            algorithm_cache_copy = algorithm_cache;
+            project_cache_copy = project_cache;
+            for (auto& e : shared_memory_exports)
+            {
+                for (auto& shm : e.second)
+                {
+                    shared_memory_bytes += shm->size();
+                }
+            }
+        }
+
+        // Models shared by several handles or with the caches are counted once
+        uint64_t bytes = shared_memory_bytes;
+        std::set<asdk::IModel*> counted;
+        for (auto& e : models_copy)
+        {
+            if (counted.insert(static_cast<asdk::IModel*>(e.second->model)).second)
+            {
+                bytes += e.second->get_memory_estimate().bytes;
+            }
+        }
+        for (auto& e : captures_copy)
+        {
+            bytes += e.second->estimate_bytes();
+        }
+        if (algorithm_cache_copy)
+        {
+            bytes += algorithm_cache_copy->GetBytes(counted);
+        }
+        if (project_cache_copy)
+        {
+            bytes += project_cache_copy->GetBytes(counted);
+        }
+        return bytes;
+    }
+
+    uint64_t ArtecScannerImpl::get_memory_limit()
+    {
+        return memory_limit.load();
+    }
+
+    void ArtecScannerImpl::set_memory_limit(uint64_t value)
+    {
+        memory_limit.store(value);
+        RR_ARTEC_LOG_INFO("Memory limit set to " << value << " bytes");
+    }
+
+    void ArtecScannerImpl::check_memory_limit(uint64_t required_bytes, const std::string& operation)
+    {
+        uint64_t limit = memory_limit.load();
+        if (limit == 0)
+        {
+            return;
+        }
+        uint64_t used = get_memory_used();
+        if (used + required_bytes > limit)
+        {
+            // Drop the cached models before failing. Models still referenced by handles stay loaded.
+            AlgorithmResultCachePtr algorithm_cache_copy;
+            ProjectCachePtr project_cache_copy;
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                algorithm_cache_copy = algorithm_cache;
+                project_cache_copy = project_cache;
+            }
+            if (algorithm_cache_copy)
+            {
+                algorithm_cache_copy->Clear();
+            }
+            if (project_cache_copy)
+            {
+                project_cache_copy->Clear();
+            }
+            RR_ARTEC_LOG_INFO("Cleared algorithm result and project caches to free memory for " << operation);
+            used = get_memory_used();
+        }
+        if (used + required_bytes > limit)
+        {
+            std::stringstream ss;
+            ss << "Memory limit exceeded for " << operation << ": " << (used / (1024*1024)) << " MB used and "
+                << (required_bytes / (1024*1024)) << " MB estimated required exceeds limit of "
+                << (limit / (1024*1024)) << " MB. Free models or deferred captures to continue.";
+            RR_ARTEC_LOG_ERROR(ss.str());
+            throw RR::OutOfMemoryException(ss.str());
+        }
+    }
+
     void ArtecScannerImpl::free_all()
     {
         std::vector<int32_t> model_handles;
+        std::vector<int32_t> session_handles;
         {
             boost::mutex::scoped_lock lock(this_lock);
+            for (auto& e : deferred_captures)
+            {
+                shared_memory_exports.erase(e.first);
+            }
             deferred_captures.clear();
             boost::copy(models | boost::adaptors::map_keys, std::back_inserter(model_handles));
+            boost::copy(scanning_sessions | boost::adaptors::map_keys, std::back_inserter(session_handles));
+        }
+
+        for(auto handle : session_handles)
+        {
+            try
+            {
+                scanning_session_free(handle);
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_ERROR("Error freeing scanning session handle: " << e.what());
+            }
         }
 
         for(auto handle : model_handles)
@@ -415,7 +1208,8 @@ namespace artec_scanner_robotraconteur_driver
     }
 
     RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void> 
-        ArtecScannerImpl::deferred_capture_prepare(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles) 
+        ArtecScannerImpl::deferred_capture_prepare(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles,
+        int32_t priority)
     {
         RR_NULL_CHECK(deferred_capture_handles);
         std::list<boost::shared_ptr<RRDeferredCapture> > work;
@@ -425,11 +1219,13 @@ namespace artec_scanner_robotraconteur_driver
         }
         auto gen = RR_MAKE_SHARED<DeferredCapturePrepare>(shared_from_this());
         gen->Init(std::move(work), true, false);
+        gen->SetJobPriority(priority);
         return gen;
     }
 
     RobotRaconteur::GeneratorPtr<experimental::artec_scanner::DeferredCapturePrepareStatusPtr,void> 
-        ArtecScannerImpl::deferred_capture_prepare_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles)
+        ArtecScannerImpl::deferred_capture_prepare_stl(const RobotRaconteur::RRArrayPtr<int32_t >& deferred_capture_handles,
+        int32_t priority)
     {
         RR_NULL_CHECK(deferred_capture_handles);
         std::list<boost::shared_ptr<RRDeferredCapture> > work;
@@ -439,14 +1235,77 @@ namespace artec_scanner_robotraconteur_driver
         }
         auto gen = RR_MAKE_SHARED<DeferredCapturePrepare>(shared_from_this());
         gen->Init(std::move(work), false, true);
+        gen->SetJobPriority(priority);
         return gen;
     }
 
+    RRScannerHead::RRScannerHead(ArtecScannerImplPtr parent, uint32_t scanner_index)
+    {
+        this->parent = parent;
+        this->scanner_index = scanner_index;
+    }
+
+    ArtecScannerImplPtr RRScannerHead::GetParent()
+    {
+        auto p = parent.lock();
+        if (!p) {
+            RR_ARTEC_LOG_ERROR("ArtecScannerImpl parent has been released");
+            throw RR::InvalidOperationException("ArtecScannerImpl parent has been released");
+        }
+        return p;
+    }
+
+    uint32_t RRScannerHead::get_scanner_index()
+    {
+        return scanner_index;
+    }
+
+    std::string RRScannerHead::get_scanner_serial()
+    {
+        return GetParent()->get_device(scanner_index)->backend->get_serial();
+    }
+
+    com::robotraconteur::geometry::shapes::MeshPtr RRScannerHead::capture(RR::rr_bool with_texture)
+    {
+        return GetParent()->capture(scanner_index, with_texture.value != 0);
+    }
+
+    RR::RRArrayPtr<uint8_t> RRScannerHead::capture_stl()
+    {
+        return GetParent()->capture_stl(scanner_index);
+    }
+
+    int32_t RRScannerHead::capture_deferred(RR::rr_bool with_texture)
+    {
+        return GetParent()->capture_deferred(scanner_index, with_texture.value != 0);
+    }
+
+    RR::GeneratorPtr<rr_artec::ScanningProcedureStatusPtr,void> RRScannerHead::run_scanning_procedure(
+        const rr_artec::ScanningProcedureSettingsPtr& settings)
+    {
+        return GetParent()->run_scanning_procedure(scanner_index, settings);
+    }
+
+    int32_t RRScannerHead::scanning_session_create(const rr_artec::ScanningProcedureSettingsPtr& settings)
+    {
+        return GetParent()->scanning_session_create(scanner_index, settings);
+    }
+
+    static boost::atomic<uint64_t> model_content_id_cnt(0);
+
     RRArtecModel::RRArtecModel()
     {
+        content_id = ++model_content_id_cnt;
         RR_CALL_ARTEC( asdk::createModel( &model ), "Error creating artec model");
     }
 
+    RRArtecModel::RRArtecModel(TRef<asdk::IModel> shared_model, uint64_t content_id)
+    {
+        this->model = shared_model;
+        this->content_id = content_id;
+        this->shared = true;
+    }
+
     uint32_t RRArtecModel::get_scan_count()
     {
         return model->getSize();
@@ -482,6 +1341,66 @@ namespace artec_scanner_robotraconteur_driver
         
     }
 
+    ModelMemoryEstimate RRArtecModel::get_memory_estimate()
+    {
+        boost::mutex::scoped_lock lock(memory_estimate_lock);
+        if (memory_estimate_content_id != content_id)
+        {
+            memory_estimate = EstimateModelMemory(model);
+            memory_estimate_content_id = content_id;
+        }
+        return memory_estimate;
+    }
+
+    uint64_t RRArtecModel::get_estimated_bytes()
+    {
+        return get_memory_estimate().bytes;
+    }
+
+    void RRArtecModel::set_persisted(const boost::filesystem::path& file_path)
+    {
+        boost::mutex::scoped_lock lock(persisted_lock);
+        persisted_file = file_path;
+        persisted_scans.clear();
+        for (int i=0; i<model->getSize(); i++)
+        {
+            persisted_scans.insert(model->getElement(i));
+        }
+        persisted_container = model->getCompositeContainer();
+    }
+
+    void RRArtecModel::get_unpersisted(const boost::filesystem::path& file_path, std::vector<asdk::IScan*>& scans,
+        asdk::ICompositeContainer*& container)
+    {
+        boost::mutex::scoped_lock lock(persisted_lock);
+        bool same_project = !persisted_file.empty() && persisted_file == file_path;
+        scans.clear();
+        for (int i=0; i<model->getSize(); i++)
+        {
+            asdk::IScan* scan = model->getElement(i);
+            if (!same_project || persisted_scans.find(scan) == persisted_scans.end())
+            {
+                scans.push_back(scan);
+            }
+        }
+        container = model->getCompositeContainer();
+        if (container && (container->getSize() <= 0 || (same_project && container == persisted_container)))
+        {
+            container = nullptr;
+        }
+    }
+
+    size_t RRDeferredCapture::estimate_bytes()
+    {
+        size_t bytes = frame ? frame->estimate_bytes() : 0;
+        bytes += EstimateRRMeshBytes(mesh);
+        if (mesh_stl_bytes)
+        {
+            bytes += mesh_stl_bytes->size();
+        }
+        return bytes;
+    }
+
     RRScan::RRScan(artec::sdk::base::IScan* scan)
     {
         this->scan = scan;
@@ -520,6 +1439,29 @@ namespace artec_scanner_robotraconteur_driver
         return ConvertArtecMeshToStlBytes(mesh);
     }
 
+    RobotRaconteur::RRArrayPtr<uint8_t > RRScan::getf_frame_mesh_compact(uint32_t ind, double precision,
+        RR::rr_bool compress)
+    {
+        auto mesh = scan->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid scan frame mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid scan frame mesh index");
+        }
+        return ConvertArtecMeshToCompactBytes(mesh, precision, compress.value != 0);
+    }
+
+    rr_artec::MeshBuffersPtr RRScan::getf_frame_mesh_buffers(uint32_t ind)
+    {
+        auto mesh = scan->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid scan frame mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid scan frame mesh index");
+        }
+        return ConvertArtecFrameMeshToBuffers(mesh);
+    }
+
     com::robotraconteur::geometry::Transform RRScan::getf_frame_transform(uint32_t ind)
     {
         auto t = scan->getTransformation(ind);
@@ -568,6 +1510,29 @@ namespace artec_scanner_robotraconteur_driver
         return ConvertArtecMeshToStlBytes(mesh);
     }
 
+    RobotRaconteur::RRArrayPtr<uint8_t> RRCompositeContainer::getf_composite_mesh_compact(uint32_t ind,
+        double precision, RR::rr_bool compress)
+    {
+        auto mesh = container->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid composite mesh index");
+        }
+        return ConvertArtecMeshToCompactBytes(mesh, precision, compress.value != 0);
+    }
+
+    rr_artec::MeshBuffersPtr RRCompositeContainer::getf_composite_mesh_buffers(uint32_t ind)
+    {
+        auto mesh = container->getElement(ind);
+        if (!mesh)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to access invalid composite mesh index: " << ind);
+            throw RR::InvalidArgumentException("Invalid composite mesh index");
+        }
+        return ConvertArtecCompositeMeshToBuffers(mesh);
+    }
+
     com::robotraconteur::geometry::Transform RRCompositeContainer::getf_composite_mesh_transform(uint32_t ind)
     {
         auto t = container->getTransformation(ind);
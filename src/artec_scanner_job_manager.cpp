@@ -0,0 +1,308 @@
+#include "artec_scanner_job_manager.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+namespace rr_action = com::robotraconteur::action;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    JobTicket::JobTicket(boost::shared_ptr<JobManager> manager, uint32_t job_id)
+    {
+        this->manager = manager;
+        this->job_id = job_id;
+    }
+
+    JobTicket::~JobTicket()
+    {
+        auto m = manager.lock();
+        if (!m) return;
+        m->Release(job_id);
+    }
+
+    JobManager::JobManager(uint32_t max_concurrent_jobs, uint32_t max_queued_jobs, CpuBudgetPtr cpu_budget)
+    {
+        this->max_concurrent_jobs = std::max<uint32_t>(1, max_concurrent_jobs);
+        this->max_queued_jobs = max_queued_jobs;
+        this->cpu_budget = cpu_budget;
+        cpu_budget->SetExpectedJobs(this->max_concurrent_jobs);
+    }
+
+    bool JobManager::job_before(const JobPtr& a, const JobPtr& b)
+    {
+        if (a->priority != b->priority)
+        {
+            return a->priority > b->priority;
+        }
+        return a->job_id < b->job_id;
+    }
+
+    uint32_t JobManager::running_count()
+    {
+        uint32_t count = 0;
+        for (auto& job : jobs)
+        {
+            if (job->running) count++;
+        }
+        return count;
+    }
+
+    bool JobManager::exclusive_running()
+    {
+        for (auto& job : jobs)
+        {
+            if (job->running && job->exclusive) return true;
+        }
+        return false;
+    }
+
+    JobTicketPtr JobManager::Submit(const std::string& job_type, boost::function<void()> on_admitted,
+        bool exclusive, int32_t priority)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto running = running_count();
+        auto queued = static_cast<uint32_t>(jobs.size()) - running;
+        bool admit = queued == 0 && !exclusive_running()
+            && (exclusive ? running == 0 : running < max_concurrent_jobs);
+        if (!admit && queued >= max_queued_jobs)
+        {
+            RR_ARTEC_LOG_ERROR("Job queue is full, rejecting " << job_type << " job");
+            throw RR::OperationFailedException("Job queue is full");
+        }
+
+        auto job = boost::make_shared<Job>();
+        job->job_id = ++job_id_cnt;
+        job->job_type = job_type;
+        job->exclusive = exclusive;
+        job->priority = priority;
+        job->submit_time = std::chrono::steady_clock::now();
+        job->on_admitted = on_admitted;
+        auto ticket = boost::make_shared<JobTicket>(shared_from_this(), job->job_id);
+        job->ticket = ticket;
+        if (admit)
+        {
+            job->running = true;
+            job->start_time = job->submit_time;
+            ticket->admitted.store(true);
+            RR_ARTEC_LOG_INFO("Started " << job_type << " job " << job->job_id);
+        }
+        else
+        {
+            RR_ARTEC_LOG_INFO("Queued " << job_type << " job " << job->job_id);
+        }
+        jobs.push_back(job);
+        return ticket;
+    }
+
+    JobTicketPtr JobManager::SubmitWait(const std::string& job_type, bool exclusive, int32_t priority)
+    {
+        struct AdmissionWait
+        {
+            boost::mutex lock;
+            boost::condition_variable cv;
+        };
+        auto wait = boost::make_shared<AdmissionWait>();
+        // The ticket is marked admitted before the callback is posted, so it is checked under the wait lock
+        auto ticket = Submit(job_type, [wait]() {
+            boost::mutex::scoped_lock lock(wait->lock);
+            wait->cv.notify_all();
+        }, exclusive, priority);
+        boost::mutex::scoped_lock lock(wait->lock);
+        while (!ticket->IsAdmitted())
+        {
+            wait->cv.wait(lock);
+        }
+        return ticket;
+    }
+
+    void JobManager::Release(uint32_t job_id)
+    {
+        std::vector<boost::function<void()> > admitted;
+        std::vector<JobTicketPtr> admitted_tickets;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            for (auto e = jobs.begin(); e != jobs.end(); ++e)
+            {
+                if ((*e)->job_id == job_id)
+                {
+                    RR_ARTEC_LOG_INFO("Released " << (*e)->job_type << " job " << job_id);
+                    jobs.erase(e);
+                    break;
+                }
+            }
+            admit_jobs(admitted, admitted_tickets);
+        }
+        post_admitted(admitted);
+    }
+
+    void JobManager::admit_jobs(std::vector<boost::function<void()> >& admitted,
+        std::vector<JobTicketPtr>& admitted_tickets)
+    {
+        auto running = running_count();
+        while (running < max_concurrent_jobs && !exclusive_running())
+        {
+            JobPtr next;
+            for (auto& job : jobs)
+            {
+                if (job->running) continue;
+                if (!next || job_before(job, next))
+                {
+                    next = job;
+                }
+            }
+            if (!next)
+            {
+                return;
+            }
+            // An exclusive job waits for the running jobs to complete. Jobs behind it are not admitted meanwhile,
+            // so it is not starved.
+            if (next->exclusive && running > 0)
+            {
+                return;
+            }
+
+            next->running = true;
+            next->start_time = std::chrono::steady_clock::now();
+            running++;
+            auto ticket = next->ticket.lock();
+            if (ticket)
+            {
+                ticket->admitted.store(true);
+                admitted_tickets.push_back(ticket);
+            }
+            if (next->on_admitted)
+            {
+                admitted.push_back(next->on_admitted);
+            }
+            RR_ARTEC_LOG_INFO("Started queued " << next->job_type << " job " << next->job_id);
+        }
+    }
+
+    void JobManager::post_admitted(std::vector<boost::function<void()> >& admitted)
+    {
+        for (auto& h : admitted)
+        {
+            RR::RobotRaconteurNode::TryPostToThreadPool(RR::RobotRaconteurNode::weak_sp(), h, true);
+        }
+    }
+
+    int32_t JobManager::GetQueuePosition(uint32_t job_id)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        JobPtr this_job;
+        for (auto& job : jobs)
+        {
+            if (job->job_id == job_id) this_job = job;
+        }
+        if (!this_job)
+        {
+            return -1;
+        }
+        if (this_job->running)
+        {
+            return 0;
+        }
+        int32_t position = 1;
+        for (auto& job : jobs)
+        {
+            if (!job->running && job_before(job, this_job)) position++;
+        }
+        return position;
+    }
+
+    uint32_t JobManager::get_max_concurrent_jobs()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return max_concurrent_jobs;
+    }
+
+    void JobManager::set_max_concurrent_jobs(uint32_t value)
+    {
+        if (value == 0)
+        {
+            throw RR::InvalidArgumentException("max_concurrent_jobs must be greater than zero");
+        }
+        std::vector<boost::function<void()> > admitted;
+        std::vector<JobTicketPtr> admitted_tickets;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            max_concurrent_jobs = value;
+            cpu_budget->SetExpectedJobs(value);
+            admit_jobs(admitted, admitted_tickets);
+        }
+        post_admitted(admitted);
+    }
+
+    uint32_t JobManager::get_max_queued_jobs()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return max_queued_jobs;
+    }
+
+    void JobManager::set_max_queued_jobs(uint32_t value)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        max_queued_jobs = value;
+    }
+
+    uint32_t JobManager::get_running_count()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return running_count();
+    }
+
+    uint32_t JobManager::get_queued_count()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return static_cast<uint32_t>(jobs.size()) - running_count();
+    }
+
+    RR::RRListPtr<rr_artec::JobInfo> JobManager::get_jobs()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto now = std::chrono::steady_clock::now();
+        auto ret = RR::AllocateEmptyRRList<rr_artec::JobInfo>();
+        for (auto& job : jobs)
+        {
+            auto info = rr_artec::JobInfoPtr(new rr_artec::JobInfo());
+            info->job_id = job->job_id;
+            info->job_type = job->job_type;
+            info->priority = job->priority;
+            info->action_status = job->running ? rr_action::ActionStatusCode::running
+                : rr_action::ActionStatusCode::queued;
+            auto queue_end = job->running ? job->start_time : now;
+            info->queued_time = std::chrono::duration<double>(queue_end - job->submit_time).count();
+            info->running_time = job->running ? std::chrono::duration<double>(now - job->start_time).count() : 0.0;
+            int32_t position = 0;
+            if (!job->running)
+            {
+                position = 1;
+                for (auto& job2 : jobs)
+                {
+                    if (!job2->running && job_before(job2, job)) position++;
+                }
+            }
+            info->queue_position = position;
+            ret->push_back(info);
+        }
+        return ret;
+    }
+
+    void JobManager::set_job_priority(uint32_t job_id, int32_t priority)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        for (auto& job : jobs)
+        {
+            if (job->job_id == job_id)
+            {
+                job->priority = priority;
+                RR_ARTEC_LOG_INFO("Set " << job->job_type << " job " << job_id << " priority to " << priority);
+                return;
+            }
+        }
+        RR_ARTEC_LOG_ERROR("Attempt to set priority of invalid job: " << job_id);
+        throw RR::InvalidArgumentException("Invalid job id");
+    }
+}
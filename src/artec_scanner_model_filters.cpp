@@ -0,0 +1,486 @@
+#include "artec_scanner_model_filters.h"
+
+#include <artec/sdk/base/IModel.h>
+#include <artec/sdk/base/IImage.h>
+#include <artec/sdk/base/IArrayPoint3F.h>
+#include <artec/sdk/base/IArrayIndexTriplet.h>
+#include <artec/sdk/base/IArrayUVCoordinates.h>
+#include <artec/sdk/base/ICancellationToken.h>
+#include <artec/sdk/base/IProgressObserver.h>
+#include <artec/sdk/base/TArrayRef.h>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::algorithms;
+};
+using asdk::TRef;
+using asdk::TArrayRef;
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static Eigen::Matrix4d rr_transform_to_eigen_mm(const com::robotraconteur::geometry::Transform& transform)
+    {
+        auto& r = transform.s.rotation.s;
+        auto& t = transform.s.translation.s;
+        Eigen::Matrix4d ret = Eigen::Matrix4d::Identity();
+        ret.block<3,3>(0,0) = Eigen::Quaterniond(r.w, r.x, r.y, r.z).normalized().toRotationMatrix();
+        ret.block<3,1>(0,3) = Eigen::Vector3d(t.x, t.y, t.z) * 1000.0;
+        return ret;
+    }
+
+    CropModelAlgorithm::CropModelAlgorithm(const rr_artec::CropAlgorithmPtr& settings)
+    {
+        auto& size = settings->box_size.s;
+        box_half_size = Eigen::Vector3d(size.x, size.y, size.z) * 500.0;
+        use_box = !box_half_size.isZero();
+        if (use_box)
+        {
+            if ((box_half_size.array() < 0.0).any())
+            {
+                RR_ARTEC_LOG_ERROR("CropAlgorithm box_size must not be negative");
+                throw RR::InvalidArgumentException("CropAlgorithm box_size must not be negative");
+            }
+            box_transform_inv = rr_transform_to_eigen_mm(settings->box_transform).inverse();
+        }
+
+        size_t plane_count = settings->hull_normals ? settings->hull_normals->size() : 0;
+        size_t offset_count = settings->hull_offsets ? settings->hull_offsets->size() : 0;
+        if (plane_count != offset_count)
+        {
+            RR_ARTEC_LOG_ERROR("CropAlgorithm hull_normals and hull_offsets must have the same length");
+            throw RR::InvalidArgumentException("CropAlgorithm hull_normals and hull_offsets must have the same length");
+        }
+        hull_normals.resize(plane_count, 3);
+        hull_offsets.resize(plane_count);
+        for (size_t i=0; i<plane_count; i++)
+        {
+            auto& n = settings->hull_normals->at(i).s;
+            hull_normals.row(i) = Eigen::Vector3d(n.x, n.y, n.z).transpose();
+            hull_offsets(i) = (*settings->hull_offsets)[i] * 1000.0;
+        }
+
+        if (!use_box && plane_count == 0)
+        {
+            RR_ARTEC_LOG_ERROR("CropAlgorithm requires box_size or hull_normals");
+            throw RR::InvalidArgumentException("CropAlgorithm requires box_size or hull_normals");
+        }
+    }
+
+    TRef<asdk::IFrameMesh> CropModelAlgorithm::crop_frame(asdk::IFrameMesh* mesh, const Eigen::Matrix4d& frame_to_model)
+    {
+        static_assert(sizeof(asdk::Point3F) == 3 * sizeof(float), "Point3F must be three packed floats");
+
+        asdk::IArrayPoint3F* points = mesh->getPoints();
+        asdk::IArrayIndexTriplet* triangles = mesh->getTriangles();
+        if (!points || !triangles || points->getSize() == 0)
+        {
+            return nullptr;
+        }
+        int n = points->getSize();
+        Eigen::Map<const Eigen::Matrix3Xf> p(reinterpret_cast<const float*>(points->getPointer()), 3, n);
+
+        // Test all points of the frame at once in the frame coordinates
+        Eigen::Array<bool, 1, Eigen::Dynamic> inside = Eigen::Array<bool, 1, Eigen::Dynamic>::Constant(n, true);
+        if (use_box)
+        {
+            Eigen::Matrix4d frame_to_box = box_transform_inv * frame_to_model;
+            Eigen::Matrix3f r = frame_to_box.block<3,3>(0,0).cast<float>();
+            Eigen::Vector3f t = frame_to_box.block<3,1>(0,3).cast<float>();
+            Eigen::Array3f half = box_half_size.cast<float>().array();
+            Eigen::Array3Xf q = ((r * p).colwise() + t).array().abs();
+            inside = ((q.colwise() - half) <= 0.0f).colwise().all();
+        }
+        if (hull_normals.rows() > 0)
+        {
+            Eigen::Matrix3d r = frame_to_model.block<3,3>(0,0);
+            Eigen::Vector3d t = frame_to_model.block<3,1>(0,3);
+            Eigen::MatrixX3f normals = (hull_normals * r).cast<float>();
+            Eigen::VectorXf offsets = (hull_offsets - hull_normals * t).cast<float>();
+            Eigen::MatrixXf d = (normals * p).colwise() - offsets;
+            inside = inside && (d.array() <= 0.0f).colwise().all();
+        }
+
+        int kept = inside.count();
+        if (kept == n)
+        {
+            return TRef<asdk::IFrameMesh>(mesh);
+        }
+        if (kept == 0)
+        {
+            return nullptr;
+        }
+
+        std::vector<int> new_index(n, -1);
+        int j = 0;
+        for (int i=0; i<n; i++)
+        {
+            if (inside(i))
+            {
+                new_index[i] = j++;
+            }
+        }
+
+        const asdk::IndexTriplet* tri = triangles->getPointer();
+        int tri_count = triangles->getSize();
+        int kept_tri_count = 0;
+        for (int i=0; i<tri_count; i++)
+        {
+            if (new_index[tri[i].x] >= 0 && new_index[tri[i].y] >= 0 && new_index[tri[i].z] >= 0)
+            {
+                kept_tri_count++;
+            }
+        }
+        if (kept_tri_count == 0)
+        {
+            return nullptr;
+        }
+
+        TArrayRef<asdk::IArrayPoint3F> new_points;
+        RR_CALL_ARTEC(asdk::createArrayPoint3F(&new_points, kept), "Error allocating cropped points");
+        TArrayRef<asdk::IArrayIndexTriplet> new_triangles;
+        RR_CALL_ARTEC(asdk::createArrayIndexTriplet(&new_triangles, kept_tri_count),
+            "Error allocating cropped triangles");
+        const asdk::Point3F* src_points = points->getPointer();
+        for (int i=0; i<n; i++)
+        {
+            if (new_index[i] >= 0)
+            {
+                new_points[new_index[i]] = src_points[i];
+            }
+        }
+        j = 0;
+        for (int i=0; i<tri_count; i++)
+        {
+            int v1 = new_index[tri[i].x];
+            int v2 = new_index[tri[i].y];
+            int v3 = new_index[tri[i].z];
+            if (v1 >= 0 && v2 >= 0 && v3 >= 0)
+            {
+                auto& t = new_triangles[j++];
+                t.x = v1; t.y = v2; t.z = v3;
+            }
+        }
+
+        TRef<asdk::IFrameMesh> ret;
+        RR_CALL_ARTEC(asdk::createFrameMesh(&ret), "Error creating cropped frame mesh");
+        ret->setPoints(new_points);
+        ret->setTriangles(new_triangles);
+
+        // Keep the normals of the kept vertices and triangles
+        asdk::IArrayPoint3F* point_normals = mesh->getPointsNormals();
+        if (point_normals && point_normals->getSize() == n)
+        {
+            TArrayRef<asdk::IArrayPoint3F> new_point_normals;
+            RR_CALL_ARTEC(asdk::createArrayPoint3F(&new_point_normals, kept), "Error allocating cropped normals");
+            const asdk::Point3F* src_normals = point_normals->getPointer();
+            for (int i=0; i<n; i++)
+            {
+                if (new_index[i] >= 0)
+                {
+                    new_point_normals[new_index[i]] = src_normals[i];
+                }
+            }
+            ret->setPointsNormals(new_point_normals);
+        }
+        asdk::IArrayPoint3F* triangle_normals = mesh->getTrianglesNormals();
+        if (triangle_normals && triangle_normals->getSize() == tri_count)
+        {
+            TArrayRef<asdk::IArrayPoint3F> new_triangle_normals;
+            RR_CALL_ARTEC(asdk::createArrayPoint3F(&new_triangle_normals, kept_tri_count),
+                "Error allocating cropped triangle normals");
+            const asdk::Point3F* src_normals = triangle_normals->getPointer();
+            j = 0;
+            for (int i=0; i<tri_count; i++)
+            {
+                if (new_index[tri[i].x] >= 0 && new_index[tri[i].y] >= 0 && new_index[tri[i].z] >= 0)
+                {
+                    new_triangle_normals[j++] = src_normals[i];
+                }
+            }
+            ret->setTrianglesNormals(new_triangle_normals);
+        }
+
+        // Keep the texture so the cropped model can still be texturized
+        asdk::IImage* img = mesh->getImage();
+        asdk::IArrayUVCoordinates* uv = mesh->getUVCoordinates();
+        if (img && uv && uv->getSize() == n)
+        {
+            TArrayRef<asdk::IArrayUVCoordinates> new_uv;
+            RR_CALL_ARTEC(asdk::createArrayUVCoordinates(&new_uv, kept), "Error allocating cropped uvs");
+            const asdk::UVCoordinates* src_uv = uv->getPointer();
+            for (int i=0; i<n; i++)
+            {
+                if (new_index[i] >= 0)
+                {
+                    new_uv[new_index[i]] = src_uv[i];
+                }
+            }
+            ret->setImage(img);
+            ret->setUVCoordinates(new_uv);
+        }
+        return ret;
+    }
+
+    asdk::ErrorCode CropModelAlgorithm::run(asdk::AlgorithmWorkset* workset)
+    {
+        if (!workset || !workset->in || !workset->out)
+        {
+            return asdk::ErrorCode_ArgumentInvalid;
+        }
+
+        asdk::IModel* in = workset->in;
+        std::vector<std::pair<int,int> > frames;
+        for (int i=0; i<in->getSize(); i++)
+        {
+            int frame_count = in->getElement(i)->getSize();
+            for (int j=0; j<frame_count; j++)
+            {
+                frames.push_back(std::make_pair(i, j));
+            }
+        }
+
+        std::vector<TRef<asdk::IFrameMesh> > cropped(frames.size());
+        boost::atomic<size_t> next_frame(0);
+        boost::atomic<int> completed_frames(0);
+        boost::atomic<bool> cancelled(false);
+        boost::atomic<int> error(asdk::ErrorCode_OK);
+        boost::mutex progress_lock;
+
+        auto worker = [&]() {
+            while (true)
+            {
+                size_t k = next_frame.fetch_add(1);
+                if (k >= frames.size() || cancelled.load() || error.load() != asdk::ErrorCode_OK)
+                {
+                    return;
+                }
+                if (workset->cancellation && workset->cancellation->isCancelled())
+                {
+                    cancelled.store(true);
+                    return;
+                }
+                try
+                {
+                    asdk::IScan* scan = in->getElement(frames[k].first);
+                    Eigen::Matrix4d frame_to_model = ConvertArtecTransformToEigen(scan->getScanTransformation())
+                        * ConvertArtecTransformToEigen(scan->getTransformation(frames[k].second));
+                    asdk::IFrameMesh* mesh = scan->getElement(frames[k].second);
+                    if (mesh)
+                    {
+                        cropped[k] = crop_frame(mesh, frame_to_model);
+                    }
+                }
+                catch (std::exception& e)
+                {
+                    RR_ARTEC_LOG_ERROR("Error cropping frame: " << e.what());
+                    error.store(asdk::ErrorCode_OperationFailed);
+                    return;
+                }
+                int c = completed_frames.fetch_add(1) + 1;
+                if (workset->progress)
+                {
+                    boost::mutex::scoped_lock lock(progress_lock);
+                    workset->progress->report(c, static_cast<int>(frames.size()));
+                }
+            }
+        };
+
+        size_t thread_count = workset->threadsCount > 0 ? workset->threadsCount : boost::thread::hardware_concurrency();
+        thread_count = std::max<size_t>(1, std::min(thread_count, frames.size()));
+        boost::thread_group threads;
+        for (size_t i=1; i<thread_count; i++)
+        {
+            threads.create_thread(worker);
+        }
+        worker();
+        threads.join_all();
+
+        if (cancelled.load())
+        {
+            return asdk::ErrorCode_OperationAborted;
+        }
+        if (error.load() != asdk::ErrorCode_OK)
+        {
+            return static_cast<asdk::ErrorCode>(error.load());
+        }
+
+        size_t k = 0;
+        size_t kept_frames = 0;
+        for (int i=0; i<in->getSize(); i++)
+        {
+            asdk::IScan* src_scan = in->getElement(i);
+            TRef<asdk::IScan> dst_scan;
+            if (asdk::createScan(&dst_scan) != asdk::ErrorCode_OK)
+            {
+                return asdk::ErrorCode_OutOfMemory;
+            }
+            dst_scan->setScannerType(src_scan->getScannerType());
+            dst_scan->setScanTransformation(src_scan->getScanTransformation());
+            int frame_count = src_scan->getSize();
+            for (int j=0; j<frame_count; j++, k++)
+            {
+                if (cropped[k])
+                {
+                    dst_scan->add(cropped[k], src_scan->getTransformation(j));
+                    kept_frames++;
+                }
+            }
+            workset->out->add(dst_scan);
+        }
+        RR_ARTEC_LOG_INFO("Crop kept " << kept_frames << " of " << frames.size() << " frames");
+        return asdk::ErrorCode_OK;
+    }
+
+    FrameDecimationModelAlgorithm::FrameDecimationModelAlgorithm(
+        const rr_artec::FrameDecimationAlgorithmPtr& settings)
+    {
+        if (settings->min_translation < 0.0 || settings->min_rotation < 0.0)
+        {
+            RR_ARTEC_LOG_ERROR("FrameDecimationAlgorithm thresholds must not be negative");
+            throw RR::InvalidArgumentException("FrameDecimationAlgorithm thresholds must not be negative");
+        }
+        min_translation = settings->min_translation * 1000.0;
+        min_rotation = settings->min_rotation;
+        max_frame_count = settings->max_frame_count;
+    }
+
+    std::vector<int> FrameDecimationModelAlgorithm::select_frames(asdk::IScan* scan)
+    {
+        std::vector<int> kept;
+        // Length of the path through the kept frames up to each kept frame
+        std::vector<double> path;
+        int n = scan->getSize();
+        if (n <= 0)
+        {
+            return kept;
+        }
+
+        bool use_thresholds = min_translation > 0.0 || min_rotation > 0.0;
+        Eigen::Matrix4d last = ConvertArtecTransformToEigen(scan->getTransformation(0));
+        kept.push_back(0);
+        path.push_back(0.0);
+        for (int j=1; j<n; j++)
+        {
+            Eigen::Matrix4d t = ConvertArtecTransformToEigen(scan->getTransformation(j));
+            double dt = (t.block<3,1>(0,3) - last.block<3,1>(0,3)).norm();
+            bool keep = !use_thresholds || (min_translation > 0.0 && dt >= min_translation);
+            if (!keep && min_rotation > 0.0)
+            {
+                Eigen::Matrix3d dr = last.block<3,3>(0,0).transpose() * t.block<3,3>(0,0);
+                keep = Eigen::AngleAxisd(dr).angle() >= min_rotation;
+            }
+            if (keep)
+            {
+                kept.push_back(j);
+                path.push_back(path.back() + dt);
+                last = t;
+            }
+        }
+
+        size_t k = kept.size();
+        if (max_frame_count == 0 || k <= max_frame_count)
+        {
+            return kept;
+        }
+        if (max_frame_count == 1)
+        {
+            return std::vector<int>(1, kept.front());
+        }
+
+        // Pick the kept frame closest to each evenly spaced point along the path, or evenly spaced by index if
+        // the scanner did not move. The picks are forced to be distinct while leaving room for the rest.
+        std::vector<int> ret;
+        double total = path.back();
+        size_t p = 0;
+        int64_t last_pick = -1;
+        for (uint32_t i=0; i<max_frame_count; i++)
+        {
+            size_t pick;
+            if (total > 0.0)
+            {
+                double target = total * i / (max_frame_count - 1);
+                while (p + 1 < k && path[p + 1] <= target)
+                {
+                    p++;
+                }
+                pick = (p + 1 < k && path[p + 1] - target < target - path[p]) ? p + 1 : p;
+            }
+            else
+            {
+                pick = static_cast<size_t>(std::llround(static_cast<double>(i) * (k - 1) / (max_frame_count - 1)));
+            }
+            pick = std::max<size_t>(pick, static_cast<size_t>(last_pick + 1));
+            pick = std::min<size_t>(pick, k - (max_frame_count - i));
+            ret.push_back(kept[pick]);
+            last_pick = static_cast<int64_t>(pick);
+        }
+        return ret;
+    }
+
+    asdk::ErrorCode FrameDecimationModelAlgorithm::run(asdk::AlgorithmWorkset* workset)
+    {
+        if (!workset || !workset->in || !workset->out)
+        {
+            return asdk::ErrorCode_ArgumentInvalid;
+        }
+
+        asdk::IModel* in = workset->in;
+        int scan_count = in->getSize();
+        size_t in_frames = 0;
+        size_t kept_frames = 0;
+        for (int i=0; i<scan_count; i++)
+        {
+            if (workset->cancellation && workset->cancellation->isCancelled())
+            {
+                return asdk::ErrorCode_OperationAborted;
+            }
+
+            asdk::IScan* src_scan = in->getElement(i);
+            TRef<asdk::IScan> dst_scan;
+            if (asdk::createScan(&dst_scan) != asdk::ErrorCode_OK)
+            {
+                return asdk::ErrorCode_OutOfMemory;
+            }
+            dst_scan->setScannerType(src_scan->getScannerType());
+            dst_scan->setScanTransformation(src_scan->getScanTransformation());
+            for (int j : select_frames(src_scan))
+            {
+                dst_scan->add(src_scan->getElement(j), src_scan->getTransformation(j));
+            }
+            in_frames += src_scan->getSize();
+            kept_frames += dst_scan->getSize();
+            workset->out->add(dst_scan);
+
+            if (workset->progress)
+            {
+                workset->progress->report(i + 1, scan_count);
+            }
+        }
+        RR_ARTEC_LOG_INFO("Frame decimation kept " << kept_frames << " of " << in_frames << " frames");
+        return asdk::ErrorCode_OK;
+    }
+
+    void create_crop_algorithm(asdk::IAlgorithm** alg, const rr_artec::CropAlgorithmPtr& settings,
+        asdk::ScannerType scanner_type)
+    {
+        RR_NULL_CHECK(settings);
+        *alg = new CropModelAlgorithm(settings);
+    }
+
+    void create_frame_decimation_algorithm(asdk::IAlgorithm** alg,
+        const rr_artec::FrameDecimationAlgorithmPtr& settings, asdk::ScannerType scanner_type)
+    {
+        RR_NULL_CHECK(settings);
+        *alg = new FrameDecimationModelAlgorithm(settings);
+    }
+}
@@ -0,0 +1,501 @@
+#include "artec_scanner_presets.h"
+#include "artec_scanner_algorithm_util.h"
+
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <set>
+
+#define RR_ARTEC_PREFIX "experimental.artec_scanner."
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static void yaml_field(const YAML::Node& v, float& out)
+    {
+        out = v.as<float>();
+    }
+
+    static void yaml_field(const YAML::Node& v, int32_t& out)
+    {
+        out = v.as<int32_t>();
+    }
+
+    static void yaml_field(const YAML::Node& v, double& out)
+    {
+        out = v.as<double>();
+    }
+
+    static void yaml_field(const YAML::Node& v, uint32_t& out)
+    {
+        out = v.as<uint32_t>();
+    }
+
+    static void yaml_field(const YAML::Node& v, RR::rr_bool& out)
+    {
+        out.value = v.as<bool>() ? 1 : 0;
+    }
+
+    static void yaml_field(const YAML::Node& v, com::robotraconteur::geometry::Vector3& out)
+    {
+        if (!v.IsSequence() || v.size() != 3)
+        {
+            throw RR::InvalidArgumentException("Vector must be a list of three numbers");
+        }
+        out.s.x = v[0].as<double>();
+        out.s.y = v[1].as<double>();
+        out.s.z = v[2].as<double>();
+    }
+
+    // Transform is a map with rotation as a [w, x, y, z] quaternion and translation as [x, y, z]
+    static void yaml_field(const YAML::Node& v, com::robotraconteur::geometry::Transform& out)
+    {
+        if (!v.IsMap())
+        {
+            throw RR::InvalidArgumentException("Transform must be a map with rotation and translation");
+        }
+        out.s.rotation.s.w = 1.0;
+        out.s.rotation.s.x = out.s.rotation.s.y = out.s.rotation.s.z = 0.0;
+        if (auto r = v["rotation"])
+        {
+            if (!r.IsSequence() || r.size() != 4)
+            {
+                throw RR::InvalidArgumentException("Transform rotation must be a list of four numbers");
+            }
+            out.s.rotation.s.w = r[0].as<double>();
+            out.s.rotation.s.x = r[1].as<double>();
+            out.s.rotation.s.y = r[2].as<double>();
+            out.s.rotation.s.z = r[3].as<double>();
+        }
+        com::robotraconteur::geometry::Vector3 t = {};
+        if (auto t_node = v["translation"])
+        {
+            yaml_field(t_node, t);
+        }
+        out.s.translation.s.x = t.s.x;
+        out.s.translation.s.y = t.s.y;
+        out.s.translation.s.z = t.s.z;
+    }
+
+    // Enum values are numbered from zero in the order of names
+    template<typename E>
+    static void yaml_enum(const YAML::Node& v, E& out, const std::vector<std::string>& names)
+    {
+        auto s = v.as<std::string>();
+        auto e = std::find(names.begin(), names.end(), s);
+        if (e != names.end())
+        {
+            out = static_cast<E>(e - names.begin());
+            return;
+        }
+        int32_t i = -1;
+        if (!boost::conversion::try_lexical_convert(s, i) || i < 0 || i >= static_cast<int32_t>(names.size()))
+        {
+            throw RR::InvalidArgumentException("Invalid enum value: " + s);
+        }
+        out = static_cast<E>(i);
+    }
+
+    static const std::vector<std::string> global_registration_type_names = {"geometry", "geometry_and_texture"};
+    static const std::vector<std::string> simplify_type_names = {"triangle_quantity", "accuracy", "remesh",
+        "triangle_quantity_fast"};
+    static const std::vector<std::string> simplify_metric_names = {"edge_length", "edge_length_and_angle",
+        "distance_to_surface", "distance_to_surface_iterative"};
+    static const std::vector<std::string> poisson_fusion_type_names = {"sharp", "smooth"};
+    static const std::vector<std::string> fill_holes_type_names = {"all", "by_radius"};
+    static const std::vector<std::string> input_filter_names = {"use_texture_key_frames", "use_all_textures"};
+    static const std::vector<std::string> serial_registration_type_names = {"rough", "rough_textured", "fine",
+        "fine_textured"};
+    static const std::vector<std::string> small_objects_filter_type_names = {"leave_biggest_object",
+        "filter_by_threshold"};
+    static const std::vector<std::string> texturize_type_names = {"advanced", "atlas", "keep_atlas",
+        "vertex_color_to_atlas"};
+    static const std::vector<std::string> texturize_resolution_names = {"texturize_resolution_512x512",
+        "texturize_resolution_1024x1024", "texturize_resolution_2048x2048", "texturize_resolution_4096x4096",
+        "texturize_resolution_8192x8192", "texturize_resolution_16384x16384"};
+
+    template<typename T>
+    static void set_extended(const RR::RRValuePtr& settings, const std::string& key, const RR::RRValuePtr& value)
+    {
+        auto s = RR_DYNAMIC_POINTER_CAST<T>(settings);
+        if (!s->extended)
+        {
+            s->extended = RR::AllocateEmptyRRMap<std::string,RR::RRValue>();
+        }
+        s->extended->insert(std::make_pair(key, value));
+    }
+
+    static void set_max_threads(const RR::RRValuePtr& settings, uint32_t max_threads)
+    {
+        auto type = settings->RRType();
+        auto value = RR::ScalarToRRArray<uint32_t>(max_threads);
+        if (type == RR_ARTEC_PREFIX "AutoAlignAlgorithm")
+            set_extended<rr_artec::AutoAlignAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "FastFusionAlgorithm")
+            set_extended<rr_artec::FastFusionAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm")
+            set_extended<rr_artec::FastMeshSimplificationAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm")
+            set_extended<rr_artec::GlobalRegistrationAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "LoopClosureAlgorithm")
+            set_extended<rr_artec::LoopClosureAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "MeshSimplificationAlgorithm")
+            set_extended<rr_artec::MeshSimplificationAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "OutliersRemovalAlgorithm")
+            set_extended<rr_artec::OutliersRemovalAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "PoissonFusionAlgorithm")
+            set_extended<rr_artec::PoissonFusionAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "SerialRegistrationAlgorithm")
+            set_extended<rr_artec::SerialRegistrationAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm")
+            set_extended<rr_artec::SmallObjectsFilterAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "TexturizationAlgorithm")
+            set_extended<rr_artec::TexturizationAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "CropAlgorithm")
+            set_extended<rr_artec::CropAlgorithm>(settings, "max_threads", value);
+        else if (type == RR_ARTEC_PREFIX "FrameDecimationAlgorithm")
+            set_extended<rr_artec::FrameDecimationAlgorithm>(settings, "max_threads", value);
+    }
+
+    // Returns false if the field does not exist
+    static bool apply_yaml_field(const RR::RRValuePtr& settings, const std::string& key, const YAML::Node& v)
+    {
+        auto type = settings->RRType();
+        if (type == RR_ARTEC_PREFIX "FastFusionAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FastFusionAlgorithm>(settings);
+            if (key == "resolution") yaml_field(v, s->resolution);
+            else if (key == "radius") yaml_field(v, s->radius);
+            else if (key == "generate_normals") yaml_field(v, s->generate_normals);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "FastMeshSimplificationAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FastMeshSimplificationAlgorithm>(settings);
+            if (key == "triangle_number") yaml_field(v, s->triangle_number);
+            else if (key == "keep_boundary") yaml_field(v, s->keep_boundary);
+            else if (key == "enable_additional_criteria") yaml_field(v, s->enable_additional_criteria);
+            else if (key == "enable_distance_threshold") yaml_field(v, s->enable_distance_threshold);
+            else if (key == "distance_threshold") yaml_field(v, s->distance_threshold);
+            else if (key == "enable_angle_threshold") yaml_field(v, s->enable_angle_threshold);
+            else if (key == "angle_threshold") yaml_field(v, s->angle_threshold);
+            else if (key == "enable_aspect_ratio_threshold") yaml_field(v, s->enable_aspect_ratio_threshold);
+            else if (key == "aspect_ratio_threshold") yaml_field(v, s->aspect_ratio_threshold);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "GlobalRegistrationAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::GlobalRegistrationAlgorithm>(settings);
+            if (key == "registration_type") yaml_enum(v, s->registration_type, global_registration_type_names);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "MeshSimplificationAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::MeshSimplificationAlgorithm>(settings);
+            if (key == "simplify_type") yaml_enum(v, s->simplify_type, simplify_type_names);
+            else if (key == "simplify_metrics") yaml_enum(v, s->simplify_metrics, simplify_metric_names);
+            else if (key == "triangle_number") yaml_field(v, s->triangle_number);
+            else if (key == "keep_boundary") yaml_field(v, s->keep_boundary);
+            else if (key == "angle_threshold") yaml_field(v, s->angle_threshold);
+            else if (key == "remesh_edge_threshold") yaml_field(v, s->remesh_edge_threshold);
+            else if (key == "error") yaml_field(v, s->error);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "OutliersRemovalAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::OutliersRemovalAlgorithm>(settings);
+            if (key == "standard_deviation_multiplier") yaml_field(v, s->standard_deviation_multiplier);
+            else if (key == "resolution") yaml_field(v, s->resolution);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "PoissonFusionAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::PoissonFusionAlgorithm>(settings);
+            if (key == "fusion_type") yaml_enum(v, s->fusion_type, poisson_fusion_type_names);
+            else if (key == "fill_type") yaml_enum(v, s->fill_type, fill_holes_type_names);
+            else if (key == "resolution") yaml_field(v, s->resolution);
+            else if (key == "max_hole_radius") yaml_field(v, s->max_hole_radius);
+            else if (key == "remove_targets") yaml_field(v, s->remove_targets);
+            else if (key == "target_inner_size") yaml_field(v, s->target_inner_size);
+            else if (key == "target_outer_size") yaml_field(v, s->target_outer_size);
+            else if (key == "generate_normals") yaml_field(v, s->generate_normals);
+            else if (key == "input_filter_type") yaml_enum(v, s->input_filter_type, input_filter_names);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "SerialRegistrationAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::SerialRegistrationAlgorithm>(settings);
+            if (key == "registration_type") yaml_enum(v, s->registration_type, serial_registration_type_names);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "SmallObjectsFilterAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::SmallObjectsFilterAlgorithm>(settings);
+            if (key == "filter_type") yaml_enum(v, s->filter_type, small_objects_filter_type_names);
+            else if (key == "filter_threshold") yaml_field(v, s->filter_threshold);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "TexturizationAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::TexturizationAlgorithm>(settings);
+            if (key == "texturize_type") yaml_enum(v, s->texturize_type, texturize_type_names);
+            else if (key == "texturize_resolution") yaml_enum(v, s->texturize_resolution, texturize_resolution_names);
+            else if (key == "enable_background_segmentation") yaml_field(v, s->enable_background_segmentation);
+            else if (key == "enable_ambient_lighting_compensation")
+                yaml_field(v, s->enable_ambient_lighting_compensation);
+            else if (key == "atlas_unfolding_polygon_limit") yaml_field(v, s->atlas_unfolding_polygon_limit);
+            else if (key == "enable_texture_inpainting") yaml_field(v, s->enable_texture_inpainting);
+            else if (key == "use_texture_normalization") yaml_field(v, s->use_texture_normalization);
+            else if (key == "input_filter_type") yaml_enum(v, s->input_filter_type, input_filter_names);
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "CropAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::CropAlgorithm>(settings);
+            if (key == "box_transform") yaml_field(v, s->box_transform);
+            else if (key == "box_size") yaml_field(v, s->box_size);
+            else if (key == "hull_normals")
+            {
+                if (!v.IsSequence())
+                {
+                    throw RR::InvalidArgumentException("hull_normals must be a list of vectors");
+                }
+                s->hull_normals = RR::AllocateEmptyRRNamedArray<com::robotraconteur::geometry::Vector3>(v.size());
+                for (size_t i=0; i<v.size(); i++)
+                {
+                    yaml_field(v[i], s->hull_normals->at(i));
+                }
+            }
+            else if (key == "hull_offsets")
+            {
+                auto offsets = v.as<std::vector<double> >();
+                s->hull_offsets = RR::AttachRRArrayCopy<double>(offsets.data(), offsets.size());
+            }
+            else return false;
+            return true;
+        }
+        if (type == RR_ARTEC_PREFIX "FrameDecimationAlgorithm")
+        {
+            auto s = RR_DYNAMIC_POINTER_CAST<rr_artec::FrameDecimationAlgorithm>(settings);
+            if (key == "min_translation") yaml_field(v, s->min_translation);
+            else if (key == "min_rotation") yaml_field(v, s->min_rotation);
+            else if (key == "max_frame_count") yaml_field(v, s->max_frame_count);
+            else return false;
+            return true;
+        }
+        // AutoAlignAlgorithm and LoopClosureAlgorithm do not have settings
+        return false;
+    }
+
+    void apply_yaml_algorithm_settings(const RR::RRValuePtr& settings, const YAML::Node& node)
+    {
+        RR_NULL_CHECK(settings);
+        if (!node || node.IsNull())
+        {
+            return;
+        }
+        if (!node.IsMap())
+        {
+            throw RR::InvalidArgumentException("Algorithm settings must be a map");
+        }
+        for (auto it = node.begin(); it != node.end(); ++it)
+        {
+            auto key = it->first.as<std::string>();
+            try
+            {
+                if (key == "max_threads")
+                {
+                    set_max_threads(settings, it->second.as<uint32_t>());
+                    continue;
+                }
+                if (!apply_yaml_field(settings, key, it->second))
+                {
+                    throw RR::InvalidArgumentException("Unknown field " + key + " for " + settings->RRType());
+                }
+            }
+            catch (YAML::Exception& e)
+            {
+                throw RR::InvalidArgumentException("Invalid value for field " + key + " of " + settings->RRType()
+                    + ": " + e.what());
+            }
+        }
+    }
+
+    AlgorithmPresetPtr AlgorithmPresets::parse_preset(const std::string& name, const YAML::Node& node)
+    {
+        if (!node.IsSequence() || node.size() == 0)
+        {
+            throw RR::InvalidArgumentException("Preset " + name + " must be a list of algorithms");
+        }
+
+        auto preset = boost::make_shared<AlgorithmPreset>();
+        preset->name = name;
+        std::set<std::string> step_names;
+        for (size_t i=0; i<node.size(); i++)
+        {
+            auto step_node = node[i];
+            if (!step_node.IsMap() || !step_node["algorithm"])
+            {
+                throw RR::InvalidArgumentException("Preset " + name + " step " + boost::lexical_cast<std::string>(i)
+                    + " must be a map with an algorithm entry");
+            }
+
+            AlgorithmPresetStep step;
+            step.algorithm = step_node["algorithm"].as<std::string>();
+            step.name = step_node["name"] ? step_node["name"].as<std::string>()
+                : boost::lexical_cast<std::string>(i) + "_" + step.algorithm;
+            // Steps without an input use the previous step, so a plain list runs in sequence
+            if (step_node["input"])
+            {
+                step.input = step_node["input"].IsNull() ? "" : step_node["input"].as<std::string>();
+            }
+            else if (!preset->steps.empty())
+            {
+                step.input = preset->steps.back().name;
+            }
+            step.retain_output = step_node["retain_output"] ? step_node["retain_output"].as<bool>() : false;
+
+            if (step_names.find(step.name) != step_names.end())
+            {
+                throw RR::InvalidArgumentException("Preset " + name + " step names must be unique: " + step.name);
+            }
+            if (!step.input.empty() && step_names.find(step.input) == step_names.end())
+            {
+                throw RR::InvalidArgumentException("Preset " + name + " step " + step.name + " input " + step.input
+                    + " must be listed before the step");
+            }
+
+            step.settings = YAML::Node(YAML::NodeType::Map);
+            for (auto it = step_node.begin(); it != step_node.end(); ++it)
+            {
+                auto key = it->first.as<std::string>();
+                if (key == "algorithm" || key == "name" || key == "input" || key == "retain_output")
+                {
+                    continue;
+                }
+                step.settings[key] = it->second;
+            }
+
+            // Validate the algorithm type and fields before the preset is used
+            auto settings = util_new_algorithm_settings(step.algorithm);
+            if (!settings)
+            {
+                throw RR::InvalidArgumentException("Preset " + name + " step " + step.name
+                    + " has invalid algorithm type: " + step.algorithm);
+            }
+            apply_yaml_algorithm_settings(settings, step.settings);
+
+            step_names.insert(step.name);
+            preset->steps.push_back(step);
+        }
+        return preset;
+    }
+
+    RR::RRListPtr<rr_artec::AlgorithmPipelineNode> AlgorithmPresets::build_pipeline(const AlgorithmPreset& preset,
+        artec::sdk::base::ScannerType scanner_type)
+    {
+        auto pipeline = RR::AllocateEmptyRRList<rr_artec::AlgorithmPipelineNode>();
+        for (auto& step : preset.steps)
+        {
+            auto node = rr_artec::AlgorithmPipelineNodePtr(new rr_artec::AlgorithmPipelineNode());
+            node->name = step.name;
+            node->input = step.input;
+            node->retain_output.value = step.retain_output ? 1 : 0;
+            node->algorithm = util_initialize_algorithm(step.algorithm, scanner_type);
+            apply_yaml_algorithm_settings(node->algorithm, step.settings);
+            pipeline->push_back(node);
+        }
+        return pipeline;
+    }
+
+    void AlgorithmPresets::Load(const boost::filesystem::path& path)
+    {
+        std::map<std::string, AlgorithmPresetPtr> new_presets;
+        try
+        {
+            auto root = YAML::LoadFile(path.string());
+            auto presets_node = root["presets"];
+            if (!presets_node || !presets_node.IsMap())
+            {
+                throw RR::InvalidArgumentException("Algorithm presets file must contain a presets map");
+            }
+            for (auto it = presets_node.begin(); it != presets_node.end(); ++it)
+            {
+                auto name = it->first.as<std::string>();
+                new_presets.insert(std::make_pair(name, parse_preset(name, it->second)));
+            }
+        }
+        catch (YAML::Exception& e)
+        {
+            RR_ARTEC_LOG_ERROR("Error loading algorithm presets from " << path << ": " << e.what());
+            throw RR::InvalidArgumentException("Error loading algorithm presets: " + std::string(e.what()));
+        }
+        catch (RR::InvalidArgumentException& e)
+        {
+            RR_ARTEC_LOG_ERROR("Error loading algorithm presets from " << path << ": " << e.Message);
+            throw;
+        }
+
+        boost::mutex::scoped_lock lock(this_lock);
+        presets.swap(new_presets);
+        this->path = path;
+        RR_ARTEC_LOG_INFO("Loaded " << presets.size() << " algorithm presets from " << path);
+    }
+
+    void AlgorithmPresets::Reload()
+    {
+        boost::optional<boost::filesystem::path> p;
+        {
+            boost::mutex::scoped_lock lock(this_lock);
+            p = path;
+        }
+        if (!p)
+        {
+            RR_ARTEC_LOG_ERROR("Algorithm presets file has not been specified");
+            throw RR::InvalidOperationException("Algorithm presets file has not been specified");
+        }
+        Load(*p);
+    }
+
+    RR::RRListPtr<rr_artec::AlgorithmPipelineNode> AlgorithmPresets::GetPipeline(const std::string& name,
+        artec::sdk::base::ScannerType scanner_type)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = presets.find(name);
+        if (e == presets.end())
+        {
+            RR_ARTEC_LOG_ERROR("Invalid algorithm preset: " << name);
+            throw RR::InvalidArgumentException("Invalid algorithm preset: " + name);
+        }
+        auto& preset = e->second;
+        auto e2 = preset->pipelines.find(static_cast<int32_t>(scanner_type));
+        if (e2 != preset->pipelines.end())
+        {
+            return e2->second;
+        }
+        auto pipeline = build_pipeline(*preset, scanner_type);
+        preset->pipelines.insert(std::make_pair(static_cast<int32_t>(scanner_type), pipeline));
+        return pipeline;
+    }
+
+    std::vector<std::string> AlgorithmPresets::GetPresetNames()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        std::vector<std::string> names;
+        for (auto& p : presets)
+        {
+            names.push_back(p.first);
+        }
+        return names;
+    }
+}
@@ -0,0 +1,655 @@
+#include "artec_scanner_project.h"
+#include "artec_scanner_impl.h"
+
+#include <artec/sdk/project/ProjectSettings.h>
+#include <artec/sdk/project/ProjectLoaderSettings.h>
+#include <artec/sdk/project/ProjectSaverSettings.h>
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/base/ICompositeContainer.h>
+#include <artec/sdk/algorithms/Algorithms.h>
+
+#include <boost/regex.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <set>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::project;
+    using namespace artec::sdk::algorithms;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+namespace rr_action = com::robotraconteur::action;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    boost::filesystem::path ProjectFilePath(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name)
+    {
+        if (!save_path)
+        {
+            RR_ARTEC_LOG_ERROR("Project save path not specified")
+            throw RR::InvalidOperationException("Project save path not specified");
+        }
+        boost::regex r_project_name("^[\\w\\-]+$");
+        if(!boost::regex_match(project_name,r_project_name))
+        {
+            RR_ARTEC_LOG_ERROR("Invalid project name specified: " << project_name);
+            throw RR::InvalidArgumentException("Invalid project name");
+        }
+        return (*save_path) / project_name / (project_name + ".a3d");
+    }
+
+    uint64_t DirectorySize(const boost::filesystem::path& dir)
+    {
+        uint64_t bytes = 0;
+        boost::system::error_code ec;
+        for (boost::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (boost::filesystem::is_regular_file(it->status()))
+            {
+                bytes += boost::filesystem::file_size(it->path(), ec);
+            }
+        }
+        return bytes;
+    }
+
+    std::string UuidToString(const asdk::Uuid& uuid)
+    {
+        static_assert(sizeof(asdk::Uuid) == 16, "Unexpected Uuid size");
+        uint8_t bytes[16];
+        std::memcpy(bytes, &uuid, 16);
+        static const char hex[] = "0123456789abcdef";
+        std::string ret;
+        ret.reserve(36);
+        for (int i=0; i<16; i++)
+        {
+            if (i == 4 || i == 6 || i == 8 || i == 10)
+            {
+                ret.push_back('-');
+            }
+            ret.push_back(hex[bytes[i] >> 4]);
+            ret.push_back(hex[bytes[i] & 0xf]);
+        }
+        return ret;
+    }
+
+    asdk::Uuid UuidFromString(const std::string& str)
+    {
+        boost::regex r_uuid("^[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{12}$");
+        if (!boost::regex_match(str, r_uuid))
+        {
+            RR_ARTEC_LOG_ERROR("Invalid entry uuid specified: " << str);
+            throw RR::InvalidArgumentException("Invalid entry uuid");
+        }
+        uint8_t bytes[16];
+        int n = 0;
+        for (size_t i=0; i<str.size();)
+        {
+            if (str[i] == '-')
+            {
+                i++;
+                continue;
+            }
+            bytes[n++] = static_cast<uint8_t>(std::stoi(str.substr(i, 2), nullptr, 16));
+            i += 2;
+        }
+        asdk::Uuid ret;
+        std::memcpy(&ret, bytes, 16);
+        return ret;
+    }
+
+    RR::RRListPtr<rr_artec::ProjectEntryInfo> ListProjectEntries(
+        const boost::optional<boost::filesystem::path>& save_path, const std::string& project_name)
+    {
+        auto file_path = ProjectFilePath(save_path, project_name);
+        TRef<asdk::IProject> project;
+        RR_CALL_ARTEC(asdk::openProject(&project, file_path.c_str()), "Could not open project");
+
+        auto ret = RR::AllocateEmptyRRList<rr_artec::ProjectEntryInfo>();
+        int num_entries = project->getEntryCount();
+        for (int i=0; i<num_entries; i++)
+        {
+            asdk::EntryInfo entry;
+            RR_CALL_ARTEC(project->getEntry(i, &entry), "Could not get entry info");
+            rr_artec::ProjectEntryInfoPtr info(new rr_artec::ProjectEntryInfo());
+            info->uuid = UuidToString(entry.uuid);
+            std::wstring name(entry.name ? entry.name : L"");
+            info->name = std::string(name.begin(), name.end());
+            info->entry_type = static_cast<int32_t>(entry.type);
+            info->entry_index = static_cast<uint32_t>(i);
+            ret->push_back(info);
+        }
+        return ret;
+    }
+
+    ModelProjectJobPtr PrepareModelLoad(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name, const std::vector<std::string>& entry_uuids, const ProjectCachePtr& cache)
+    {
+        auto ret = boost::make_shared<ModelProjectJob>();
+        ret->project_name = project_name;
+        ret->file_path = ProjectFilePath(save_path, project_name);
+        ret->project_dir = ret->file_path.parent_path();
+
+        if (cache && boost::filesystem::exists(ret->file_path))
+        {
+            std::vector<std::string> normalized_uuids;
+            for (auto& s : entry_uuids)
+            {
+                normalized_uuids.push_back(UuidToString(UuidFromString(s)));
+            }
+            ret->cache_key = ProjectCache::MakeKey(ret->file_path, normalized_uuids);
+            TRef<asdk::IModel> cached_model;
+            uint64_t content_id = 0;
+            if (cache->Get(ret->cache_key, cached_model, content_id))
+            {
+                ret->model = RR_MAKE_SHARED<RRArtecModel>(cached_model, content_id);
+                ret->cache_hit = true;
+                ret->bytes_total = DirectorySize(ret->project_dir);
+                ret->entries_total = entry_uuids.empty() ? static_cast<uint32_t>(cached_model->getSize()
+                    + (cached_model->getCompositeContainer() ? 1 : 0))
+                    : static_cast<uint32_t>(std::set<std::string>(normalized_uuids.begin(), normalized_uuids.end()).size());
+                RR_ARTEC_LOG_INFO("Model for file " << ret->file_path << " found in project cache");
+                return ret;
+            }
+        }
+
+        RR_ARTEC_LOG_INFO("Begin load model from file " << ret->file_path);
+
+        RR_CALL_ARTEC(asdk::openProject(&ret->project, ret->file_path.c_str()), "Could not open project");
+
+        int num_entries = ret->project->getEntryCount();
+        std::vector<asdk::Uuid> selected;
+        if (entry_uuids.empty())
+        {
+            for (int i=0; i<num_entries; i++)
+            {
+                asdk::EntryInfo entry;
+                RR_CALL_ARTEC(ret->project->getEntry(i, &entry), "Could not get entry info");
+                selected.push_back(entry.uuid);
+            }
+        }
+        else
+        {
+            std::set<std::string> project_uuids;
+            for (int i=0; i<num_entries; i++)
+            {
+                asdk::EntryInfo entry;
+                RR_CALL_ARTEC(ret->project->getEntry(i, &entry), "Could not get entry info");
+                project_uuids.insert(UuidToString(entry.uuid));
+            }
+            std::set<std::string> seen;
+            for (auto& s : entry_uuids)
+            {
+                auto uuid = UuidFromString(s);
+                auto uuid_str = UuidToString(uuid);
+                if (project_uuids.find(uuid_str) == project_uuids.end())
+                {
+                    RR_ARTEC_LOG_ERROR("Entry " << s << " not found in project " << project_name);
+                    throw RR::InvalidArgumentException("Entry not found in project: " + s);
+                }
+                if (seen.insert(uuid_str).second)
+                {
+                    selected.push_back(uuid);
+                }
+            }
+        }
+
+        asdk::TRef<asdk::IArrayUuid> uuids;
+        RR_CALL_ARTEC(asdk::createArrayUuid(&uuids, static_cast<int>(selected.size())),
+            "Could not allocate project load uuids");
+        for (size_t i=0; i<selected.size(); i++)
+        {
+            uuids->setElement(static_cast<int>(i), selected[i]);
+        }
+
+        asdk::ProjectLoaderSettings loader_settings;
+        loader_settings.entryList = uuids;
+        RR_CALL_ARTEC(ret->project->createLoader(&ret->job, &loader_settings), "Could not create loader");
+        ret->model = RR_MAKE_SHARED<RRArtecModel>();
+        ret->bytes_total = DirectorySize(ret->project_dir);
+        ret->entries_total = static_cast<uint32_t>(selected.size());
+        return ret;
+    }
+
+    void CacheLoadedModel(const ModelProjectJobPtr& job, const ProjectCachePtr& cache)
+    {
+        if (!cache || job->cache_hit || job->cache_key.empty())
+        {
+            return;
+        }
+        // The cache holds the loaded model, so it is shared with the loading handle
+        job->model->shared = true;
+        cache->Put(job->cache_key, job->model->model, job->model->content_id, EstimateModelBytes(job->model->model));
+    }
+
+    ModelProjectJobPtr PrepareModelSave(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name, boost::shared_ptr<RRArtecModel> model, int32_t model_handle)
+    {
+        auto ret = boost::make_shared<ModelProjectJob>();
+        ret->save = true;
+        ret->project_name = project_name;
+        ret->file_path = ProjectFilePath(save_path, project_name);
+        ret->project_dir = ret->file_path.parent_path();
+        ret->model = model;
+        ret->model_handle = model_handle;
+        if (boost::filesystem::exists(ret->project_dir))
+        {
+            RR_ARTEC_LOG_ERROR("Project directory already exists: " << ret->project_dir);
+            throw RR::InvalidArgumentException("Project name already exstis");
+        }
+
+        asdk::ProjectSaverSettings save_settings;
+
+        boost::filesystem::create_directory(ret->project_dir);
+        save_settings.path = ret->file_path.c_str();
+        RR_ARTEC_LOG_INFO("Begin save model: " << model_handle << " to file " << ret->file_path);
+        RR_CALL_ARTEC(asdk::generateUuid(&save_settings.projectId), "Error generating project UUID");
+        asdk::ProjectSettings project_settings;
+        project_settings.path = ret->file_path.c_str();
+        asdk::createNewProject(&ret->project, &project_settings);
+        RR_CALL_ARTEC(ret->project->createSaver(&ret->job, &save_settings), "Error creating project saver");
+        ret->bytes_total = EstimateModelBytes(model->model);
+        ret->entries_total = static_cast<uint32_t>(model->model->getSize())
+            + (model->model->getCompositeContainer() ? 1 : 0);
+        return ret;
+    }
+
+    namespace
+    {
+        struct ProjectFileState
+        {
+            uint64_t size;
+            std::time_t mtime;
+        };
+    }
+
+    static std::map<boost::filesystem::path, ProjectFileState> project_file_states(const boost::filesystem::path& dir)
+    {
+        std::map<boost::filesystem::path, ProjectFileState> ret;
+        boost::system::error_code ec;
+        for (boost::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (boost::filesystem::is_regular_file(it->status()))
+            {
+                boost::system::error_code ec2;
+                ProjectFileState state;
+                state.size = boost::filesystem::file_size(it->path(), ec2);
+                state.mtime = boost::filesystem::last_write_time(it->path(), ec2);
+                ret[it->path()] = state;
+            }
+        }
+        return ret;
+    }
+
+    // An append rewrites the project file, so appends are run one at a time
+    static boost::mutex project_append_lock;
+
+    rr_artec::ModelAppendResultPtr AppendModelToProject(const boost::optional<boost::filesystem::path>& save_path,
+        const std::string& project_name, boost::shared_ptr<RRArtecModel> model, int32_t model_handle)
+    {
+        auto file_path = ProjectFilePath(save_path, project_name);
+        auto project_dir = file_path.parent_path();
+        if (!boost::filesystem::exists(file_path))
+        {
+            RR_ARTEC_LOG_ERROR("Project does not exist: " << file_path);
+            throw RR::InvalidArgumentException("Project does not exist");
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+        auto ret = rr_artec::ModelAppendResultPtr(new rr_artec::ModelAppendResult());
+        ret->project_name = project_name;
+
+        std::vector<asdk::IScan*> scans;
+        asdk::ICompositeContainer* container = nullptr;
+        model->get_unpersisted(file_path, scans, container);
+        ret->scans_appended = static_cast<uint32_t>(scans.size());
+        ret->composite_appended.value = container ? 1 : 0;
+        if (scans.empty() && !container)
+        {
+            RR_ARTEC_LOG_INFO("Model " << model_handle << " has no new scans to append to file " << file_path);
+            return ret;
+        }
+
+        // Model holding only the new scans, so the saver does not write the existing entries again
+        TRef<asdk::IModel> append_model;
+        RR_CALL_ARTEC(asdk::createModel(&append_model), "Error creating artec model");
+        for (auto scan : scans)
+        {
+            append_model->add(scan);
+        }
+        if (container)
+        {
+            append_model->setCompositeContainer(container);
+        }
+
+        boost::mutex::scoped_lock lock(project_append_lock);
+        RR_ARTEC_LOG_INFO("Begin append model: " << model_handle << " with " << scans.size() << " new scans to file "
+            << file_path);
+
+        boost::filesystem::path backup_path = file_path;
+        backup_path += ".append_backup";
+        boost::filesystem::remove(backup_path);
+        boost::filesystem::copy_file(file_path, backup_path);
+        auto files_before = project_file_states(project_dir);
+
+        try
+        {
+            TRef<asdk::IProject> project;
+            RR_CALL_ARTEC(asdk::openProject(&project, file_path.c_str()), "Could not open project");
+            // The saver of an opened project adds entries to it, so the existing project id is kept
+            asdk::ProjectSaverSettings save_settings;
+            save_settings.path = file_path.c_str();
+            TRef<asdk::IJob> job;
+            RR_CALL_ARTEC(project->createSaver(&job, &save_settings), "Error creating project saver");
+            asdk::AlgorithmWorkset save_workset = {append_model, nullptr, nullptr, 0};
+            RR_CALL_ARTEC(asdk::executeJob(job, &save_workset), "Error appending model to project");
+        }
+        catch (std::exception&)
+        {
+            boost::system::error_code ec;
+            for (auto& f : project_file_states(project_dir))
+            {
+                if (files_before.find(f.first) == files_before.end())
+                {
+                    boost::filesystem::remove(f.first, ec);
+                }
+            }
+            boost::filesystem::remove(file_path, ec);
+            boost::filesystem::rename(backup_path, file_path, ec);
+            if (ec)
+            {
+                RR_ARTEC_LOG_ERROR("Could not restore project file " << file_path << " after failed append: "
+                    << ec.message());
+            }
+            throw;
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::remove(backup_path, ec);
+
+        uint64_t bytes_written = 0;
+        for (auto& f : project_file_states(project_dir))
+        {
+            auto e = files_before.find(f.first);
+            if (e == files_before.end() || e->second.size != f.second.size || e->second.mtime != f.second.mtime)
+            {
+                bytes_written += f.second.size;
+            }
+        }
+        ret->bytes_written = bytes_written;
+        ret->append_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+        model->set_persisted(file_path);
+        RR_ARTEC_LOG_INFO("Appended model: " << model_handle << " to file " << file_path << " (" << bytes_written
+            << " bytes in " << ret->append_time << " s)");
+        return ret;
+    }
+
+    boost::shared_ptr<ArtecScannerImpl> ModelProjectIO::GetParent()
+    {
+        auto p = parent.lock();
+        if (!p) {
+            RR_ARTEC_LOG_ERROR("ArtecScannerImpl parent has been released");
+            throw RR::InvalidOperationException("ArtecScannerImpl parent has been released");
+        }
+        return p;
+    }
+
+    ModelProjectIO::ModelProjectIO(boost::shared_ptr<ArtecScannerImpl> parent)
+        : QueuedJobGenerator("", "Model project", false)
+    {
+        this->parent = parent;
+    }
+
+    void ModelProjectIO::Init(ModelProjectJobPtr job)
+    {
+        this->job = job;
+        // Save and load are reported as separate job types in the job queue
+        this->job_type = job->save ? "model_save" : "model_load";
+        this->job_manager = GetParent()->job_manager;
+        if (job->cache_hit)
+        {
+            // Loads from the project cache do not read the project, so they do not wait in the job queue
+            started = true;
+            artec_job_complete = true;
+        }
+    }
+
+    rr_artec::ModelProjectStatusPtr ModelProjectIO::Run()
+    {
+        boost::mutex wait_lock;
+        boost::condition_variable wait_cv;
+        while (true)
+        {
+            bool done = false;
+            rr_artec::ModelProjectStatusPtr status;
+            RR::RobotRaconteurExceptionPtr err;
+            AsyncNext([&](const rr_artec::ModelProjectStatusPtr& s, const RR::RobotRaconteurExceptionPtr& e)
+            {
+                boost::mutex::scoped_lock lock(wait_lock);
+                status = s;
+                err = e;
+                done = true;
+                wait_cv.notify_all();
+            });
+            {
+                boost::mutex::scoped_lock lock(wait_lock);
+                while (!done)
+                {
+                    wait_cv.wait(lock);
+                }
+            }
+            if (err)
+            {
+                RR::RobotRaconteurExceptionUtil::DownCastAndThrowException(*err);
+            }
+            if (status->action_status == rr_action::ActionStatusCode::complete)
+            {
+                return status;
+            }
+        }
+    }
+
+    ModelProjectIO::~ModelProjectIO()
+    {
+        // The job observer holds a reference until the job completes, so the job is not running here
+        if (job && (!artec_job_complete || artec_job_status != asdk::ErrorCode_OK))
+        {
+            remove_partial_save();
+        }
+    }
+
+    rr_artec::ModelProjectStatusPtr ModelProjectIO::running_status()
+    {
+        auto ret = rr_artec::ModelProjectStatusPtr(new rr_artec::ModelProjectStatus());
+        ret->action_status = started ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::queued;
+        ret->model_handle = job->save ? job->model_handle : 0;
+        ret->project_name = job->project_name;
+        double fraction = 0.0;
+        if (progress)
+        {
+            int32_t total = progress->total.load(boost::memory_order_relaxed);
+            int32_t current = progress->current.load(boost::memory_order_relaxed);
+            if (total > 0)
+            {
+                fraction = std::min(1.0, std::max(0.0, static_cast<double>(current) / total));
+            }
+        }
+        ret->progress = fraction;
+        ret->bytes_total = job->bytes_total;
+        ret->bytes_processed = static_cast<uint64_t>(fraction * job->bytes_total);
+        ret->entries_total = job->entries_total;
+        ret->entries_processed = static_cast<uint32_t>(fraction * job->entries_total);
+        ret->job_id = job_id;
+        ret->queue_position = started ? 0 : job_manager->GetQueuePosition(job_id);
+        return ret;
+    }
+
+    void ModelProjectIO::start_job()
+    {
+        started = true;
+        try
+        {
+            RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
+            progress = boost::make_shared<AlgorithmProgressObserver>();
+            workset.in = nullptr;
+            workset.out = nullptr;
+            if (job->save)
+            {
+                workset.in = job->model->model;
+            }
+            else
+            {
+                workset.out = job->model->model;
+            }
+            workset.progress = progress.get();
+            workset.cancellation = ct_source->getToken();
+            cpu_lease = GetParent()->cpu_budget->Acquire();
+            workset.threadsCount = cpu_lease->get_threads();
+
+            auto job_observer = new ModelProjectIOJobObserver(shared_from_this());
+            RR_CALL_ARTEC(asdk::launchJob(job->job, &workset, job_observer),
+                job->save ? "Error launching project saver" : "Error launching project loader");
+        }
+        catch (std::exception&)
+        {
+            completed = true;
+            job_ticket.reset();
+            cpu_lease.reset();
+            remove_partial_save();
+            throw;
+        }
+        RR_ARTEC_LOG_INFO("Started model project job " << job_id << " for " << job->file_path);
+    }
+
+    bool ModelProjectIO::job_complete()
+    {
+        return artec_job_complete;
+    }
+
+    void ModelProjectIO::stop_job(bool abort)
+    {
+        if (ct_source)
+        {
+            this->ct_source->cancel();
+        }
+    }
+
+    void ModelProjectIO::job_dropped()
+    {
+        remove_partial_save();
+    }
+
+    void ModelProjectIO::project_job_complete(asdk::ErrorCode result)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        artec_job_complete = true;
+        artec_job_status = result;
+        // Free the job slot for queued jobs
+        job_ticket.reset();
+        cpu_lease.reset();
+        if (result != asdk::ErrorCode_OK)
+        {
+            remove_partial_save();
+        }
+        auto h = next_handler;
+        next_handler.clear();
+        if (h)
+        {
+            try
+            {
+                next_timer->Stop();
+            }
+            catch (std::exception&) {}
+
+            complete_gen(h);
+            return;
+        }
+    }
+
+    void ModelProjectIO::remove_partial_save()
+    {
+        if (!job->save)
+        {
+            return;
+        }
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(job->project_dir, ec);
+        if (ec)
+        {
+            RR_ARTEC_LOG_ERROR("Could not remove partially saved project " << job->project_dir << ": "
+                << ec.message());
+        }
+        else
+        {
+            RR_ARTEC_LOG_INFO("Removed partially saved project " << job->project_dir);
+        }
+    }
+
+    void ModelProjectIO::complete_gen(boost::function<void(const rr_artec::ModelProjectStatusPtr&,
+        const RR::RobotRaconteurExceptionPtr&)> handler)
+    {
+        RR_ARTEC_LOG_INFO("Model project job complete");
+
+        completed = true;
+
+        if (aborted)
+        {
+            handler(nullptr, RR_MAKE_SHARED<RR::OperationAbortedException>(aborted_message()));
+            return;
+        }
+
+        if (artec_job_status != asdk::ErrorCode_OK)
+        {
+            auto exp = ArtecErrorToExceptionPtr(artec_job_status, job->save ? "Error saving model"
+                : "Error loading model");
+            handler(nullptr, exp);
+            return;
+        }
+
+        auto ret = running_status();
+        ret->action_status = rr_action::ActionStatusCode::complete;
+        ret->progress = 1.0;
+        if (job->save)
+        {
+            job->bytes_total = DirectorySize(job->project_dir);
+            job->model->set_persisted(job->file_path);
+            RR_ARTEC_LOG_INFO("Saved model: " << job->model_handle << " to file " << job->file_path);
+        }
+        else
+        {
+            auto parent = GetParent();
+            CacheLoadedModel(job, parent->project_cache);
+            job->model->set_persisted(job->file_path);
+            job->model_handle = parent->add_model(job->model);
+            RR_ARTEC_LOG_INFO("Loaded model: " << job->model_handle << " from file " << job->file_path);
+        }
+        ret->model_handle = job->model_handle;
+        ret->bytes_total = job->bytes_total;
+        ret->bytes_processed = job->bytes_total;
+        ret->entries_processed = job->entries_total;
+        handler(ret,nullptr);
+    }
+
+    ModelProjectIOJobObserver::ModelProjectIOJobObserver(boost::shared_ptr<ModelProjectIO> parent)
+    {
+        this->parent = parent;
+    }
+
+    void ModelProjectIOJobObserver::completed(artec::sdk::base::ErrorCode result)
+    {
+        auto p = parent;
+        parent.reset();
+        if (!p) return;
+        p->project_job_complete(result);
+    }
+}
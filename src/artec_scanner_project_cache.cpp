@@ -0,0 +1,142 @@
+#include "artec_scanner_project_cache.h"
+
+#include <algorithm>
+#include <ctime>
+#include <boost/lexical_cast.hpp>
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    ProjectCache::ProjectCache(size_t budget_bytes)
+    {
+        this->budget_bytes = budget_bytes;
+    }
+
+    std::string ProjectCache::MakeKey(const boost::filesystem::path& file_path,
+        const std::vector<std::string>& entry_uuids)
+    {
+        boost::system::error_code ec;
+        auto canonical_path = boost::filesystem::canonical(file_path, ec);
+        if (ec)
+        {
+            canonical_path = file_path;
+        }
+
+        // Saving a project writes several files next to the .a3d file, so use the newest file and the total size
+        // of the directory to detect changes
+        std::time_t mtime = 0;
+        uint64_t bytes = 0;
+        for (boost::filesystem::recursive_directory_iterator it(canonical_path.parent_path(), ec), end;
+            !ec && it != end; it.increment(ec))
+        {
+            if (boost::filesystem::is_regular_file(it->status()))
+            {
+                boost::system::error_code ec2;
+                mtime = std::max(mtime, boost::filesystem::last_write_time(it->path(), ec2));
+                bytes += boost::filesystem::file_size(it->path(), ec2);
+            }
+        }
+
+        std::vector<std::string> uuids(entry_uuids);
+        std::sort(uuids.begin(), uuids.end());
+        uuids.erase(std::unique(uuids.begin(), uuids.end()), uuids.end());
+
+        std::string key = canonical_path.string() + "|" + boost::lexical_cast<std::string>(mtime) + "|"
+            + boost::lexical_cast<std::string>(bytes) + "|";
+        if (uuids.empty())
+        {
+            key += "*";
+        }
+        for (auto& u : uuids)
+        {
+            key += u + ",";
+        }
+        return key;
+    }
+
+    bool ProjectCache::Get(const std::string& key, artec::sdk::base::TRef<artec::sdk::base::IModel>& model,
+        uint64_t& content_id)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = index.find(key);
+        if (e == index.end())
+        {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, e->second);
+        model = e->second->model;
+        content_id = e->second->content_id;
+        return true;
+    }
+
+    void ProjectCache::Put(const std::string& key, artec::sdk::base::TRef<artec::sdk::base::IModel> model,
+        uint64_t content_id, size_t bytes)
+    {
+        if (budget_bytes == 0)
+        {
+            return;
+        }
+
+        if (bytes > budget_bytes)
+        {
+            RR_ARTEC_LOG_INFO("Loaded project of " << bytes << " bytes is larger than the project cache budget");
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(this_lock);
+        auto e = index.find(key);
+        if (e != index.end())
+        {
+            total_bytes -= e->second->bytes;
+            entries.erase(e->second);
+            index.erase(e);
+        }
+
+        while (!entries.empty() && total_bytes + bytes > budget_bytes)
+        {
+            auto& lru = entries.back();
+            RR_ARTEC_LOG_INFO("Evicting loaded project of " << lru.bytes << " bytes from cache");
+            total_bytes -= lru.bytes;
+            index.erase(lru.key);
+            entries.pop_back();
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.model = model;
+        entry.content_id = content_id;
+        entry.bytes = bytes;
+        entries.push_front(std::move(entry));
+        index.insert(std::make_pair(key, entries.begin()));
+        total_bytes += bytes;
+    }
+
+    void ProjectCache::Clear()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        index.clear();
+        entries.clear();
+        total_bytes = 0;
+    }
+
+    size_t ProjectCache::GetBytes()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return total_bytes;
+    }
+
+    size_t ProjectCache::GetBytes(std::set<artec::sdk::base::IModel*>& counted)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        size_t bytes = 0;
+        for (auto& e : entries)
+        {
+            if (counted.insert(static_cast<artec::sdk::base::IModel*>(e.model)).second)
+            {
+                bytes += e.bytes;
+            }
+        }
+        return bytes;
+    }
+}
@@ -2,6 +2,7 @@
 #include <RobotRaconteur.h>
 #include <RobotRaconteurCompanion/StdRobDef/StdRobDefAll.h>
 #include "artec_scanner_impl.h"
+#include "artec_scanner_simulated.h"
 
 #include <artec/sdk/capturing/IScanner.h>
 #include <artec/sdk/capturing/IArrayScannerId.h>
@@ -33,7 +34,37 @@ int main(int argc, char* argv[])
     desc.add_options()
         ("help", "produce help message")
         ("project-save-path", po::value<std::string>(), "set project save path")
-        ("no-scanner","Do not search for scanner. Only used to process existing scan data");
+        ("no-scanner","Do not search for scanner. Only used to process existing scan data")
+        ("algorithm-cache-size", po::value<uint32_t>()->default_value(2048), 
+            "memory budget for cached algorithm results in MB, 0 to disable")
+        ("project-cache-size", po::value<uint32_t>()->default_value(1024), 
+            "memory budget for cached models loaded from projects in MB, 0 to disable")
+        ("memory-limit", po::value<uint32_t>()->default_value(0), 
+            "limit in MB on the estimated memory of models and deferred captures, 0 for no limit")
+        ("cpu-threads", po::value<uint32_t>()->default_value(0), 
+            "CPU threads shared by algorithms and deferred capture preparation, 0 for all hardware threads")
+        ("max-concurrent-jobs", po::value<uint32_t>()->default_value(2), 
+            "maximum number of scanning, algorithm, and deferred capture prepare jobs running at the same time")
+        ("max-queued-jobs", po::value<uint32_t>()->default_value(16), 
+            "maximum number of jobs waiting to start, further jobs are rejected")
+        ("algorithm-presets", po::value<std::string>(), "YAML file of named algorithm presets")
+        ("autosave", "save completed scanning and algorithm output models as checkpoints in the project save path")
+        ("autosave-bandwidth", po::value<double>()->default_value(20.0), 
+            "average checkpoint write rate limit in MB/s, 0 for no limit")
+        ("autosave-max-checkpoints", po::value<uint32_t>()->default_value(20), 
+            "number of checkpoints kept, oldest are removed first, 0 to keep all")
+        ("warm-up-capture", "run a throwaway capture on each scanner during warm up")
+        ("simulated-scanner","Use a simulated scanner instead of searching for a scanner")
+        ("simulated-scanner-vertex-count", po::value<uint32_t>()->default_value(100000), 
+            "number of vertices in each simulated frame")
+        ("simulated-scanner-texture-size", po::value<uint32_t>()->default_value(1024), 
+            "width and height of simulated frame textures in pixels")
+        ("simulated-scanner-noise", po::value<double>()->default_value(0.05), 
+            "standard deviation of simulated surface noise in mm")
+        ("simulated-scanner-latency", po::value<uint32_t>()->default_value(50), 
+            "simulated capture latency in milliseconds")
+        ("simulated-scanner-replay-path", po::value<std::string>(), 
+            "replay .obj frames from directory instead of generating frames");
 
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
@@ -44,8 +75,24 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    TRef<asdk::IScanner> scanner;
-    if(vm.count("no-scanner") == 0)
+    std::vector<ArtecScannerDevicePtr> devices;
+    if (vm.count("simulated-scanner"))
+    {
+        SimulatedScannerSettings sim_settings;
+        sim_settings.vertex_count = vm["simulated-scanner-vertex-count"].as<uint32_t>();
+        sim_settings.texture_size = vm["simulated-scanner-texture-size"].as<uint32_t>();
+        sim_settings.noise = vm["simulated-scanner-noise"].as<double>();
+        sim_settings.capture_latency_ms = vm["simulated-scanner-latency"].as<uint32_t>();
+        if (vm.count("simulated-scanner-replay-path"))
+        {
+            sim_settings.replay_path = boost::filesystem::path(vm["simulated-scanner-replay-path"].as<std::string>());
+        }
+        std::cerr << "Using simulated scanner" << std::endl;
+        auto device = boost::make_shared<ArtecScannerDevice>();
+        device->backend = boost::make_shared<SimulatedScannerBackend>(sim_settings);
+        devices.push_back(device);
+    }
+    else if(vm.count("no-scanner") == 0)
     {
         asdk::setOutputLevel( asdk::VerboseLevel_Trace );
         asdk::ErrorCode ec = asdk::ErrorCode_OK;
@@ -64,26 +111,64 @@ int main(int argc, char* argv[])
             return 3;
         }
         const asdk::ScannerId* idArray = scannersList->getPointer();
-        const asdk::ScannerId& defaultScanner = idArray[0]; // just take the first available scanner
-        std::wcerr 
-            << L"Connecting to " << asdk::getScannerTypeName( defaultScanner.type ) 
-            << L" scanner " << defaultScanner.serial << L"... "
-        ;
-        ec = asdk::createScanner( &scanner, &defaultScanner );
-        if( ec != asdk::ErrorCode_OK )
+        for (int i=0; i<scanner_count; i++)
         {
-            std::cerr << "Create scanner failed" << std::endl;
-            return 2;
+            const asdk::ScannerId& scanner_id = idArray[i];
+            std::wcerr 
+                << L"Connecting to " << asdk::getScannerTypeName( scanner_id.type ) 
+                << L" scanner " << scanner_id.serial << L"... "
+            ;
+            TRef<asdk::IScanner> scanner;
+            ec = asdk::createScanner( &scanner, &scanner_id );
+            if( ec != asdk::ErrorCode_OK )
+            {
+                std::cerr << "Create scanner failed" << std::endl;
+                return 2;
+            }
+            std::wstring serial(scanner_id.serial);
+            auto device = boost::make_shared<ArtecScannerDevice>();
+            device->backend = boost::make_shared<ArtecSdkScannerBackend>(scanner, std::string(serial.begin(), serial.end()));
+            devices.push_back(device);
         }
     }
 
     auto scanner_impl = RR_MAKE_SHARED<ArtecScannerImpl>();
-    scanner_impl->Init(scanner);
+    scanner_impl->set_cpu_threads(vm["cpu-threads"].as<uint32_t>());
+    scanner_impl->Init(devices);
     if (vm.count("project-save-path"))
     {
         boost::filesystem::path save_path(vm["project-save-path"].as<std::string>());
         scanner_impl->set_save_path(save_path);
     }
+    scanner_impl->set_algorithm_cache_size(static_cast<size_t>(vm["algorithm-cache-size"].as<uint32_t>()) * 1024 * 1024);
+    scanner_impl->set_project_cache_size(static_cast<size_t>(vm["project-cache-size"].as<uint32_t>()) * 1024 * 1024);
+    scanner_impl->set_memory_limit(static_cast<uint64_t>(vm["memory-limit"].as<uint32_t>()) * 1024 * 1024);
+    scanner_impl->set_job_limits(vm["max-concurrent-jobs"].as<uint32_t>(), vm["max-queued-jobs"].as<uint32_t>());
+    if (vm.count("algorithm-presets"))
+    {
+        try
+        {
+            scanner_impl->set_algorithm_presets_path(vm["algorithm-presets"].as<std::string>());
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Could not load algorithm presets: " << e.what() << std::endl;
+            return 4;
+        }
+    }
+    if (vm.count("autosave"))
+    {
+        try
+        {
+            scanner_impl->set_autosave(vm["autosave-bandwidth"].as<double>() * 1024 * 1024,
+                vm["autosave-max-checkpoints"].as<uint32_t>());
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Could not enable autosave: " << e.what() << std::endl;
+            return 5;
+        }
+    }
     
     RR::RobotRaconteurNodeSetup node_setup(RR::RobotRaconteurNode::sp(),
         ROBOTRACONTEUR_SERVICE_TYPES, "experimental.artec_scanner", 64238,
@@ -91,10 +176,8 @@ int main(int argc, char* argv[])
         RR::RobotRaconteurNodeSetupFlags_SERVER_DEFAULT_ALLOWED_OVERRIDE,
         argc, argv);
     RR::RobotRaconteurNode::s()->RegisterService("scanner", "experimental.artec_scanner", scanner_impl);
-    if (!artec::sdk::algorithms::checkAlgorithmsPermission())
-    {
-        RR_ARTEC_LOG_WARNING("Artec Algorithms not available on this computer");
-    }
+    scanner_impl->set_warm_up_capture(vm.count("warm-up-capture") > 0);
+    scanner_impl->StartWarmUp();
 
     std::cout << "Press enter to quit..." << std::endl;
     getchar();
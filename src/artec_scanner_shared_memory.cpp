@@ -0,0 +1,293 @@
+#include "artec_scanner_shared_memory.h"
+
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/base/IMesh.h>
+#include <artec/sdk/base/ICompositeMesh.h>
+#include <artec/sdk/base/ICompositeContainer.h>
+#include <artec/sdk/base/IArrayPoint3F.h>
+#include <artec/sdk/base/IArrayIndexTriplet.h>
+#include <artec/sdk/base/IArrayUVCoordinates.h>
+#include <artec/sdk/base/IImage.h>
+#include <Eigen/Dense>
+
+#include <boost/atomic.hpp>
+#include <cstring>
+#include <sstream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace asdk {
+    using namespace artec::sdk::base;
+};
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+namespace bip = boost::interprocess;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    static const uint32_t shared_memory_layout_version = 1;
+    static const size_t shared_memory_header_size = 64;
+    static const size_t shared_memory_alignment = 64;
+
+    namespace
+    {
+        struct SharedMemoryTextureSource
+        {
+            asdk::IImage* image;
+            asdk::IArrayUVCoordinates* uvs;
+        };
+
+        struct SharedMemoryMeshSource
+        {
+            asdk::IMesh* mesh;
+            Eigen::Matrix4d transform;
+            std::vector<SharedMemoryTextureSource> textures;
+        };
+    }
+
+    SharedMemoryExport::SharedMemoryExport(const std::string& name, size_t size)
+        : name(name)
+#ifdef _WIN32
+        , shm(bip::create_only, name.c_str(), bip::read_write, size)
+#else
+        , shm(bip::create_only, name.c_str(), bip::read_write)
+#endif
+    {
+#ifndef _WIN32
+        try
+        {
+            shm.truncate(static_cast<bip::offset_t>(size));
+            region = bip::mapped_region(shm, bip::read_write, 0, size);
+        }
+        catch (...)
+        {
+            bip::shared_memory_object::remove(name.c_str());
+            throw;
+        }
+#else
+        region = bip::mapped_region(shm, bip::read_write, 0, size);
+#endif
+    }
+
+    SharedMemoryExport::~SharedMemoryExport()
+    {
+        // Windows removes the region when the last handle is closed. Clients that have already mapped a POSIX
+        // region keep their mapping after it is unlinked.
+#ifndef _WIN32
+        bip::shared_memory_object::remove(name.c_str());
+#endif
+    }
+
+    std::string SharedMemoryRegionName(int32_t handle)
+    {
+        static boost::atomic<uint32_t> region_cnt(0);
+#ifdef _WIN32
+        uint64_t pid = GetCurrentProcessId();
+#else
+        uint64_t pid = getpid();
+#endif
+        std::stringstream ss;
+        ss << "artec_scanner_" << pid << "_" << handle << "_" << ++region_cnt;
+        return ss.str();
+    }
+
+    static size_t shared_memory_align(size_t offset)
+    {
+        return (offset + shared_memory_alignment - 1) & ~(shared_memory_alignment - 1);
+    }
+
+    // Reserve an aligned buffer of size bytes, returning its offset
+    static size_t shared_memory_reserve(size_t& offset, size_t size)
+    {
+        size_t ret = shared_memory_align(offset);
+        offset = ret + size;
+        return ret;
+    }
+
+    static SharedMemoryExportPtr export_meshes(const std::string& name, std::vector<SharedMemoryMeshSource>& sources)
+    {
+        static_assert(sizeof(asdk::Point3F) == 3 * sizeof(float), "Point3F must be three packed floats");
+        static_assert(sizeof(asdk::IndexTriplet) == 3 * sizeof(uint32_t), "IndexTriplet must be three packed ints");
+        static_assert(sizeof(asdk::UVCoordinates) == 2 * sizeof(float), "UVCoordinates must be two packed floats");
+
+        auto descriptor = rr_artec::SharedMemoryRegionPtr(new rr_artec::SharedMemoryRegion());
+        descriptor->name = name;
+        descriptor->layout_version = shared_memory_layout_version;
+        descriptor->meshes = RR::AllocateEmptyRRList<rr_artec::SharedMemoryMesh>();
+
+        // Compute the layout before creating the region so it can be sized exactly
+        size_t offset = shared_memory_header_size;
+        for (auto& s : sources)
+        {
+            s.mesh->calculate( asdk::CM_Normals );
+            asdk::IArrayPoint3F* points = s.mesh->getPoints();
+            asdk::IArrayPoint3F* normals = s.mesh->getPointsNormals();
+            asdk::IArrayIndexTriplet* triangles = s.mesh->getTriangles();
+            uint32_t vertex_count = points ? static_cast<uint32_t>(points->getSize()) : 0;
+            uint32_t normal_count = normals ? static_cast<uint32_t>(normals->getSize()) : 0;
+            uint32_t triangle_count = triangles ? static_cast<uint32_t>(triangles->getSize()) : 0;
+
+            auto m = rr_artec::SharedMemoryMeshPtr(new rr_artec::SharedMemoryMesh());
+            m->transform = ConvertEigenTransformToRR(s.transform);
+            m->vertex_count = vertex_count;
+            m->vertices_offset = shared_memory_reserve(offset, vertex_count * sizeof(asdk::Point3F));
+            m->normal_count = normal_count;
+            m->normals_offset = shared_memory_reserve(offset, normal_count * sizeof(asdk::Point3F));
+            m->triangle_count = triangle_count;
+            m->triangles_offset = shared_memory_reserve(offset, triangle_count * sizeof(asdk::IndexTriplet));
+            m->textures = RR::AllocateEmptyRRList<rr_artec::SharedMemoryTexture>();
+            for (auto& t : s.textures)
+            {
+                auto tex = rr_artec::SharedMemoryTexturePtr(new rr_artec::SharedMemoryTexture());
+                tex->uv_count = static_cast<uint32_t>(t.uvs->getSize());
+                tex->uvs_offset = shared_memory_reserve(offset, tex->uv_count * sizeof(asdk::UVCoordinates));
+                tex->image_width = static_cast<uint32_t>(t.image->getWidth());
+                tex->image_height = static_cast<uint32_t>(t.image->getHeight());
+                tex->image_pitch = static_cast<uint32_t>(t.image->getPitch());
+                tex->pixel_format = static_cast<int32_t>(t.image->getPixelFormat());
+                tex->image_offset = shared_memory_reserve(offset,
+                    static_cast<size_t>(tex->image_pitch) * tex->image_height);
+                m->textures->push_back(tex);
+            }
+            descriptor->meshes->push_back(m);
+        }
+        size_t size = shared_memory_align(offset);
+        descriptor->size = size;
+
+        SharedMemoryExportPtr ret;
+        try
+        {
+            ret = boost::make_shared<SharedMemoryExport>(name, size);
+        }
+        catch (bip::interprocess_exception& e)
+        {
+            RR_ARTEC_LOG_ERROR("Could not create shared memory region " << name << ": " << e.what());
+            throw RR::OperationFailedException("Could not create shared memory region: " + std::string(e.what()));
+        }
+        ret->descriptor = descriptor;
+
+        uint8_t* data = ret->data();
+        std::memset(data, 0, shared_memory_header_size);
+        std::memcpy(data, "ARSM", 4);
+        uint32_t version = shared_memory_layout_version;
+        uint64_t size64 = size;
+        uint32_t mesh_count = static_cast<uint32_t>(sources.size());
+        std::memcpy(data + 4, &version, sizeof(version));
+        std::memcpy(data + 8, &size64, sizeof(size64));
+        std::memcpy(data + 16, &mesh_count, sizeof(mesh_count));
+
+        auto m_iter = descriptor->meshes->begin();
+        for (auto& s : sources)
+        {
+            auto& m = *m_iter++;
+            if (m->vertex_count > 0)
+            {
+                std::memcpy(data + m->vertices_offset, s.mesh->getPoints()->getPointer(),
+                    m->vertex_count * sizeof(asdk::Point3F));
+            }
+            if (m->normal_count > 0)
+            {
+                std::memcpy(data + m->normals_offset, s.mesh->getPointsNormals()->getPointer(),
+                    m->normal_count * sizeof(asdk::Point3F));
+            }
+            if (m->triangle_count > 0)
+            {
+                std::memcpy(data + m->triangles_offset, s.mesh->getTriangles()->getPointer(),
+                    m->triangle_count * sizeof(asdk::IndexTriplet));
+            }
+            auto t_iter = m->textures->begin();
+            for (auto& t : s.textures)
+            {
+                auto& tex = *t_iter++;
+                if (tex->uv_count > 0)
+                {
+                    std::memcpy(data + tex->uvs_offset, t.uvs->getPointer(),
+                        tex->uv_count * sizeof(asdk::UVCoordinates));
+                }
+                size_t image_bytes = static_cast<size_t>(tex->image_pitch) * tex->image_height;
+                if (image_bytes > 0)
+                {
+                    std::memcpy(data + tex->image_offset, t.image->getPointer(), image_bytes);
+                }
+            }
+        }
+
+        return ret;
+    }
+
+    SharedMemoryExportPtr ExportModelSharedMemory(const std::string& name, asdk::IModel* model)
+    {
+        std::vector<SharedMemoryMeshSource> sources;
+        asdk::ICompositeContainer* container = model->getCompositeContainer();
+        if (container && container->getSize() > 0)
+        {
+            Eigen::Matrix4d container_transform = ConvertArtecTransformToEigen(container->getContainerTransformation());
+            for (int i=0; i<container->getSize(); i++)
+            {
+                asdk::ICompositeMesh* mesh = container->getElement(i);
+                if (!mesh)
+                {
+                    continue;
+                }
+                SharedMemoryMeshSource s;
+                s.mesh = mesh;
+                s.transform = container_transform * ConvertArtecTransformToEigen(container->getTransformation(i));
+                for (int j=0; j<mesh->getTexturesCount(); j++)
+                {
+                    auto t = mesh->getTexture(j);
+                    if (t->getImage() && t->getUVCoordinates())
+                    {
+                        s.textures.push_back({t->getImage(), t->getUVCoordinates()});
+                    }
+                }
+                sources.push_back(s);
+            }
+        }
+        else
+        {
+            for (int i=0; i<model->getSize(); i++)
+            {
+                asdk::IScan* scan = model->getElement(i);
+                Eigen::Matrix4d scan_transform = ConvertArtecTransformToEigen(scan->getScanTransformation());
+                for (int j=0; j<scan->getSize(); j++)
+                {
+                    asdk::IFrameMesh* mesh = scan->getElement(j);
+                    if (!mesh)
+                    {
+                        continue;
+                    }
+                    SharedMemoryMeshSource s;
+                    s.mesh = mesh;
+                    s.transform = scan_transform * ConvertArtecTransformToEigen(scan->getTransformation(j));
+                    if (mesh->getImage() && mesh->getUVCoordinates())
+                    {
+                        s.textures.push_back({mesh->getImage(), mesh->getUVCoordinates()});
+                    }
+                    sources.push_back(s);
+                }
+            }
+        }
+        return export_meshes(name, sources);
+    }
+
+    SharedMemoryExportPtr ExportFrameMeshSharedMemory(const std::string& name, asdk::IFrameMesh* mesh)
+    {
+        std::vector<SharedMemoryMeshSource> sources;
+        SharedMemoryMeshSource s;
+        s.mesh = mesh;
+        s.transform = Eigen::Matrix4d::Identity();
+        if (mesh->getImage() && mesh->getUVCoordinates())
+        {
+            s.textures.push_back({mesh->getImage(), mesh->getUVCoordinates()});
+        }
+        sources.push_back(s);
+        return export_meshes(name, sources);
+    }
+}
@@ -0,0 +1,212 @@
+#include "artec_scanner_simulated.h"
+
+#include <artec/sdk/base/IFrameMesh.h>
+#include <artec/sdk/base/IImage.h>
+#include <artec/sdk/base/IArrayPoint3F.h>
+#include <artec/sdk/base/IArrayIndexTriplet.h>
+#include <artec/sdk/base/IArrayUVCoordinates.h>
+#include <artec/sdk/base/TArrayRef.h>
+#include <artec/sdk/base/io/ObjIO.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+};
+using asdk::TRef;
+using asdk::TArrayRef;
+
+namespace RR=RobotRaconteur;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    SimulatedScannerBackend::SimulatedScannerBackend(const SimulatedScannerSettings& settings)
+    {
+        this->settings = settings;
+        if (settings.replay_path)
+        {
+            if (!boost::filesystem::is_directory(*settings.replay_path))
+            {
+                RR_ARTEC_LOG_ERROR("Simulated scanner replay path is not a directory: " << *settings.replay_path);
+                throw RR::InvalidArgumentException("Simulated scanner replay path is not a directory");
+            }
+            for (auto& e : boost::filesystem::directory_iterator(*settings.replay_path))
+            {
+                if (boost::algorithm::iequals(e.path().extension().string(), ".obj"))
+                {
+                    replay_files.push_back(e.path());
+                }
+            }
+            std::sort(replay_files.begin(), replay_files.end());
+            if (replay_files.empty())
+            {
+                RR_ARTEC_LOG_ERROR("No .obj frames found in simulated scanner replay path: " << *settings.replay_path);
+                throw RR::InvalidArgumentException("No .obj frames found in simulated scanner replay path");
+            }
+            RR_ARTEC_LOG_INFO("Simulated scanner replaying " << replay_files.size() << " frames from "
+                << *settings.replay_path);
+        }
+    }
+
+    std::string SimulatedScannerBackend::get_serial()
+    {
+        return "simulated";
+    }
+
+    ScannerFramePtr SimulatedScannerBackend::capture(bool with_texture)
+    {
+        if (settings.capture_latency_ms > 0)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(settings.capture_latency_ms));
+        }
+        auto frame = boost::make_shared<SimulatedScannerFrame>();
+        frame->frame_number = frame_count.fetch_add(1, boost::memory_order_relaxed);
+        frame->with_texture = with_texture;
+        return frame;
+    }
+
+    ScannerFrameProcessorPtr SimulatedScannerBackend::create_frame_processor()
+    {
+        return boost::make_shared<SimulatedFrameProcessor>(settings, replay_files);
+    }
+
+    asdk::IScanner* SimulatedScannerBackend::get_scanner()
+    {
+        return nullptr;
+    }
+
+    SimulatedFrameProcessor::SimulatedFrameProcessor(const SimulatedScannerSettings& settings,
+        const std::vector<boost::filesystem::path>& replay_files)
+    {
+        this->settings = settings;
+        this->replay_files = replay_files;
+    }
+
+    void SimulatedFrameProcessor::reconstruct(const ScannerFramePtr& frame, asdk::IFrameMesh** mesh)
+    {
+        auto sim_frame = RR_DYNAMIC_POINTER_CAST<SimulatedScannerFrame>(frame);
+        if (!sim_frame)
+        {
+            RR_ARTEC_LOG_ERROR("Frame was not captured by the simulated scanner");
+            throw RR::InvalidArgumentException("Frame was not captured by the simulated scanner");
+        }
+        *mesh = nullptr;
+        if (!replay_files.empty())
+        {
+            replay_frame(*sim_frame, mesh);
+        }
+        else
+        {
+            generate_frame(*sim_frame, mesh);
+        }
+    }
+
+    void SimulatedFrameProcessor::replay_frame(const SimulatedScannerFrame& frame, asdk::IFrameMesh** mesh)
+    {
+        auto& file_path = replay_files.at(frame.frame_number % replay_files.size());
+        RR_CALL_ARTEC(asdk::io::loadObjFrameFromFile(mesh, file_path.c_str()), "Error loading simulated frame");
+    }
+
+    void SimulatedFrameProcessor::generate_frame(const SimulatedScannerFrame& frame, asdk::IFrameMesh** mesh)
+    {
+        // Wavy surface patch 100 mm wide at a typical working distance. The phase advances with the
+        // frame number so consecutive frames differ.
+        const float width = 100.0f;
+        const float distance = 300.0f;
+        const float amplitude = 10.0f;
+        const float pi = 3.14159265f;
+
+        uint32_t n = std::max<uint32_t>(2, static_cast<uint32_t>(std::ceil(std::sqrt((double)settings.vertex_count))));
+        uint32_t points_count = n * n;
+        uint32_t triangles_count = 2 * (n - 1) * (n - 1);
+        float phase = 0.05f * frame.frame_number;
+
+        std::mt19937 rng(frame.frame_number);
+        std::normal_distribution<float> noise(0.0f, static_cast<float>(settings.noise));
+
+        TArrayRef<asdk::IArrayPoint3F> points;
+        RR_CALL_ARTEC(asdk::createArrayPoint3F(&points, points_count), "Error allocating simulated points");
+        TArrayRef<asdk::IArrayIndexTriplet> triangles;
+        RR_CALL_ARTEC(asdk::createArrayIndexTriplet(&triangles, triangles_count),
+            "Error allocating simulated triangles");
+        TArrayRef<asdk::IArrayUVCoordinates> uvs;
+        if (frame.with_texture)
+        {
+            RR_CALL_ARTEC(asdk::createArrayUVCoordinates(&uvs, points_count), "Error allocating simulated uvs");
+        }
+
+        for (uint32_t j=0; j<n; j++)
+        {
+            for (uint32_t i=0; i<n; i++)
+            {
+                float u = static_cast<float>(i) / (n - 1);
+                float v = static_cast<float>(j) / (n - 1);
+                float x = (u - 0.5f) * width;
+                float y = (v - 0.5f) * width;
+                auto& p = points[j*n + i];
+                p.x = x;
+                p.y = y;
+                p.z = distance + amplitude * std::sin(2.0f * pi * x / 50.0f + phase) * std::cos(2.0f * pi * y / 50.0f)
+                    + (settings.noise > 0 ? noise(rng) : 0.0f);
+                if (frame.with_texture)
+                {
+                    auto& uv = uvs[j*n + i];
+                    uv.u = u;
+                    uv.v = v;
+                }
+            }
+        }
+
+        uint32_t t = 0;
+        for (uint32_t j=0; j<n-1; j++)
+        {
+            for (uint32_t i=0; i<n-1; i++)
+            {
+                int v0 = j*n + i;
+                int v1 = v0 + 1;
+                int v2 = v0 + n;
+                int v3 = v2 + 1;
+                auto& t1 = triangles[t++];
+                t1.x = v0; t1.y = v2; t1.z = v1;
+                auto& t2 = triangles[t++];
+                t2.x = v1; t2.y = v2; t2.z = v3;
+            }
+        }
+
+        TRef<asdk::IFrameMesh> ret;
+        RR_CALL_ARTEC(asdk::createFrameMesh(&ret), "Error creating simulated frame mesh");
+        ret->setPoints(points);
+        ret->setTriangles(triangles);
+
+        if (frame.with_texture && settings.texture_size > 0)
+        {
+            TRef<asdk::IImage> img;
+            int size = static_cast<int>(settings.texture_size);
+            RR_CALL_ARTEC(asdk::createImage(&img, size, size, asdk::PixelFormat_RGB),
+                "Error creating simulated texture");
+            auto data = static_cast<uint8_t*>(img->getPointer());
+            int pitch = img->getPitch();
+            for (int y=0; y<size; y++)
+            {
+                uint8_t* row = data + y * pitch;
+                for (int x=0; x<size; x++)
+                {
+                    uint8_t checker = ((x / 64) + (y / 64)) % 2 ? 200 : 60;
+                    row[x*3] = checker;
+                    row[x*3+1] = static_cast<uint8_t>((x * 255) / size);
+                    row[x*3+2] = static_cast<uint8_t>((y * 255) / size);
+                }
+            }
+            ret->setImage(img);
+            ret->setUVCoordinates(uvs);
+        }
+
+        *mesh = ret;
+        (*mesh)->ref();
+    }
+}
@@ -9,13 +9,34 @@
 #include <artec/sdk/base/io/StlIO.h>
 #include <artec/sdk/base/IFrameMesh.h>
 #include <artec/sdk/base/TArrayRef.h>
+#include <artec/sdk/base/IArrayPoint3F.h>
+#include <artec/sdk/base/IArrayIndexTriplet.h>
 #include <artec/sdk/base/io/PngIO.h>
 #include <artec/sdk/base/ITexture.h>
+#include <artec/sdk/base/IModel.h>
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/base/ICompositeContainer.h>
+#include <artec/sdk/base/ICompositeMesh.h>
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 #include <RobotRaconteurCompanion/Converters/EigenConverters.h>
 #include <boost/filesystem.hpp>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <zlib.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
 namespace asdk {
     using namespace artec::sdk::base;
     using namespace artec::sdk::capturing;
@@ -27,6 +48,7 @@ namespace rr_geom = com::robotraconteur::geometry;
 namespace rr_shapes = com::robotraconteur::geometry::shapes;
 namespace rr_image = com::robotraconteur::image;
 namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
 
 namespace artec_scanner_robotraconteur_driver
 {
@@ -176,6 +198,78 @@ namespace artec_scanner_robotraconteur_driver
         return ret;
     }
 
+    static RR::RRArrayPtr<float> points3f_to_buffer(asdk::IArrayPoint3F* points)
+    {
+        static_assert(sizeof(asdk::Point3F) == 3 * sizeof(float), "Point3F must be three packed floats");
+        size_t count = points ? static_cast<size_t>(points->getSize()) : 0;
+        auto ret = RR::AllocateRRArray<float>(count * 3);
+        if (count > 0)
+        {
+            std::memcpy(ret->data(), points->getPointer(), count * sizeof(asdk::Point3F));
+        }
+        return ret;
+    }
+
+    static RR::RRArrayPtr<float> uv_coords_to_buffer(asdk::IArrayUVCoordinates* uv)
+    {
+        static_assert(sizeof(asdk::UVCoordinates) == 2 * sizeof(float), "UVCoordinates must be two packed floats");
+        size_t count = static_cast<size_t>(uv->getSize());
+        auto ret = RR::AllocateRRArray<float>(count * 2);
+        if (count > 0)
+        {
+            std::memcpy(ret->data(), uv->getPointer(), count * sizeof(asdk::UVCoordinates));
+        }
+        return ret;
+    }
+
+    static rr_artec::MeshBuffersPtr fill_mesh_buffers(asdk::IMesh* mesh)
+    {
+        static_assert(sizeof(asdk::IndexTriplet) == 3 * sizeof(uint32_t), "IndexTriplet must be three packed ints");
+        auto ret = rr_artec::MeshBuffersPtr(new rr_artec::MeshBuffers());
+        ret->vertices = points3f_to_buffer(mesh->getPoints());
+        mesh->calculate( asdk::CM_Normals );
+        ret->normals = points3f_to_buffer(mesh->getPointsNormals());
+        asdk::IArrayIndexTriplet* triangles = mesh->getTriangles();
+        size_t triangle_count = triangles ? static_cast<size_t>(triangles->getSize()) : 0;
+        ret->triangles = RR::AllocateRRArray<uint32_t>(triangle_count * 3);
+        if (triangle_count > 0)
+        {
+            std::memcpy(ret->triangles->data(), triangles->getPointer(), triangle_count * sizeof(asdk::IndexTriplet));
+        }
+        ret->textures = RR::AllocateEmptyRRList<rr_artec::MeshBufferTexture>();
+        return ret;
+    }
+
+    rr_artec::MeshBuffersPtr ConvertArtecFrameMeshToBuffers(artec::sdk::base::IFrameMesh* mesh)
+    {
+        auto ret = fill_mesh_buffers(mesh);
+        asdk::IImage* img = mesh->getImage();
+        asdk::IArrayUVCoordinates* uv = mesh->getUVCoordinates();
+        if (img != nullptr && uv != nullptr)
+        {
+            auto tex = rr_artec::MeshBufferTexturePtr(new rr_artec::MeshBufferTexture());
+            tex->uvs = uv_coords_to_buffer(uv);
+            tex->image = convert_texture(img);
+            ret->textures->push_back(tex);
+        }
+        return ret;
+    }
+
+    rr_artec::MeshBuffersPtr ConvertArtecCompositeMeshToBuffers(artec::sdk::base::ICompositeMesh* mesh)
+    {
+        auto ret = fill_mesh_buffers(mesh);
+        auto c = mesh->getTexturesCount();
+        for (int i=0; i<c; i++)
+        {
+            auto t = mesh->getTexture(i);
+            auto tex = rr_artec::MeshBufferTexturePtr(new rr_artec::MeshBufferTexture());
+            tex->uvs = uv_coords_to_buffer(t->getUVCoordinates());
+            tex->image = convert_texture(t->getImage());
+            ret->textures->push_back(tex);
+        }
+        return ret;
+    }
+
     RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToStlBytes(artec::sdk::base::IMesh* mesh)
     {
         boost::filesystem::path temp = boost::filesystem::unique_path();
@@ -195,9 +289,199 @@ namespace artec_scanner_robotraconteur_driver
         return ret;
     }   
 
+    static inline void compact_put_varint(std::vector<uint8_t>& out, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    template<typename T>
+    static inline void compact_put(std::vector<uint8_t>& out, T v)
+    {
+        const uint8_t* b = reinterpret_cast<const uint8_t*>(&v);
+        out.insert(out.end(), b, b + sizeof(T));
+    }
+
+    static inline int8_t compact_oct_component(float v)
+    {
+        return static_cast<int8_t>(std::lround(std::max(-1.0f, std::min(1.0f, v)) * 127.0f));
+    }
+
+    RobotRaconteur::RRArrayPtr<uint8_t> ConvertArtecMeshToCompactBytes(artec::sdk::base::IMesh* mesh,
+        double precision, bool compress)
+    {
+        if (!(precision > 0.0))
+        {
+            precision = CompactMeshDefaultPrecision;
+        }
+
+        asdk::IArrayPoint3F* points = mesh->getPoints();
+        asdk::IArrayIndexTriplet* triangles = mesh->getTriangles();
+        uint32_t vertex_count = points ? static_cast<uint32_t>(points->getSize()) : 0;
+        uint32_t triangle_count = triangles ? static_cast<uint32_t>(triangles->getSize()) : 0;
+        const asdk::Point3F* p = vertex_count > 0 ? points->getPointer() : nullptr;
+
+        mesh->calculate( asdk::CM_Normals );
+        asdk::IArrayPoint3F* normals = mesh->getPointsNormals();
+        bool has_normals = normals && static_cast<uint32_t>(normals->getSize()) == vertex_count && vertex_count > 0;
+
+        double origin[3] = {0.0, 0.0, 0.0};
+        double extent = 0.0;
+        if (vertex_count > 0)
+        {
+            double lo[3] = {p[0].x, p[0].y, p[0].z};
+            double hi[3] = {p[0].x, p[0].y, p[0].z};
+            for (uint32_t i=1; i<vertex_count; i++)
+            {
+                const float v[3] = {p[i].x, p[i].y, p[i].z};
+                for (int k=0; k<3; k++)
+                {
+                    lo[k] = std::min(lo[k], static_cast<double>(v[k]));
+                    hi[k] = std::max(hi[k], static_cast<double>(v[k]));
+                }
+            }
+            for (int k=0; k<3; k++)
+            {
+                origin[k] = lo[k];
+                extent = std::max(extent, hi[k] - lo[k]);
+            }
+        }
+        double max_q = std::ceil(extent / precision);
+        if (max_q > static_cast<double>(UINT32_MAX))
+        {
+            RR_ARTEC_LOG_ERROR("Compact mesh precision " << precision << " is too small for mesh extent " << extent);
+            throw RR::InvalidArgumentException("Compact mesh precision too small for mesh");
+        }
+        uint8_t position_bytes = max_q <= static_cast<double>(UINT16_MAX) ? 2 : 4;
+
+        std::vector<uint8_t> payload;
+        payload.reserve(static_cast<size_t>(vertex_count) * (3 * position_bytes + 2)
+            + static_cast<size_t>(triangle_count) * 4);
+        for (uint32_t i=0; i<vertex_count; i++)
+        {
+            const float v[3] = {p[i].x, p[i].y, p[i].z};
+            for (int k=0; k<3; k++)
+            {
+                uint32_t q = static_cast<uint32_t>(std::llround((v[k] - origin[k]) / precision));
+                if (position_bytes == 2)
+                {
+                    compact_put<uint16_t>(payload, static_cast<uint16_t>(std::min<uint32_t>(q, UINT16_MAX)));
+                }
+                else
+                {
+                    compact_put<uint32_t>(payload, q);
+                }
+            }
+        }
+
+        if (has_normals)
+        {
+            const asdk::Point3F* n = normals->getPointer();
+            for (uint32_t i=0; i<vertex_count; i++)
+            {
+                float x = n[i].x;
+                float y = n[i].y;
+                float z = n[i].z;
+                float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+                if (!(l1 > 0.0f))
+                {
+                    x = 0.0f;
+                    y = 0.0f;
+                    z = 1.0f;
+                    l1 = 1.0f;
+                }
+                x /= l1;
+                y /= l1;
+                if (z < 0.0f)
+                {
+                    float ox = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                    float oy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                    x = ox;
+                    y = oy;
+                }
+                payload.push_back(static_cast<uint8_t>(compact_oct_component(x)));
+                payload.push_back(static_cast<uint8_t>(compact_oct_component(y)));
+            }
+        }
+
+        if (triangle_count > 0)
+        {
+            const asdk::IndexTriplet* t = triangles->getPointer();
+            int64_t last = 0;
+            for (uint32_t i=0; i<triangle_count; i++)
+            {
+                const int64_t ind[3] = {t[i].x, t[i].y, t[i].z};
+                for (int k=0; k<3; k++)
+                {
+                    int64_t d = ind[k] - last;
+                    last = ind[k];
+                    compact_put_varint(payload, (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63));
+                }
+            }
+        }
+
+        std::vector<uint8_t> stored;
+        if (compress)
+        {
+            uLongf stored_size = compressBound(static_cast<uLong>(payload.size()));
+            stored.resize(stored_size);
+            if (compress2(stored.data(), &stored_size, payload.data(), static_cast<uLong>(payload.size()),
+                Z_DEFAULT_COMPRESSION) != Z_OK)
+            {
+                RR_ARTEC_LOG_ERROR("Could not deflate compact mesh");
+                throw RR::OperationFailedException("Could not deflate compact mesh");
+            }
+            stored.resize(stored_size);
+        }
+        else
+        {
+            stored.swap(payload);
+        }
+
+        // Header is 56 bytes, little endian
+        std::vector<uint8_t> header;
+        header.reserve(56);
+        header.insert(header.end(), {'A', 'C', 'M', 'F'});
+        header.push_back(1);
+        header.push_back(static_cast<uint8_t>((has_normals ? 0x1 : 0) | (compress ? 0x2 : 0)));
+        header.push_back(position_bytes);
+        header.push_back(0);
+        compact_put<uint32_t>(header, vertex_count);
+        compact_put<uint32_t>(header, triangle_count);
+        compact_put<double>(header, precision);
+        for (int k=0; k<3; k++)
+        {
+            compact_put<double>(header, origin[k]);
+        }
+        compact_put<uint32_t>(header, static_cast<uint32_t>(compress ? payload.size() : stored.size()));
+        compact_put<uint32_t>(header, static_cast<uint32_t>(stored.size()));
+
+        auto ret = RR::AllocateRRArray<uint8_t>(header.size() + stored.size());
+        std::memcpy(ret->data(), header.data(), header.size());
+        if (!stored.empty())
+        {
+            std::memcpy(ret->data() + header.size(), stored.data(), stored.size());
+        }
+        return ret;
+    }
+
     com::robotraconteur::geometry::Transform ConvertArtecTransformToRR(const artec::sdk::base::Matrix4x4D& transform)
     {
-        Eigen::Matrix4d e_mat = Eigen::Map<const Eigen::Matrix4d>(transform.getData(), 4, 4);
+        return ConvertEigenTransformToRR(ConvertArtecTransformToEigen(transform));
+    }
+
+    Eigen::Matrix4d ConvertArtecTransformToEigen(const artec::sdk::base::Matrix4x4D& transform)
+    {
+        return Eigen::Map<const Eigen::Matrix4d>(transform.getData(), 4, 4);
+    }
+
+    com::robotraconteur::geometry::Transform ConvertEigenTransformToRR(const Eigen::Matrix4d& transform)
+    {
+        Eigen::Matrix4d e_mat = transform;
         // Convert mm to m
         e_mat(0,3) *= 0.001;
         e_mat(1,3) *= 0.001;
@@ -318,4 +602,234 @@ namespace artec_scanner_robotraconteur_driver
         ArtecErrorCodeMessage(ec, msg, suberr);
         return "Artec Error ("+ boost::lexical_cast<std::string>(ec) + ") " + suberr + ": " + msg;
     }
+
+    size_t CopyModelFramesShallow(asdk::IModel* src, asdk::IModel* dst, const std::vector<int>& first_frames,
+        std::vector<int>* end_frames)
+    {
+        size_t frame_count = 0;
+        int scan_count = src->getSize();
+        if (end_frames)
+        {
+            end_frames->assign(scan_count, 0);
+        }
+        for (int i=0; i<scan_count; i++)
+        {
+            asdk::IScan* src_scan = src->getElement(i);
+            int first_frame = 0;
+            if (i < (int)first_frames.size())
+            {
+                first_frame = first_frames.at(i);
+            }
+            int src_frame_count = src_scan->getSize();
+            if (end_frames)
+            {
+                end_frames->at(i) = src_frame_count;
+            }
+            if (first_frame >= src_frame_count)
+            {
+                continue;
+            }
+
+            TRef<asdk::IScan> dst_scan;
+            RR_CALL_ARTEC(asdk::createScan(&dst_scan), "Error creating scan");
+            dst_scan->setScannerType(src_scan->getScannerType());
+            dst_scan->setScanTransformation(src_scan->getScanTransformation());
+
+            for (int j=first_frame; j<src_frame_count; j++)
+            {
+                dst_scan->add(src_scan->getElement(j), src_scan->getTransformation(j));
+                frame_count++;
+            }
+            dst->add(dst_scan);
+        }
+        return frame_count;
+    }
+
+    static size_t estimate_mesh_bytes(asdk::IMesh* mesh)
+    {
+        size_t bytes = 0;
+        if (auto points = mesh->getPoints())
+        {
+            bytes += points->getSize() * sizeof(asdk::Point3F);
+        }
+        if (auto normals = mesh->getPointsNormals())
+        {
+            bytes += normals->getSize() * sizeof(asdk::Point3F);
+        }
+        if (auto triangles = mesh->getTriangles())
+        {
+            bytes += triangles->getSize() * sizeof(asdk::IndexTriplet);
+        }
+        return bytes;
+    }
+
+    static size_t estimate_texture_bytes(asdk::IImage* img, asdk::IArrayUVCoordinates* uv)
+    {
+        size_t bytes = 0;
+        if (img)
+        {
+            bytes += static_cast<size_t>(img->getPitch()) * img->getHeight();
+        }
+        if (uv)
+        {
+            bytes += uv->getSize() * sizeof(asdk::UVCoordinates);
+        }
+        return bytes;
+    }
+
+    size_t EstimateModelBytes(asdk::IModel* model)
+    {
+        return EstimateModelMemory(model).bytes;
+    }
+
+    static void count_mesh_geometry(asdk::IMesh* mesh, uint64_t& vertex_count, uint64_t& triangle_count);
+
+    ModelMemoryEstimate EstimateModelMemory(asdk::IModel* model)
+    {
+        ModelMemoryEstimate ret;
+        int scan_count = model->getSize();
+        for (int i=0; i<scan_count; i++)
+        {
+            asdk::IScan* scan = model->getElement(i);
+            int frame_count = scan->getSize();
+            for (int j=0; j<frame_count; j++)
+            {
+                asdk::IFrameMesh* mesh = scan->getElement(j);
+                if (!mesh) continue;
+                ret.frame_count++;
+                count_mesh_geometry(mesh, ret.vertex_count, ret.triangle_count);
+                ret.bytes += estimate_mesh_bytes(mesh);
+                ret.texture_bytes += estimate_texture_bytes(mesh->getImage(), mesh->getUVCoordinates());
+            }
+        }
+
+        asdk::ICompositeContainer* container = model->getCompositeContainer();
+        if (container)
+        {
+            int mesh_count = container->getSize();
+            for (int i=0; i<mesh_count; i++)
+            {
+                asdk::ICompositeMesh* mesh = container->getElement(i);
+                if (!mesh) continue;
+                count_mesh_geometry(mesh, ret.vertex_count, ret.triangle_count);
+                ret.bytes += estimate_mesh_bytes(mesh);
+                int texture_count = mesh->getTexturesCount();
+                for (int j=0; j<texture_count; j++)
+                {
+                    auto tex = mesh->getTexture(j);
+                    ret.texture_bytes += estimate_texture_bytes(tex->getImage(), tex->getUVCoordinates());
+                }
+            }
+        }
+        ret.bytes += ret.texture_bytes;
+        return ret;
+    }
+
+    size_t EstimateRRMeshBytes(const rr_shapes::MeshPtr& mesh)
+    {
+        if (!mesh)
+        {
+            return 0;
+        }
+        size_t bytes = 0;
+        if (mesh->vertices) bytes += mesh->vertices->size() * sizeof(rr_geom::Point);
+        if (mesh->normals) bytes += mesh->normals->size() * sizeof(rr_geom::Vector3);
+        if (mesh->triangles) bytes += mesh->triangles->size() * sizeof(rr_shapes::MeshTriangle);
+        if (mesh->textures)
+        {
+            for (auto& tex : *mesh->textures)
+            {
+                if (!tex) continue;
+                if (tex->uvs) bytes += tex->uvs->size() * sizeof(rr_geom::Vector2);
+                if (tex->image && tex->image->data) bytes += tex->image->data->size();
+            }
+        }
+        return bytes;
+    }
+
+    size_t GetResidentBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return 0;
+        }
+        return counters.WorkingSetSize;
+#else
+        std::ifstream statm("/proc/self/statm");
+        size_t size = 0;
+        size_t resident = 0;
+        if (!(statm >> size >> resident))
+        {
+            return 0;
+        }
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    static void count_mesh_geometry(asdk::IMesh* mesh, uint64_t& vertex_count, uint64_t& triangle_count)
+    {
+        if (auto points = mesh->getPoints())
+        {
+            vertex_count += points->getSize();
+        }
+        if (auto triangles = mesh->getTriangles())
+        {
+            triangle_count += triangles->getSize();
+        }
+    }
+
+    void CountModelGeometry(asdk::IModel* model, uint64_t& vertex_count, uint64_t& triangle_count)
+    {
+        vertex_count = 0;
+        triangle_count = 0;
+        int scan_count = model->getSize();
+        for (int i=0; i<scan_count; i++)
+        {
+            asdk::IScan* scan = model->getElement(i);
+            int frame_count = scan->getSize();
+            for (int j=0; j<frame_count; j++)
+            {
+                asdk::IFrameMesh* mesh = scan->getElement(j);
+                if (!mesh) continue;
+                count_mesh_geometry(mesh, vertex_count, triangle_count);
+            }
+        }
+
+        asdk::ICompositeContainer* container = model->getCompositeContainer();
+        if (container)
+        {
+            int mesh_count = container->getSize();
+            for (int i=0; i<mesh_count; i++)
+            {
+                asdk::ICompositeMesh* mesh = container->getElement(i);
+                if (!mesh) continue;
+                count_mesh_geometry(mesh, vertex_count, triangle_count);
+            }
+        }
+    }
+
+    double GetProcessCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation_time, exit_time, kernel_time, user_time;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+        {
+            return 0.0;
+        }
+        auto to_100ns = [](const FILETIME& t) {
+            return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+        };
+        return static_cast<double>(to_100ns(kernel_time) + to_100ns(user_time)) * 1e-7;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0.0;
+        }
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+    }
 }
\ No newline at end of file
@@ -7,6 +7,9 @@
 #include <artec/sdk/capturing/IFrameProcessor.h>
 #include <artec/sdk/capturing/IFrame.h>
 
+#include <algorithm>
+#include <map>
+
 namespace asdk {
     using namespace artec::sdk::base;
     using namespace artec::sdk::capturing;
@@ -24,9 +27,15 @@ namespace rr_artec = experimental::artec_scanner;
 namespace artec_scanner_robotraconteur_driver
 {
     DeferredCapturePrepare::DeferredCapturePrepare(boost::shared_ptr<ArtecScannerImpl> parent)
-        : data_lock(parent->this_lock)
+        : QueuedJobGenerator("deferred_capture_prepare", "Prepare deferred captures", true),
+        data_lock(parent->this_lock)
     {
-        this->scanner = parent->scanner;
+        for (uint32_t i=0; i<parent->get_scanner_count(); i++)
+        {
+            this->processor_pools.push_back(parent->get_device(i)->processor_pool);
+        }
+        this->cpu_budget = parent->cpu_budget;
+        this->job_manager = parent->job_manager;
         this->parent=parent;
     }
 
@@ -48,20 +57,21 @@ namespace artec_scanner_robotraconteur_driver
     }
 
     
-    void DeferredCapturePrepare::prepare()
+    void DeferredCapturePrepare::start_job()
     {
+        started = true;
         auto this_ = shared_from_this();
-        active_thread_count = boost::thread::hardware_concurrency();
-        for( unsigned i = 0; i < boost::thread::hardware_concurrency(); i++ )
+        // Each reconstruction uses one thread, so do not request more threads than frames
+        cpu_lease = cpu_budget->Acquire(static_cast<uint32_t>(std::max<size_t>(1, input_data.size())));
+        active_thread_count = cpu_lease->get_threads();
+        RR_ARTEC_LOG_INFO("Preparing deferred captures with " << active_thread_count << " threads");
+        for( unsigned i = 0; i < active_thread_count; i++ )
         {
             thread_pool.create_thread( [this_]
             {
-                // Initialize a frame processor 
-                TRef<asdk::IFrameProcessor> processor;
-                if( this_->scanner->createFrameProcessor( &processor ) != asdk::ErrorCode_OK )
-                {
-                    return;
-                }
+                // Frame processor of each scanner is taken from its pool on first use and reused for the rest
+                // of the work
+                std::map<uint32_t, ScannerFrameProcessorPtr> processors;
                 while(true)
                 {
                     RRDeferredCapturePtr work;
@@ -73,10 +83,19 @@ namespace artec_scanner_robotraconteur_driver
                             this_->active_thread_count--;
                             if (this_->active_thread_count == 0)
                             {
+                                this_->cpu_lease.reset();
+                                this_->job_ticket.reset();
                                 this_->prepare_completed = true;
-                                if (this_->next_handler)
+                                auto h = this_->next_handler;
+                                this_->next_handler.clear();
+                                if (h)
                                 {
-                                    this_->complete_gen(this_->next_handler);
+                                    try
+                                    {
+                                        this_->next_timer->Stop();
+                                    }
+                                    catch (std::exception&) {}
+                                    this_->complete_gen(h);
                                 }
                             }
                             return;
@@ -93,13 +112,13 @@ namespace artec_scanner_robotraconteur_driver
                     try
                     {
                         
-                        TRef<asdk::IFrameProcessor> processor;
-                        if ( this_->scanner->createFrameProcessor( &processor ) != asdk::ErrorCode_OK )
+                        auto& processor = processors[work->scanner_index];
+                        if (!processor)
                         {
-                            return;
+                            processor = this_->processor_pools.at(work->scanner_index)->Acquire();
                         }
                         asdk::TRef<asdk::IFrameMesh> frame_mesh;
-                        RR_CALL_ARTEC(processor->reconstructAndTexturizeMesh(&frame_mesh, work->frame ), "Error reconstructing mesh");
+                        processor->reconstruct(work->frame, &frame_mesh);
                         
                         rr_shapes::MeshPtr rr_mesh;
                         if (this_->mesh)
@@ -141,73 +160,23 @@ namespace artec_scanner_robotraconteur_driver
                 }
             });
         }
+        RR_ARTEC_LOG_INFO("Started prepare deferred captures job " << job_id)
     }
 
-    void DeferredCapturePrepare::AsyncNext(boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
-        const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout)
-    {
-        boost::mutex::scoped_lock lock(this_lock);
-        if (aborted)
-        {
-            throw RR::OperationAbortedException("Scanning Procedure operation was aborted");
-        }
-        if ((closed && !started) || completed)
-        {
-            throw RR::StopIterationException("");
-        }
-
-        if (!started)
-        {
-            prepare();
-            auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->completed_count = completed_count;
-            ret->failed_count = failed_count;
-            RR_ARTEC_LOG_INFO("Started prepare deferred captures")
-            lock.unlock();
-            handler(ret, nullptr);
-            return;
-        }
-
-        if (next_handler)
-        {
-            throw RR::InvalidOperationException("Next call already in progress");
-        }
-
-        if (prepare_completed)
-        {
-            complete_gen(handler);
-            return;
-        }
-
-        next_handler = handler;
-
-        RR_WEAK_PTR<DeferredCapturePrepare> weak_this = shared_from_this();
-        next_timer = RR::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5), 
-            [weak_this](const RR::TimerEvent& evt) {
-                auto t = weak_this.lock();
-                if (!t) return;
-                t->next_timer_handler(evt);
-        }, true);
-        next_timer->Start();
-    }
-
-    void DeferredCapturePrepare::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                    int32_t timeout)
+    bool DeferredCapturePrepare::job_complete()
     {
-        boost::mutex::scoped_lock lock(this_lock);
-        closed = true;
-        lock.unlock();
-        handler(nullptr);
+        return prepare_completed;
     }
 
-    void DeferredCapturePrepare::AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                    int32_t timeout)
+    rr_artec::DeferredCapturePrepareStatusPtr DeferredCapturePrepare::running_status()
     {
-        boost::mutex::scoped_lock lock(this_lock);
-        aborted = true;
-        lock.unlock();
-        handler(nullptr);
+        auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
+        ret->action_status = started ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::queued;
+        ret->completed_count = completed_count;
+        ret->failed_count = failed_count;
+        ret->job_id = job_id;
+        ret->queue_position = started ? 0 : job_manager->GetQueuePosition(job_id);
+        return ret;
     }
 
     void DeferredCapturePrepare::complete_gen(boost::function<void(const experimental::artec_scanner::DeferredCapturePrepareStatusPtr&,
@@ -221,23 +190,9 @@ namespace artec_scanner_robotraconteur_driver
         ret->action_status = rr_action::ActionStatusCode::complete;
         ret->completed_count = completed_count;
         ret->failed_count = failed_count;
+        ret->job_id = job_id;
+        ret->queue_position = 0;
         handler(ret,nullptr);
     }
 
-    void DeferredCapturePrepare::next_timer_handler(const RobotRaconteur::TimerEvent& evt)
-    {
-        boost::mutex::scoped_lock lock(this_lock);
-        auto h = next_handler;
-        next_handler.clear();
-        if (h)
-        {
-            auto ret = rr_artec::DeferredCapturePrepareStatusPtr(new rr_artec::DeferredCapturePrepareStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->completed_count = completed_count;
-            ret->failed_count = failed_count;
-            h(ret, nullptr);
-            return;
-        }
-    }
-
 }
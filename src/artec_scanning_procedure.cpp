@@ -44,26 +44,35 @@ namespace artec_scanner_robotraconteur_driver
     }
     
     ScanningProcedure::ScanningProcedure(boost::shared_ptr<ArtecScannerImpl> parent)
+        : QueuedJobGenerator("run_scanning_procedure", "Scanning Procedure", true)
     {
         this->parent = parent;
     }
 
-    void ScanningProcedure::Init(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings)
+    void ScanningProcedureSettingsToArtec(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings,
+        asdk::ScanningProcedureSettings& desc)
     {
         RR_NULL_CHECK(settings);
-        asdk::ScanningProcedureSettings desc = { 0 };
         desc.maxFrameCount = settings->max_frame_count;
         desc.registrationType = (asdk::RegistrationAlgorithmType)settings->registration_type;
         desc.pipelineConfiguration = settings->pipeline_configuration;
         desc.initialState = (asdk::ScanningState)settings->initial_state;
-        observer = boost::make_shared<ScanningProcedureObserver>(shared_from_this());
-        desc.scanningCallback = observer.get();
         desc.ignoreRegistrationErrors = settings->ignore_registration_errors.value != 0;
         desc.captureTexture = (asdk::CaptureTextureMethod)settings->capture_texture;
         desc.captureTextureFrequency = settings->capture_texture_frequency;
         desc.saveEmptySurfaces = settings->save_empty_surfaces.value != 0;
+    }
+
+    void ScanningProcedure::Init(const experimental::artec_scanner::ScanningProcedureSettingsPtr& settings,
+        asdk::IScanner* scanner)
+    {
+        RR_NULL_CHECK(settings);
+        asdk::ScanningProcedureSettings desc = { 0 };
+        ScanningProcedureSettingsToArtec(settings, desc);
+        observer = boost::make_shared<ScanningProcedureObserver>(shared_from_this());
+        desc.scanningCallback = observer.get();
 
-        RR_CALL_ARTEC(asdk::createScanningProcedure(&this->scanning_procedure, GetParent()->scanner, &desc), 
+        RR_CALL_ARTEC(asdk::createScanningProcedure(&this->scanning_procedure, scanner, &desc), 
             "Error creating scanning procedure");
 
         model = boost::make_shared<RRArtecModel>();        
@@ -75,113 +84,91 @@ namespace artec_scanner_robotraconteur_driver
         workset.cancellation = ct_source->getToken();
         workset.progress = nullptr;
         workset.threadsCount = 0;        
+
+        snapshot_queue.SetDirect(model->model);
+        job_manager = GetParent()->job_manager;
+        job_priority = settings->job_priority;
     }
 
-    void ScanningProcedure::AsyncNext(boost::function<void(const experimental::artec_scanner::ScanningProcedureStatusPtr&,
-        const RobotRaconteur::RobotRaconteurExceptionPtr&)> handler, int32_t timeout )
+    bool ScanningProcedure::IsScanning()
     {
         boost::mutex::scoped_lock lock(this_lock);
-        if (aborted)
-        {
-            throw RR::OperationAbortedException("Scanning Procedure operation was aborted");
-        }
-        if ((closed && !started) || completed)
-        {
-            throw RR::StopIterationException("");
-        }
-
-        if (!started)
-        {
-            job_observer = RR_MAKE_SHARED<ScanningProcedureJobObserver>(shared_from_this());
-            auto launch_res = asdk::launchJob(scanning_procedure, &workset, job_observer.get());
-            if (launch_res != asdk::ErrorCode_OK)
-            {
-                job_observer.reset();
-            }
-            RR_CALL_ARTEC(launch_res, "Error launching scanning procedure");
-            started = true;
-            auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->model_handle = 0;
-            RR_ARTEC_LOG_INFO("Started scanning procedure")
-            lock.unlock();
-            handler(ret, nullptr);
-            return;
-        }
+        return started && !artec_job_complete;
+    }
 
-        if (next_handler)
+    boost::shared_ptr<RRArtecModel> ScanningProcedure::Snapshot()
+    {
+        auto snapshot_model = boost::make_shared<RRArtecModel>();
+        size_t snapshot_frame_count = 0;
+        if (!snapshot_queue.Snapshot(snapshot_model->model, std::vector<int>(), boost::posix_time::seconds(5), 
+            snapshot_frame_count))
         {
-            throw RR::InvalidOperationException("Next call already in progress");
+            RR_ARTEC_LOG_ERROR("Timed out waiting for scanning procedure snapshot");
+            throw RR::OperationFailedException("Timed out waiting for scanning procedure snapshot");
         }
+        RR_ARTEC_LOG_INFO("Scanning procedure snapshot contains " << snapshot_frame_count << " frames");
+        return snapshot_model;
+    }
 
-        if (artec_job_complete)
+    void ScanningProcedure::start_job()
+    {
+        job_observer = RR_MAKE_SHARED<ScanningProcedureJobObserver>(shared_from_this());
+        snapshot_queue.SetRunning(model->model);
+        // Reserves a small fixed number of threads for real time registration, so concurrent algorithms keep
+        // their share of the rest
+        cpu_lease = GetParent()->cpu_budget->AcquireRealtime();
+        auto launch_res = asdk::launchJob(scanning_procedure, &workset, job_observer.get());
+        if (launch_res != asdk::ErrorCode_OK)
         {
-            complete_gen(handler);
-            return;
+            job_observer.reset();
+            cpu_lease.reset();
+            job_ticket.reset();
+            snapshot_queue.SetDirect(model->model);
         }
+        RR_CALL_ARTEC(launch_res, "Error launching scanning procedure");
+        started = true;
+        GetParent()->add_scanning_procedure(job_id, shared_from_this());
+        RR_ARTEC_LOG_INFO("Started scanning procedure job " << job_id)
+    }
 
-        next_handler = handler;
-
-        RR_WEAK_PTR<ScanningProcedure> weak_this = shared_from_this();
-        next_timer = RR::RobotRaconteurNode::s()->CreateTimer(boost::posix_time::seconds(5), 
-            [weak_this](const RR::TimerEvent& evt) {
-                auto t = weak_this.lock();
-                if (!t) return;
-                t->next_timer_handler(evt);
-        }, true);
-        next_timer->Start();
+    bool ScanningProcedure::job_complete()
+    {
+        return artec_job_complete;
     }
-        
 
-    void ScanningProcedure::AsyncClose(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                    int32_t timeout)
+    void ScanningProcedure::stop_job(bool abort)
     {
-        boost::mutex::scoped_lock lock(this_lock);
-        if (closed || aborted)
-        {
-            lock.unlock();
-            handler(nullptr);
-            return;
-        }
-        closed = true;
         if (started)
         {
-            RR_ARTEC_LOG_INFO("Stopping scanner procedure from Close");
-            RR_CALL_ARTEC(scanning_procedure->setState(asdk::ScanningState::ScanningState_Stop), 
+            RR_ARTEC_LOG_INFO("Stopping scanner procedure from " << (abort ? "Abort" : "Close"));
+            RR_CALL_ARTEC(scanning_procedure->setState(asdk::ScanningState::ScanningState_Stop),
                 "Error stopping scanning procedure");
         }
-        lock.unlock();
-        handler(nullptr);
     }
 
-    void ScanningProcedure::AsyncAbort(boost::function<void(const RobotRaconteur::RobotRaconteurExceptionPtr& err)> handler,
-                    int32_t timeout)
+    rr_artec::ScanningProcedureStatusPtr ScanningProcedure::running_status()
     {
-        boost::mutex::scoped_lock lock(this_lock);
-        if (closed || aborted)
-        {
-            lock.unlock();
-            handler(nullptr);
-            return;
-        }
-        aborted = true;
-        if (started)
-        {
-            RR_ARTEC_LOG_INFO("Stopping scanner procedure from Abort");
-            RR_CALL_ARTEC(scanning_procedure->setState(asdk::ScanningState::ScanningState_Stop), 
-                "Error stopping scanner");
-        }
-        lock.unlock();
-        handler(nullptr);
+        auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
+        ret->action_status = started ? rr_action::ActionStatusCode::running : rr_action::ActionStatusCode::queued;
+        ret->model_handle = 0;
+        ret->frame_count = frame_count;
+        ret->job_id = job_id;
+        ret->queue_position = started ? 0 : job_manager->GetQueuePosition(job_id);
+        return ret;
     }
 
     void ScanningProcedure::scan_job_complete(artec::sdk::base::ErrorCode result)
     {
         RR_ARTEC_LOG_INFO("Scanning procedure artec job complete: " << (int32_t)result);
 
+        snapshot_queue.SetDirect(model->model);
+
         boost::mutex::scoped_lock lock(this_lock);
         artec_job_complete = true;
         artec_job_status = result;
+        cpu_lease.reset();
+        // Free the job slot for queued jobs
+        job_ticket.reset();
         auto h = next_handler;
         next_handler.clear();
         if (h)
@@ -212,42 +199,158 @@ namespace artec_scanner_robotraconteur_driver
             return;
         }
 
-        auto handle = GetParent()->add_model(model);
+        auto parent = GetParent();
+        auto handle = parent->add_model(model);
+        parent->autosave_model(handle, model, "scanning_procedure");
         auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
         ret->action_status = rr_action::ActionStatusCode::complete;
         ret->model_handle = handle;
+        ret->frame_count = frame_count;
+        ret->job_id = job_id;
+        ret->queue_position = 0;
         handler(ret,nullptr);
     }
 
-    void ScanningProcedure::next_timer_handler(const RR::TimerEvent& evt)
+    void ScanningProcedureObserver::onFrameScanned(const artec::sdk::scanning::RegistrationInfo* frameInfo)
     {
-        boost::mutex::scoped_lock lock(this_lock);
-        auto h = next_handler;
-        next_handler.clear();
-        if (h)
+        service_snapshots(true);
+    }
+        
+    void ScanningProcedureObserver::onFrameCaptured(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+    {
+        service_snapshots(false);
+    }
+
+    void ScanningProcedureObserver::service_snapshots(bool frame_scanned)
+    {
+        auto p = parent.lock();
+        if (!p) return;
+        if (frame_scanned)
         {
-            auto ret = rr_artec::ScanningProcedureStatusPtr(new rr_artec::ScanningProcedureStatus());
-            ret->action_status = rr_action::ActionStatusCode::running;
-            ret->model_handle = 0;
-            h(ret, nullptr);
-            return;
+            p->frame_count.fetch_add(1, boost::memory_order_relaxed);
         }
+        p->snapshot_queue.Service(p->model->model);
     }
 
+    void ScanningProcedureObserver::onScanningFinished (int scannerIndex)
+    {
 
-    void ScanningProcedureObserver::onFrameScanned(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+    }
+
+    const boost::posix_time::time_duration ScanningSnapshotQueue::stall_period = boost::posix_time::milliseconds(500);
+
+    void ScanningSnapshotQueue::copy_request(asdk::IModel* src, Request& req)
     {
+        req.frame_count = CopyModelFramesShallow(src, req.dst, req.first_frames, &req.end_frames);
+    }
 
+    bool ScanningSnapshotQueue::Snapshot(asdk::IModel* dst, const std::vector<int>& first_frames,
+        const boost::posix_time::time_duration& timeout, size_t& frame_count, std::vector<int>* end_frames)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        auto req = boost::make_shared<Request>();
+        req->dst = dst;
+        req->first_frames = first_frames;
+        if (direct_src)
+        {
+            copy_request(direct_src, *req);
+            frame_count = req->frame_count;
+            if (end_frames)
+            {
+                end_frames->swap(req->end_frames);
+            }
+            return true;
+        }
+
+        requests.push_back(req);
+
+        auto deadline = boost::get_system_time() + timeout;
+        while (!req->done)
+        {
+            auto now = boost::get_system_time();
+            if (now >= deadline)
+            {
+                break;
+            }
+            if (running_src && now - last_service >= stall_period)
+            {
+                // No frame has been reported, for example while the scanner is not tracking, so the SDK is not
+                // appending to the output model
+                RR_ARTEC_LOG_INFO("Scanning procedure is not producing frames, copying snapshot directly");
+                service_requests(running_src);
+                break;
+            }
+            snapshot_cv.timed_wait(lock, std::min(deadline, now + stall_period));
+        }
+
+        if (!req->done)
+        {
+            requests.remove(req);
+            return false;
+        }
+        if (!req->error.empty())
+        {
+            throw RR::OperationFailedException("Error copying scanning snapshot: " + req->error);
+        }
+        frame_count = req->frame_count;
+        if (end_frames)
+        {
+            end_frames->swap(req->end_frames);
+        }
+        return true;
     }
-        
-    void ScanningProcedureObserver::onFrameCaptured(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+
+    void ScanningSnapshotQueue::Service(asdk::IModel* src)
     {
+        boost::mutex::scoped_lock lock(this_lock);
+        last_service = boost::get_system_time();
+        service_requests(src);
+    }
 
+    void ScanningSnapshotQueue::service_requests(asdk::IModel* src)
+    {
+        if (requests.empty())
+        {
+            return;
+        }
+        for (auto& req : requests)
+        {
+            try
+            {
+                copy_request(src, *req);
+            }
+            catch (std::exception& e)
+            {
+                RR_ARTEC_LOG_ERROR("Error copying scanning procedure snapshot: " << e.what());
+                req->error = e.what();
+                if (req->error.empty())
+                {
+                    req->error = "unknown error";
+                }
+            }
+            req->done = true;
+        }
+        requests.clear();
+        snapshot_cv.notify_all();
     }
 
-    void ScanningProcedureObserver::onScanningFinished (int scannerIndex)
+    void ScanningSnapshotQueue::SetDirect(asdk::IModel* src)
     {
+        boost::mutex::scoped_lock lock(this_lock);
+        direct_src = src;
+        running_src = nullptr;
+        if (src)
+        {
+            service_requests(src);
+        }
+    }
 
+    void ScanningSnapshotQueue::SetRunning(asdk::IModel* src)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        direct_src = nullptr;
+        running_src = src;
+        last_service = boost::get_system_time();
     }
 
     ScanningProcedureObserver::ScanningProcedureObserver(boost::shared_ptr<ScanningProcedure> parent)
@@ -0,0 +1,229 @@
+#include "artec_scanning_session.h"
+#include "artec_scanner_impl.h"
+#include "artec_scanner_util.h"
+
+#include <artec/sdk/base/IModel.h>
+#include <artec/sdk/base/IScan.h>
+#include <artec/sdk/scanning/IScanningProcedure.h>
+
+namespace asdk {
+    using namespace artec::sdk::base;
+    using namespace artec::sdk::capturing;
+    using namespace artec::sdk::scanning;
+};
+using asdk::TRef;
+
+namespace RR=RobotRaconteur;
+namespace rr_artec = experimental::artec_scanner;
+
+namespace artec_scanner_robotraconteur_driver
+{
+    boost::shared_ptr<ArtecScannerImpl> ScanningSession::GetParent()
+    {
+        auto p = parent.lock();
+        if (!p) {
+            RR_ARTEC_LOG_ERROR("ArtecScannerImpl parent has been released");
+            throw RR::InvalidOperationException("ArtecScannerImpl parent has been released");
+        }
+        return p;
+    }
+
+    ScanningSession::ScanningSession(boost::shared_ptr<ArtecScannerImpl> parent)
+    {
+        this->parent = parent;
+    }
+
+    void ScanningSession::Init(const rr_artec::ScanningProcedureSettingsPtr& settings, asdk::IScanner* scanner)
+    {
+        RR_NULL_CHECK(settings);
+        asdk::ScanningProcedureSettings desc = { 0 };
+        ScanningProcedureSettingsToArtec(settings, desc);
+        observer = boost::make_shared<ScanningSessionObserver>(shared_from_this());
+        desc.scanningCallback = observer.get();
+        state = settings->initial_state;
+
+        RR_CALL_ARTEC(asdk::createScanningProcedure(&this->scanning_procedure, scanner, &desc),
+            "Error creating scanning procedure");
+
+        model = boost::make_shared<RRArtecModel>();
+        RR_CALL_ARTEC(asdk::createModel(&input_container), "Error creating input model");
+        RR_CALL_ARTEC(asdk::createCancellationTokenSource(&ct_source), "Error creating cancellation source");
+
+        workset.in = input_container;
+        workset.out = model->model;
+        workset.cancellation = ct_source->getToken();
+        workset.progress = nullptr;
+        workset.threadsCount = 0;
+
+        // The session is created synchronously, so it is not left waiting in the job queue
+        job_ticket = GetParent()->job_manager->Submit("scanning_session", boost::function<void()>(), false,
+            settings->job_priority);
+        if (!job_ticket->IsAdmitted())
+        {
+            job_ticket.reset();
+            RR_ARTEC_LOG_ERROR("No job slot available for scanning session");
+            throw RR::OperationFailedException("No job slot available for scanning session");
+        }
+
+        job_observer = RR_MAKE_SHARED<ScanningSessionJobObserver>(shared_from_this());
+        cpu_lease = GetParent()->cpu_budget->AcquireRealtime();
+        snapshot_queue.SetRunning(model->model);
+        auto launch_res = asdk::launchJob(scanning_procedure, &workset, job_observer.get());
+        if (launch_res != asdk::ErrorCode_OK)
+        {
+            job_observer.reset();
+            cpu_lease.reset();
+            job_ticket.reset();
+            snapshot_queue.SetDirect(model->model);
+        }
+        RR_CALL_ARTEC(launch_res, "Error launching scanning session");
+        running = true;
+        RR_ARTEC_LOG_INFO("Started scanning session");
+    }
+
+    void ScanningSession::Stop()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (!running)
+        {
+            return;
+        }
+        RR_ARTEC_LOG_INFO("Stopping scanning session");
+        RR_CALL_ARTEC(scanning_procedure->setState(asdk::ScanningState_Stop), "Error stopping scanning session");
+    }
+
+    void ScanningSession::set_state(rr_artec::ScanningState::ScanningState new_state)
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (!running)
+        {
+            RR_ARTEC_LOG_ERROR("Attempt to change state of stopped scanning session");
+            throw RR::InvalidOperationException("Scanning session is stopped");
+        }
+        RR_CALL_ARTEC(scanning_procedure->setState((asdk::ScanningState)new_state),
+            "Error setting scanning session state");
+        state = new_state;
+    }
+
+    rr_artec::ScanningState::ScanningState ScanningSession::get_state()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        if (!running)
+        {
+            return rr_artec::ScanningState::stop;
+        }
+        return state;
+    }
+
+    uint32_t ScanningSession::get_frame_count()
+    {
+        return frame_count;
+    }
+
+    uint32_t ScanningSession::get_segment_frame_count()
+    {
+        boost::mutex::scoped_lock lock(this_lock);
+        return frame_count - segment_start_frame_count;
+    }
+
+    void ScanningSession::preview()
+    {
+        set_state(rr_artec::ScanningState::preview);
+    }
+
+    void ScanningSession::record()
+    {
+        set_state(rr_artec::ScanningState::record);
+    }
+
+    void ScanningSession::pause()
+    {
+        // Preview keeps capturing and tracking without adding frames to the output model
+        set_state(rr_artec::ScanningState::preview);
+    }
+
+    void ScanningSession::continue_record()
+    {
+        set_state(rr_artec::ScanningState::continue_record);
+    }
+
+    int32_t ScanningSession::cut_segment()
+    {
+        auto segment_model = boost::make_shared<RRArtecModel>();
+        {
+            // this_lock is not held while waiting, so the state can still be read and changed during the cut
+            boost::mutex::scoped_lock cut_lock(cut_segment_lock);
+            uint32_t cut_frame_count = frame_count;
+            size_t segment_frames = 0;
+            // The frames are shared with the procedure output, which the SDK keeps using, so the output is
+            // never trimmed. The next segment starts after the frames copied into this one.
+            std::vector<int> segment_end;
+            if (!snapshot_queue.Snapshot(segment_model->model, segment_start, boost::posix_time::seconds(5),
+                segment_frames, &segment_end))
+            {
+                RR_ARTEC_LOG_ERROR("Timed out waiting for scanning session segment");
+                throw RR::OperationFailedException("Timed out waiting for scanning session segment");
+            }
+
+            segment_start.swap(segment_end);
+            {
+                boost::mutex::scoped_lock lock(this_lock);
+                segment_start_frame_count = cut_frame_count;
+            }
+            RR_ARTEC_LOG_INFO("Scanning session segment contains " << segment_frames << " frames");
+        }
+        auto parent = GetParent();
+        auto handle = parent->add_model(segment_model);
+        parent->autosave_model(handle, segment_model, "scanning_session");
+        return handle;
+    }
+
+    void ScanningSession::scan_job_complete(asdk::ErrorCode result)
+    {
+        RR_ARTEC_LOG_INFO("Scanning session artec job complete: " << (int32_t)result);
+        snapshot_queue.SetDirect(model->model);
+        boost::mutex::scoped_lock lock(this_lock);
+        running = false;
+        artec_job_status = result;
+        cpu_lease.reset();
+        job_ticket.reset();
+    }
+
+    ScanningSessionObserver::ScanningSessionObserver(boost::shared_ptr<ScanningSession> parent)
+    {
+        this->parent = parent;
+    }
+
+    void ScanningSessionObserver::onFrameScanned(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+    {
+        auto p = parent.lock();
+        if (!p) return;
+        p->frame_count.fetch_add(1, boost::memory_order_relaxed);
+        p->snapshot_queue.Service(p->model->model);
+    }
+
+    void ScanningSessionObserver::onFrameCaptured(const artec::sdk::scanning::RegistrationInfo* frameInfo)
+    {
+        auto p = parent.lock();
+        if (!p) return;
+        p->snapshot_queue.Service(p->model->model);
+    }
+
+    void ScanningSessionObserver::onScanningFinished (int scannerIndex)
+    {
+
+    }
+
+    ScanningSessionJobObserver::ScanningSessionJobObserver(boost::shared_ptr<ScanningSession> parent)
+    {
+        this->parent = parent;
+    }
+
+    void ScanningSessionJobObserver::completed(asdk::ErrorCode result)
+    {
+        boost::shared_ptr<ScanningSession> p = parent;
+        if (!p) return;
+        parent.reset();
+        p->scan_job_complete(result);
+    }
+}